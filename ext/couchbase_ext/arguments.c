@@ -17,18 +17,65 @@
 
 #include "couchbase_ext.h"
 
+/* Command arrays are carved out of the bucket arena, which is reused by
+ * subsequent calls. Nested calls (e.g. from transcoder) continue on top
+ * of the used part and the arena grows only when nobody refers to it,
+ * otherwise the memory comes from the heap. Everything allocated by the
+ * call is released by cb_params_destroy(). The outermost cb_params_build()
+ * starts with empty arena, so the error raised between build and destroy
+ * doesn't pin it. */
+#define CB_ARENA_ALIGN 16
+#define CB_ARENA_MAX (1024 * 1024)
+
+    static void *
+cb_params_alloc(struct cb_params_st *params, size_t size)
+{
+    struct cb_bucket_st *bucket = params->bucket;
+    void *ptr;
+
+    size = (size + CB_ARENA_ALIGN - 1) & ~(size_t)(CB_ARENA_ALIGN - 1);
+    if (size <= CB_ARENA_MAX) {
+        if (bucket->arena_used == 0 && bucket->arena_size < size) {
+            size_t nn = bucket->arena_size ? bucket->arena_size : 1024;
+            while (nn < size) {
+                nn <<= 1;
+            }
+            ptr = realloc(bucket->arena, nn);
+            if (ptr != NULL) {
+                bucket->arena = ptr;
+                bucket->arena_size = nn;
+            }
+        }
+        if (bucket->arena_size - bucket->arena_used >= size) {
+            ptr = bucket->arena + bucket->arena_used;
+            bucket->arena_used += size;
+            memset(ptr, 0, size);
+            return ptr;
+        }
+    }
+    ptr = calloc(1, size);
+    if (ptr == NULL) {
+        rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for arguments");
+    }
+    return ptr;
+}
+
+    static void
+cb_params_free(struct cb_params_st *params, void *ptr)
+{
+    struct cb_bucket_st *bucket = params->bucket;
+
+    if ((char *)ptr < bucket->arena || (char *)ptr >= bucket->arena + bucket->arena_size) {
+        free(ptr);
+    }
+}
+
 #define _alloc_data_for_s(type, _type, size, items, ptr) do {\
     lcb_size_t ii; \
     \
     params->cmd.type.num = size; \
-    params->cmd.type.items = calloc(size, sizeof(_type)); \
-    if (params->cmd.type.items == NULL) { \
-        rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for arguments"); \
-    } \
-    params->cmd.type.ptr = calloc(size, sizeof(_type *)); \
-    if (params->cmd.type.ptr == NULL) { \
-        rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for arguments"); \
-    } \
+    params->cmd.type.items = cb_params_alloc(params, size * sizeof(_type)); \
+    params->cmd.type.ptr = cb_params_alloc(params, size * sizeof(_type *)); \
     for (ii = 0; ii < size; ++ii) { \
         params->cmd.type.ptr[ii] = params->cmd.type.items + ii; \
     } \
@@ -38,13 +85,13 @@
 
 
 #define _release_data_for_s(type, items, ptr) \
-    free(params->cmd.type.items); \
-    free(params->cmd.type.ptr);
+    cb_params_free(params, params->cmd.type.items); \
+    cb_params_free(params, params->cmd.type.ptr);
 
 #define _release_data_for(type) _release_data_for_s(type, items, ptr)
 
     static VALUE
-get_transcoder(struct cb_bucket_st *bucket, VALUE override, int compat, VALUE opts)
+get_transcoder(struct cb_bucket_st *bucket, VALUE override, int compat, VALUE *opts)
 {
     VALUE ret = Qundef;
 
@@ -71,13 +118,42 @@ get_transcoder(struct cb_bucket_st *bucket, VALUE override, int compat, VALUE op
     if (ret == Qundef) {
         return bucket->transcoder;
     } else {
-        rb_hash_aset(opts, cb_sym_forced, Qtrue);
+        if (NIL_P(*opts)) {
+            *opts = rb_hash_new();
+        }
+        rb_hash_aset(*opts, cb_sym_forced, Qtrue);
         return ret;
     }
 }
 
+/* Convert the key to the String sent to the server. The key without
+ * prefix is remembered in params->keys, so that responses could return the
+ * same object instead of building new String from the packet. */
+    static VALUE
+cb_params_key(struct cb_params_st *params, VALUE key_obj)
+{
+    VALUE key, prefixed;
+
+    key = cb_unify_key_frozen(params->bucket, key_obj, &prefixed);
+    if (!RTEST(params->keys)) {
+        params->keys = rb_ary_new();
+    }
+    rb_ary_push(params->keys, key);
+    rb_ary_push(params->ensurance, prefixed);
+    return prefixed;
+}
+
 /* TOUCH */
 
+    static void
+cb_params_parse_timeout(struct cb_params_st *params, VALUE options)
+{
+    VALUE tmp = rb_hash_aref(options, cb_sym_timeout);
+    if (tmp != Qnil) {
+        params->timeout = (uint32_t)NUM2ULONG(tmp);
+    }
+}
+
     static void
 cb_params_touch_alloc(struct cb_params_st *params, lcb_size_t size)
 {
@@ -87,8 +163,7 @@ cb_params_touch_alloc(struct cb_params_st *params, lcb_size_t size)
     static void
 cb_params_touch_init_item(struct cb_params_st *params, lcb_size_t idx, VALUE key_obj, lcb_time_t exptime)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
     params->cmd.touch.items[idx].v.v0.key = RSTRING_PTR(key_obj);
     params->cmd.touch.items[idx].v.v0.nkey = RSTRING_LEN(key_obj);
     params->cmd.touch.items[idx].v.v0.exptime = exptime;
@@ -172,8 +247,7 @@ cb_params_remove_alloc(struct cb_params_st *params, lcb_size_t size)
     static void
 cb_params_remove_init_item(struct cb_params_st *params, lcb_size_t idx, VALUE key_obj, lcb_cas_t cas)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
     params->cmd.remove.items[idx].v.v0.key = RSTRING_PTR(key_obj);
     params->cmd.remove.items[idx].v.v0.nkey = RSTRING_LEN(key_obj);
     params->cmd.remove.items[idx].v.v0.cas = cas;
@@ -196,6 +270,10 @@ cb_params_remove_parse_options(struct cb_params_st *params, VALUE options)
     if (NIL_P(options)) {
         return;
     }
+    tmp = rb_hash_lookup2(options, cb_sym_batch_callback, Qundef);
+    if (tmp != Qundef) {
+        params->batch = RTEST(tmp);
+    }
     tmp = rb_hash_lookup2(options, cb_sym_quiet, Qundef);
     if (tmp != Qundef) {
         params->cmd.remove.quiet = RTEST(tmp);
@@ -204,6 +282,7 @@ cb_params_remove_parse_options(struct cb_params_st *params, VALUE options)
     if (tmp != Qnil) {
         params->cmd.remove.cas = NUM2ULL(tmp);
     }
+    cb_params_parse_timeout(params, options);
 }
 
     static void
@@ -258,22 +337,8 @@ cb_params_store_init_item(struct cb_params_st *params, lcb_size_t idx,
         VALUE key_obj, VALUE value_obj, lcb_uint32_t flags, lcb_cas_t cas,
         lcb_time_t exptime)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    value_obj = cb_encode_value(params->cmd.store.transcoder, value_obj, &flags, params->cmd.store.transcoder_opts);
-    if (rb_obj_is_kind_of(value_obj, rb_eStandardError)) {
-        VALUE exc_str = rb_funcall(value_obj, cb_id_to_s, 0);
-        VALUE msg = rb_funcall(rb_mKernel, cb_id_sprintf, 3,
-                rb_str_new2("unable to convert value for key \"%s\": %s"), key_obj, exc_str);
-        VALUE exc = rb_exc_new3(cb_eValueFormatError, msg);
-        rb_ivar_set(exc, cb_id_iv_inner_exception, value_obj);
-        rb_exc_raise(exc);
-    }
-    /* the value must be string after conversion */
-    if (TYPE(value_obj) != T_STRING) {
-        VALUE val = rb_any_to_s(value_obj);
-        rb_raise(cb_eValueFormatError, "unable to convert value for key \"%s\" to string: %s", RSTRING_PTR(key_obj), RSTRING_PTR(val));
-    }
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
+    value_obj = cb_encode_value_bang(params->cmd.store.transcoder, key_obj, value_obj, &flags, params->cmd.store.transcoder_opts);
     rb_ary_push(params->ensurance, value_obj);
     params->cmd.store.items[idx].v.v0.datatype = params->cmd.store.datatype;
     params->cmd.store.items[idx].v.v0.operation = params->cmd.store.operation;
@@ -304,6 +369,10 @@ cb_params_store_parse_options(struct cb_params_st *params, VALUE options)
     if (NIL_P(options)) {
         return;
     }
+    tmp = rb_hash_lookup2(options, cb_sym_batch_callback, Qundef);
+    if (tmp != Qundef) {
+        params->batch = RTEST(tmp);
+    }
     tmp = rb_hash_aref(options, cb_sym_flags);
     if (tmp != Qnil) {
         params->cmd.store.flags = (lcb_uint32_t)NUM2ULONG(tmp);
@@ -325,13 +394,14 @@ cb_params_store_parse_options(struct cb_params_st *params, VALUE options)
     tmp = rb_hash_aref(options, cb_sym_format);
     if (tmp != Qnil) {
         params->cmd.store.transcoder = get_transcoder(params->bucket,
-                tmp, 1, params->cmd.store.transcoder_opts);
+                tmp, 1, &params->cmd.store.transcoder_opts);
     }
     tmp = rb_hash_lookup2(options, cb_sym_transcoder, Qundef);
     if (tmp != Qundef) {
         params->cmd.store.transcoder = get_transcoder(params->bucket,
-                tmp, 0, params->cmd.store.transcoder_opts);
+                tmp, 0, &params->cmd.store.transcoder_opts);
     }
+    cb_params_parse_timeout(params, options);
 }
 
     static void
@@ -384,8 +454,7 @@ cb_params_get_alloc(struct cb_params_st *params, lcb_size_t size)
 cb_params_get_init_item(struct cb_params_st *params, lcb_size_t idx,
         VALUE key_obj, lcb_time_t exptime)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
     if (RTEST(params->cmd.get.replica)) {
         params->cmd.get.items_gr[idx].version = 1;
         params->cmd.get.items_gr[idx].v.v1.key = RSTRING_PTR(key_obj);
@@ -425,6 +494,10 @@ cb_params_get_parse_options(struct cb_params_st *params, VALUE options)
     if (NIL_P(options)) {
         return;
     }
+    tmp = rb_hash_lookup2(options, cb_sym_batch_callback, Qundef);
+    if (tmp != Qundef) {
+        params->batch = RTEST(tmp);
+    }
     tmp = rb_hash_aref(options, cb_sym_replica);
     if (tmp == Qtrue || tmp == cb_sym_all || tmp == cb_sym_first) {
         params->cmd.get.replica = tmp;
@@ -445,12 +518,12 @@ cb_params_get_parse_options(struct cb_params_st *params, VALUE options)
     tmp = rb_hash_aref(options, cb_sym_format);
     if (tmp != Qnil) {
         params->cmd.get.transcoder = get_transcoder(params->bucket,
-                tmp, 1, params->cmd.get.transcoder_opts);
+                tmp, 1, &params->cmd.get.transcoder_opts);
     }
     tmp = rb_hash_lookup2(options, cb_sym_transcoder, Qundef);
     if (tmp != Qundef) {
         params->cmd.get.transcoder = get_transcoder(params->bucket,
-                tmp, 0, params->cmd.get.transcoder_opts);
+                tmp, 0, &params->cmd.get.transcoder_opts);
     }
     tmp = rb_hash_aref(options, cb_sym_ttl);
     if (tmp != Qnil) {
@@ -464,6 +537,7 @@ cb_params_get_parse_options(struct cb_params_st *params, VALUE options)
             params->cmd.get.ttl = NUM2ULONG(tmp);
         }
     }
+    cb_params_parse_timeout(params, options);
 }
 
     static void
@@ -523,8 +597,7 @@ cb_params_arith_alloc(struct cb_params_st *params, lcb_size_t size)
 cb_params_arith_init_item(struct cb_params_st *params, lcb_size_t idx,
         VALUE key_obj, lcb_int64_t delta)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
     params->cmd.arith.items[idx].v.v0.key = RSTRING_PTR(key_obj);
     params->cmd.arith.items[idx].v.v0.nkey = RSTRING_LEN(key_obj);
     params->cmd.arith.items[idx].v.v0.delta = delta * params->cmd.arith.sign;
@@ -550,6 +623,10 @@ cb_params_arith_parse_options(struct cb_params_st *params, VALUE options)
     if (NIL_P(options)) {
         return;
     }
+    tmp = rb_hash_lookup2(options, cb_sym_batch_callback, Qundef);
+    if (tmp != Qundef) {
+        params->batch = RTEST(tmp);
+    }
     tmp = rb_hash_aref(options, cb_sym_create);
     if (tmp != Qnil) {
         params->cmd.arith.create = RTEST(tmp);
@@ -571,13 +648,14 @@ cb_params_arith_parse_options(struct cb_params_st *params, VALUE options)
     tmp = rb_hash_aref(options, cb_sym_format);
     if (tmp != Qnil) {
         params->cmd.arith.transcoder = get_transcoder(params->bucket,
-                tmp, 1, params->cmd.arith.transcoder_opts);
+                tmp, 1, &params->cmd.arith.transcoder_opts);
     }
     tmp = rb_hash_lookup2(options, cb_sym_transcoder, Qundef);
     if (tmp != Qundef) {
         params->cmd.arith.transcoder = get_transcoder(params->bucket,
-                tmp, 0, params->cmd.arith.transcoder_opts);
+                tmp, 0, &params->cmd.arith.transcoder_opts);
     }
+    cb_params_parse_timeout(params, options);
 }
 
     static void
@@ -733,8 +811,7 @@ cb_params_unlock_alloc(struct cb_params_st *params, lcb_size_t size)
     static void
 cb_params_unlock_init_item(struct cb_params_st *params, lcb_size_t idx, VALUE key_obj, lcb_cas_t cas)
 {
-    key_obj = cb_unify_key(params->bucket, key_obj, 1);
-    rb_ary_push(params->ensurance, key_obj);
+    key_obj = cb_params_key(params, key_obj);
     params->cmd.unlock.items[idx].v.v0.key = RSTRING_PTR(key_obj);
     params->cmd.unlock.items[idx].v.v0.nkey = RSTRING_LEN(key_obj);
     params->cmd.unlock.items[idx].v.v0.cas = cas;
@@ -802,6 +879,7 @@ cb_params_version_alloc(struct cb_params_st *params)
     void
 cb_params_destroy(struct cb_params_st *params)
 {
+    params->bucket->arena_used = params->arena_mark;
     rb_ary_clear(params->ensurance);
     params->ensurance = Qfalse;
     params->args = Qfalse;
@@ -837,6 +915,36 @@ cb_params_destroy(struct cb_params_st *params)
     }
 }
 
+/*
+ * Set defaults and parse the options of get or store command, without
+ * touching the arguments. Used by cb_params_build and by prepared
+ * operations, which keep the result to skip the options on every call.
+ */
+    void
+cb_params_prepare(struct cb_params_st *params, VALUE opts)
+{
+    switch (params->type) {
+        case cb_cmd_store:
+            params->cmd.store.datatype = 0x00;
+            params->cmd.store.ttl = params->bucket->default_ttl;
+            params->cmd.store.flags = params->bucket->default_flags;
+            params->cmd.store.observe = Qnil;
+            params->cmd.store.transcoder = params->bucket->transcoder;
+            params->cmd.store.transcoder_opts = Qnil;
+            cb_params_store_parse_options(params, opts);
+            break;
+        case cb_cmd_get:
+            params->cmd.get.quiet = params->bucket->quiet;
+            params->cmd.get.transcoder = params->bucket->transcoder;
+            params->cmd.get.transcoder_opts = Qnil;
+            params->cmd.get.replica = Qfalse;
+            cb_params_get_parse_options(params, opts);
+            break;
+        default:
+            rb_raise(rb_eArgError, "the command doesn't support preparing");
+    }
+}
+
     static VALUE
 do_params_build(VALUE ptr)
 {
@@ -846,8 +954,8 @@ do_params_build(VALUE ptr)
     int argc = RARRAY_LEN(params->args);
     VALUE argv = params->args;
 
-    /* extract options */
-    if (argc > 1 && TYPE(rb_ary_entry(argv, argc-1)) == T_HASH) {
+    /* extract options, prepared operations have them resolved already */
+    if (params->prepared == NULL && argc > 1 && TYPE(rb_ary_entry(argv, argc-1)) == T_HASH) {
         opts = rb_ary_pop(argv);
         --argc;
     } else {
@@ -882,26 +990,30 @@ do_params_build(VALUE ptr)
                 opts = Qnil;
                 ++argc;
             }
-            params->cmd.store.datatype = 0x00;
-            params->cmd.store.ttl = params->bucket->default_ttl;
-            params->cmd.store.flags = params->bucket->default_flags;
-            params->cmd.store.observe = Qnil;
-            params->cmd.store.transcoder = params->bucket->transcoder;
-            params->cmd.store.transcoder_opts = rb_hash_new();
-            cb_params_store_parse_options(params, opts);
+            if (params->prepared) {
+                params->cmd.store = params->prepared->params.cmd.store;
+                params->batch = params->prepared->params.batch;
+                params->timeout = params->prepared->params.timeout;
+            } else {
+                cb_params_prepare(params, opts);
+            }
             cb_params_store_parse_arguments(params, argc, argv);
             break;
         case cb_cmd_get:
-            params->cmd.get.quiet = params->bucket->quiet;
-            params->cmd.get.transcoder = params->bucket->transcoder;
-            params->cmd.get.transcoder_opts = rb_hash_new();
-            params->cmd.get.replica = Qfalse;
-            cb_params_get_parse_options(params, opts);
+            if (params->prepared) {
+                VALUE keys_ary = params->cmd.get.keys_ary;
+                params->cmd.get = params->prepared->params.cmd.get;
+                params->cmd.get.keys_ary = keys_ary;
+                params->batch = params->prepared->params.batch;
+                params->timeout = params->prepared->params.timeout;
+            } else {
+                cb_params_prepare(params, opts);
+            }
             cb_params_get_parse_arguments(params, argc, argv);
             break;
         case cb_cmd_arith:
             params->cmd.arith.transcoder = params->bucket->transcoder;
-            params->cmd.arith.transcoder_opts = rb_hash_new();
+            params->cmd.arith.transcoder_opts = Qnil;
             params->cmd.arith.create = params->bucket->default_arith_create;
             params->cmd.arith.initial = params->bucket->default_arith_init;
             params->cmd.arith.delta = 1;
@@ -937,6 +1049,10 @@ do_params_build(VALUE ptr)
             cb_params_unlock_parse_arguments(params, argc, argv);
             break;
     }
+    if (params->timeout && params->bucket->async) {
+        /* the deadline is a timer around lcb_wait() */
+        rb_raise(rb_eArgError, "the :timeout option is not supported in asynchronous mode");
+    }
 
     return Qnil;
 }
@@ -944,10 +1060,20 @@ do_params_build(VALUE ptr)
     void
 cb_params_build(struct cb_params_st *params)
 {
+    struct cb_bucket_st *bucket = params->bucket;
     int fail = 0;
+
+    if (bucket->arena_nesting == 0) {
+        /* not called from transcoder of another call, so the arena is
+         * free, unless the previous call raised before cb_params_destroy() */
+        bucket->arena_used = 0;
+    }
     params->ensurance = rb_ary_new();
+    params->arena_mark = bucket->arena_used;
 
+    bucket->arena_nesting++;
     rb_protect(do_params_build, (VALUE)params, &fail);
+    bucket->arena_nesting--;
     if (fail) {
         cb_params_destroy(params);
         /* raise exception from protected block */
@@ -23,11 +23,12 @@ cb_arithmetic_callback(lcb_t handle, const void *cookie, lcb_error_t error, cons
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE cas, key, val, exc, res;
+    struct cb_result_st *result;
     ID o;
 
     ctx->nqueries--;
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    cb_latency_record(ctx, cb_latency_arith, resp->v.v0.key, resp->v.v0.nkey, CB_LATENCY_NO_SIZE);
 
     cas = resp->v.v0.cas > 0 ? ULL2NUM(resp->v.v0.cas) : Qnil;
     o = ctx->arith > 0 ? cb_sym_increment : cb_sym_decrement;
@@ -40,32 +41,65 @@ cb_arithmetic_callback(lcb_t handle, const void *cookie, lcb_error_t error, cons
     val = ULL2NUM(resp->v.v0.value);
     if (bucket->async) {    /* asynchronous */
         if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_operation, o);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            rb_ivar_set(res, cb_id_iv_value, val);
-            rb_ivar_set(res, cb_id_iv_cas, cas);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->operation = o;
+            result->key = key;
+            result->value = val;
+            result->cas = resp->v.v0.cas;
+            result->has_cas = resp->v.v0.cas > 0;
+            cb_context_yield(ctx, res);
         }
     } else {                /* synchronous */
         if (NIL_P(exc)) {
             if (ctx->extended) {
-                rb_hash_aset(ctx->rv, key, rb_ary_new3(2, val, cas));
+                cb_context_set_result(ctx, key, rb_ary_new3(2, val, cas));
             } else {
-                rb_hash_aset(ctx->rv, key, val);
+                cb_context_set_result(ctx, key, val);
             }
         }
     }
     if (ctx->nqueries == 0) {
+        cb_context_flush_batch(ctx);
         ctx->proc = Qnil;
-        if (bucket->async) {
+        cb_context_complete(ctx);
+        if (bucket->async || ctx->detached) {
             cb_context_free(ctx);
         }
     }
     (void)handle;
 }
 
+/* synchronous incr/decr of the single key without options */
+    static VALUE
+cb_bucket_arithmetic_single(int sign, struct cb_bucket_st *bucket, VALUE key, lcb_int64_t delta)
+{
+    struct cb_context_st *ctx;
+    lcb_arithmetic_cmd_t cmd;
+    const lcb_arithmetic_cmd_t *ptr = &cmd;
+    lcb_error_t err;
+    VALUE prefixed, exc;
+
+    key = cb_unify_key_frozen(bucket, key, &prefixed);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.v.v0.key = RSTRING_PTR(prefixed);
+    cmd.v.v0.nkey = RSTRING_LEN(prefixed);
+    cmd.v.v0.delta = delta * sign;
+    cmd.v.v0.exptime = bucket->default_ttl;
+    cmd.v.v0.create = bucket->default_arith_create;
+    cmd.v.v0.initial = bucket->default_arith_init;
+    ctx = cb_context_alloc_single(bucket, key);
+    ctx->arith = sign;
+    err = lcb_arithmetic(bucket->handle, (const void *)ctx, 1, &ptr);
+    exc = cb_check_error(err, "failed to schedule arithmetic request", Qnil);
+    if (exc != Qnil) {
+        cb_context_free(ctx);
+        rb_exc_raise(exc);
+    }
+    bucket->nbytes += CB_PACKET_HEADER_SIZE + cmd.v.v0.nkey;
+    return cb_context_wait(ctx);
+}
+
     static inline VALUE
 cb_bucket_arithmetic(int sign, int argc, VALUE *argv, VALUE self)
 {
@@ -78,6 +112,12 @@ cb_bucket_arithmetic(int sign, int argc, VALUE *argv, VALUE self)
     if (!cb_bucket_connected_bang(bucket, sign > 0 ? cb_sym_increment : cb_sym_decrement)) {
         return Qnil;
     }
+    if (!bucket->async && !rb_block_given_p() && (argc == 1 || argc == 2) &&
+            CB_SINGLE_KEY_P(argv[0]) && (argc == 1 || TYPE(argv[1]) == T_FIXNUM)) {
+        /* allow form incr("foo", 1) */
+        lcb_int64_t delta = (argc == 2) ? (NUM2ULL(argv[1]) & INT64_MAX) : 1;
+        return cb_bucket_arithmetic_single(sign, bucket, argv[0], delta);
+    }
 
     memset(&params, 0, sizeof(struct cb_params_st));
     rb_scan_args(argc, argv, "0*&", &params.args, &proc);
@@ -89,7 +129,12 @@ cb_bucket_arithmetic(int sign, int argc, VALUE *argv, VALUE self)
     params.cmd.arith.sign = sign;
     cb_params_build(&params);
     ctx = cb_context_alloc_common(bucket, proc, params.cmd.arith.num);
+    cb_context_index_init(ctx, params.keys);
+    if (bucket->async && params.batch) {
+        ctx->batch = rb_ary_new2(params.cmd.arith.num);
+    }
     ctx->extended = params.cmd.arith.extended;
+    ctx->arith = sign;
     err = lcb_arithmetic(bucket->handle, (const void *)ctx,
             params.cmd.arith.num, params.cmd.arith.ptr);
     cb_params_destroy(&params);
@@ -98,14 +143,15 @@ cb_bucket_arithmetic(int sign, int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_set_deadline(ctx, params.timeout);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
@@ -158,6 +204,14 @@ cb_bucket_arithmetic(int sign, int argc, VALUE *argv, VALUE self)
  *   @option options [true, false] :extended (false) If set to +true+, the
  *     operation will return tuple +[value, cas]+, otherwise (by default) it
  *     returns just value.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @yieldparam ret [Result] the result of operation in asynchronous mode
  *     (valid attributes: +error+, +operation+, +key+, +value+, +cas+).
@@ -256,6 +310,14 @@ cb_bucket_incr(int argc, VALUE *argv, VALUE self)
  *   @option options [true, false] :extended (false) If set to +true+, the
  *     operation will return tuple +[value, cas]+, otherwise (by default) it
  *     returns just value.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @yieldparam ret [Result] the result of operation in asynchronous mode
  *     (valid attributes: +error+, +operation+, +key+, +value+, +cas+).
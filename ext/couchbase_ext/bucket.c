@@ -23,11 +23,12 @@ trigger_on_connect_callback(VALUE self)
     struct cb_bucket_st *bucket = DATA_PTR(self);
     VALUE on_connect_proc = bucket->on_connect_proc;
     if (RTEST(on_connect_proc)) {
-        VALUE res = rb_class_new_instance(0, NULL, cb_cResult);
-        rb_ivar_set(res, cb_id_iv_error, bucket->exception);
+        struct cb_result_st *result;
+        VALUE res = cb_result_new(&result);
+        result->error = bucket->exception;
         bucket->exception = Qnil;
-        rb_ivar_set(res, cb_id_iv_operation, cb_sym_connect);
-        rb_ivar_set(res, cb_id_iv_value, self);
+        result->operation = cb_sym_connect;
+        result->value = self;
         return rb_funcall(on_connect_proc, cb_id_call, 1, res);
     } else {
         bucket->trigger_connect_cb_on_set = 1;
@@ -52,6 +53,9 @@ configuration_callback(lcb_t handle, lcb_configuration_t config)
 {
     struct cb_bucket_st *bucket = (struct cb_bucket_st *)lcb_get_cookie(handle);
 
+    if (config != LCB_CONFIGURATION_UNCHANGED) {
+        cb_latency_config_changed(bucket);
+    }
     if (config == LCB_CONFIGURATION_NEW) {
         bucket->connected = 1;
         (void)trigger_on_connect_callback(bucket->self);
@@ -72,6 +76,9 @@ cb_bucket_free(void *ptr)
         if (bucket->object_space) {
             st_free_table(bucket->object_space);
         }
+        cb_context_free_all(bucket);
+        cb_latency_free(bucket);
+        free(bucket->arena);
         xfree(bucket);
     }
 }
@@ -104,6 +111,7 @@ cb_bucket_mark(void *ptr)
         if (bucket->object_space) {
             st_foreach(bucket->object_space, cb_bucket_mark_object_i, (st_data_t)bucket);
         }
+        cb_context_mark_all(bucket);
     }
 }
 
@@ -207,6 +215,10 @@ do_scan_connection_options(struct cb_bucket_st *bucket, int argc, VALUE *argv)
             if (arg != Qundef) {
                 bucket->quiet = RTEST(arg);
             }
+            arg = rb_hash_lookup2(opts, cb_sym_collect_latency, Qundef);
+            if (arg != Qundef) {
+                bucket->collect_latency = RTEST(arg);
+            }
             arg = rb_hash_aref(opts, cb_sym_timeout);
             if (arg != Qnil) {
                 bucket->timeout = (uint32_t)NUM2ULONG(arg);
@@ -282,6 +294,10 @@ do_scan_connection_options(struct cb_bucket_st *bucket, int argc, VALUE *argv)
                     bucket->engine = cb_sym_libev;
                 } else if (arg == cb_sym_libevent) {
                     bucket->engine = cb_sym_libevent;
+#ifdef HAVE_LIBURING
+                } else if (arg == cb_sym_io_uring) {
+                    bucket->engine = cb_sym_io_uring;
+#endif
 #ifdef BUILD_EVENTMACHINE_PLUGIN
                 } else if (arg == cb_sym_eventmachine) {
                     bucket->engine = cb_sym_eventmachine;
@@ -369,7 +385,7 @@ do_connect(struct cb_bucket_st *bucket)
             ciops.version = 1;
             ciops.v.v1.sofile = NULL;
             ciops.v.v1.symbol = "cb_create_ruby_mt_io_opts";
-            ciops.v.v1.cookie = NULL;
+            ciops.v.v1.cookie = bucket;
 #endif
         }
         err = lcb_create_io_ops(&bucket->io, &ciops);
@@ -500,6 +516,8 @@ cb_bucket_alloc(VALUE klass)
  *     is +true+ it will raise {Couchbase::Error::NotFound} exceptions. The
  *     default behaviour is to return +nil+ value silently (might be useful in
  *     Rails cache).
+ *   @option options [true, false] :collect_latency (true) record the
+ *     latency of the responses for {Bucket#latency_stats} (since 1.3.8)
  *   @option options [Symbol] :environment (:production) the mode of the
  *     connection. Currently it influences only on design documents set. If
  *     the environment is +:development+, you will able to get design
@@ -523,6 +541,8 @@ cb_bucket_alloc(VALUE klass)
  *     :libevent     :: libevent IO plugin from libcouchbase (optional)
  *     :libev        :: libev IO plugin from libcouchbase (optional)
  *     :eventmachine :: EventMachine plugin (builtin, but requires EM gem and ruby 1.9+)
+ *     :io_uring     :: Built-in engine, which waits for IO using io_uring
+ *                      (linux only, requires liburing at build time)
  *   @option options [true, false] :async (false) If true, the
  *     connection instance will be considered always asynchronous and
  *     IO interaction will be occured only when {Couchbase::Bucket#run}
@@ -579,6 +599,7 @@ cb_bucket_init(int argc, VALUE *argv, VALUE self)
     bucket->engine = cb_sym_default;
     bucket->async = 0;
     bucket->quiet = 0;
+    bucket->collect_latency = 1;
     bucket->default_ttl = 0;
     bucket->default_flags = 0;
     cb_bucket_transcoder_set(self, cb_mDocument);
@@ -639,6 +660,7 @@ cb_bucket_init_copy(VALUE copy, VALUE orig)
     copy_b->engine = orig_b->engine;
     copy_b->async = orig_b->async;
     copy_b->quiet = orig_b->quiet;
+    copy_b->collect_latency = orig_b->collect_latency;
     copy_b->transcoder = orig_b->transcoder;
     copy_b->default_flags = orig_b->default_flags;
     copy_b->default_ttl = orig_b->default_ttl;
@@ -764,6 +786,22 @@ cb_bucket_quiet_set(VALUE self, VALUE val)
     return new;
 }
 
+    VALUE
+cb_bucket_collect_latency_get(VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    return bucket->collect_latency ? Qtrue : Qfalse;
+}
+
+    VALUE
+cb_bucket_collect_latency_set(VALUE self, VALUE val)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+
+    bucket->collect_latency = RTEST(val);
+    return bucket->collect_latency ? Qtrue : Qfalse;
+}
+
     VALUE
 cb_bucket_default_flags_get(VALUE self)
 {
@@ -1123,6 +1161,57 @@ cb_bucket_num_replicas_get(VALUE self)
         return INT2FIX(nr);
     }
 }
+/* Document-method: in_flight_ops
+ *
+ * @since 1.3.8
+ *
+ * The number of operations scheduled in asynchronous mode, which
+ * haven't been completed yet
+ *
+ * @return [Fixnum]
+ */
+    VALUE
+cb_bucket_in_flight_ops_get(VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    return ULONG2NUM(bucket->in_flight_ops);
+}
+/* Document-method: in_flight_bytes
+ *
+ * @since 1.3.8
+ *
+ * The number of bytes of the operations scheduled in asynchronous
+ * mode, which haven't been completed yet
+ *
+ * @return [Fixnum]
+ */
+    VALUE
+cb_bucket_in_flight_bytes_get(VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    return ULONG2NUM(bucket->in_flight_bytes);
+}
+/* Document-method: live_contexts
+ *
+ * @since 1.3.8
+ *
+ * The number of operation contexts, which haven't been released yet
+ * (pending operations and HTTP requests of both modes)
+ *
+ * @return [Fixnum]
+ */
+    VALUE
+cb_bucket_live_contexts_get(VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    struct cb_context_st *ctx;
+    unsigned long nn = 0;
+
+    for (ctx = bucket->contexts; ctx != NULL; ctx = ctx->next) {
+        nn++;
+    }
+    return ULONG2NUM(nn);
+}
 /* Document-method: default_observe_timeout
  *
  * @since 1.2.0.dp6
@@ -1237,18 +1326,88 @@ cb_bucket_inspect(VALUE self)
     return str;
 }
 
+/* bounds of the threshold in adaptive mode */
+#define CB_ADAPTIVE_MIN_THRESHOLD 1024
+#define CB_ADAPTIVE_MAX_THRESHOLD (1024 * 1024)
+#define CB_ADAPTIVE_DEFAULT_THRESHOLD 8192
+
+/*
+ * Pick the number of bytes, which will be scheduled during one flush
+ * round trip with observed rate. So that the commands don't wait in the
+ * buffer longer than the network would take anyway, but still are sent
+ * in batches large enough to amortize the round trip.
+ */
+    static size_t
+adaptive_threshold(struct cb_bucket_st *bucket)
+{
+    double threshold = bucket->flush_rate * bucket->flush_rtt;
+
+    if (threshold < CB_ADAPTIVE_MIN_THRESHOLD) {
+        return CB_ADAPTIVE_MIN_THRESHOLD;
+    } else if (threshold > CB_ADAPTIVE_MAX_THRESHOLD) {
+        return CB_ADAPTIVE_MAX_THRESHOLD;
+    }
+    return (size_t)threshold;
+}
+
+    static void
+adapt_threshold(struct cb_bucket_st *bucket, hrtime_t start, hrtime_t end)
+{
+    if (bucket->nbytes == 0 || bucket->first_op == 0 || start <= bucket->first_op) {
+        return;
+    }
+#define CB_EWMA(avg, val) ((avg) == 0 ? (val) : (avg) * 0.75 + (val) * 0.25)
+    bucket->flush_rtt = CB_EWMA(bucket->flush_rtt, (double)(end - start));
+    bucket->flush_rate = CB_EWMA(bucket->flush_rate,
+            (double)bucket->nbytes / (double)(start - bucket->first_op));
+#undef CB_EWMA
+    bucket->threshold = adaptive_threshold(bucket);
+}
+
     static void
 do_loop(struct cb_bucket_st *bucket)
 {
-    lcb_wait(bucket->handle);
+    if (bucket->adaptive) {
+        hrtime_t start = gethrtime();
+        lcb_wait(bucket->handle);
+        adapt_threshold(bucket, start, gethrtime());
+    } else {
+        lcb_wait(bucket->handle);
+    }
     bucket->nbytes = 0;
+    bucket->nops = 0;
+    bucket->first_op = 0;
+}
+
+    int
+cb_bucket_over_limits(struct cb_bucket_st *bucket)
+{
+    return (bucket->max_in_flight_ops != 0 && bucket->in_flight_ops >= bucket->max_in_flight_ops) ||
+        (bucket->max_in_flight_bytes != 0 && bucket->in_flight_bytes >= bucket->max_in_flight_bytes);
 }
 
     void
 cb_maybe_do_loop(struct cb_bucket_st *bucket)
 {
-    if (bucket->threshold != 0 && bucket->nbytes > bucket->threshold) {
+    hrtime_t now = 0;
+
+    bucket->nops++;
+    if (bucket->max_linger || bucket->adaptive) {
+        now = gethrtime();
+        if (bucket->first_op == 0) {
+            bucket->first_op = now;
+        }
+    }
+    if ((bucket->threshold != 0 && bucket->nbytes > bucket->threshold) ||
+            (bucket->max_ops != 0 && bucket->nops >= bucket->max_ops) ||
+            (bucket->max_linger != 0 && now - bucket->first_op >= bucket->max_linger)) {
         do_loop(bucket);
+    } else if (cb_bucket_over_limits(bucket)) {
+        /* block the submitter until enough responses arrive, the
+         * context release will break out the loop (see cb_context_free) */
+        bucket->throttled = 1;
+        do_loop(bucket);
+        bucket->throttled = 0;
     }
 }
 
@@ -1267,6 +1426,11 @@ do_run(VALUE *args)
         rb_raise(cb_eInvalidError, "nested #run");
     }
     bucket->threshold = 0;
+    bucket->max_ops = 0;
+    bucket->max_linger = 0;
+    bucket->adaptive = 0;
+    bucket->max_in_flight_ops = 0;
+    bucket->max_in_flight_bytes = 0;
     if (opts != Qnil) {
         VALUE arg;
         Check_Type(opts, T_HASH);
@@ -1274,7 +1438,34 @@ do_run(VALUE *args)
         if (arg != Qnil) {
             bucket->threshold = (uint32_t)NUM2ULONG(arg);
         }
+        arg = rb_hash_aref(opts, cb_sym_max_ops);
+        if (arg != Qnil) {
+            bucket->max_ops = NUM2ULONG(arg);
+        }
+        arg = rb_hash_aref(opts, cb_sym_max_linger);
+        if (arg != Qnil) {
+            bucket->max_linger = (hrtime_t)NUM2ULONG(arg) * 1000;
+        }
+        arg = rb_hash_aref(opts, cb_sym_max_in_flight_ops);
+        if (arg != Qnil) {
+            bucket->max_in_flight_ops = NUM2ULONG(arg);
+        }
+        arg = rb_hash_aref(opts, cb_sym_max_in_flight_bytes);
+        if (arg != Qnil) {
+            bucket->max_in_flight_bytes = NUM2ULONG(arg);
+        }
+        bucket->adaptive = RTEST(rb_hash_aref(opts, cb_sym_adaptive));
+    }
+    if (bucket->adaptive) {
+        if (bucket->flush_rtt > 0 && bucket->flush_rate > 0) {
+            /* continue with the threshold learned in previous runs */
+            bucket->threshold = adaptive_threshold(bucket);
+        } else if (bucket->threshold == 0) {
+            bucket->threshold = CB_ADAPTIVE_DEFAULT_THRESHOLD;
+        }
     }
+    bucket->nops = 0;
+    bucket->first_op = 0;
     bucket->async = 1;
     bucket->running = 1;
     if (proc != Qnil) {
@@ -1310,6 +1501,7 @@ ensure_run(VALUE *args)
     struct cb_bucket_st *bucket = DATA_PTR(self);
 
     bucket->running = 0;
+    bucket->throttled = 0;
     bucket->async = args[3];
     bucket->running = args[4];
     return Qnil;
@@ -1325,6 +1517,26 @@ ensure_run(VALUE *args)
  *   buffer will exceeds this value, then the library will start network
  *   interaction and block the current thread until all scheduled commands
  *   will be completed.
+ * @option options [Fixnum] :max_ops (0) start network interaction when
+ *   this number of operations has been scheduled since the last one
+ *   (since 1.3.8)
+ * @option options [Fixnum] :max_linger (0) start network interaction
+ *   when the oldest scheduled operation waits longer than this number of
+ *   microseconds. It is checked when next operation is scheduled (since
+ *   1.3.8)
+ * @option options [true, false] :adaptive (false) tune +:send_threshold+
+ *   automatically, so that the buffer collects about as many bytes as
+ *   scheduled during the round trip of previous flushes. The given
+ *   +:send_threshold+ (or 8Kb) is used as initial value, and the
+ *   learned value is kept for the next runs (since 1.3.8)
+ * @option options [Fixnum] :max_in_flight_ops (0) when this number of
+ *   scheduled operations is waiting for the responses, the next
+ *   operation blocks the current thread and runs the event loop until
+ *   some of them are completed. See also {Bucket#in_flight_ops}
+ *   (since 1.3.8)
+ * @option options [Fixnum] :max_in_flight_bytes (0) the same as
+ *   +:max_in_flight_ops+, but limits the number of bytes of the pending
+ *   operations. See also {Bucket#in_flight_bytes} (since 1.3.8)
  *
  * @yieldparam [Bucket] bucket the bucket instance
  *
@@ -17,10 +17,41 @@
 
 #include "couchbase_ext.h"
 
+/* Open addressing table which maps the key of the response back to the
+ * position of the key in the request. The slots keep positions only, the
+ * bytes are compared against the key Strings in the context. */
+struct cb_key_index_st
+{
+    size_t mask;
+    long slots[1];
+};
+
+    static size_t
+cb_key_index_hash(const char *key, size_t nkey)
+{
+    size_t hh = 2166136261U;
+    size_t ii;
+
+    for (ii = 0; ii < nkey; ++ii) {
+        hh = (hh ^ (unsigned char)key[ii]) * 16777619U;
+    }
+    return hh;
+}
+
+/* Contexts are carved out of slabs owned by the bucket. Released contexts
+ * go to the free list of the bucket, the live ones are linked into the
+ * in-flight list, which is the only thing walked during GC mark. */
+#define CB_CONTEXT_SLAB_SIZE 64
+
+struct cb_context_slab_st
+{
+    struct cb_context_slab_st *next;
+    struct cb_context_st items[CB_CONTEXT_SLAB_SIZE];
+};
+
     static void
-cb_context_mark(void *p, struct cb_bucket_st* bucket)
+cb_context_mark(struct cb_context_st *ctx)
 {
-    struct cb_context_st *ctx = p;
     rb_gc_mark(ctx->proc);
     rb_gc_mark(ctx->rv);
     rb_gc_mark(ctx->exception);
@@ -29,19 +60,86 @@ cb_context_mark(void *p, struct cb_bucket_st* bucket)
     rb_gc_mark(ctx->transcoder_opts);
     rb_gc_mark(ctx->operation);
     rb_gc_mark(ctx->headers_val);
-    (void)bucket;
+    rb_gc_mark(ctx->batch);
+    rb_gc_mark(ctx->keys);
+}
+
+    void
+cb_context_mark_all(struct cb_bucket_st *bucket)
+{
+    struct cb_context_st *ctx;
+
+    for (ctx = bucket->contexts; ctx != NULL; ctx = ctx->next) {
+        cb_context_mark(ctx);
+    }
+}
+
+    void
+cb_context_free_all(struct cb_bucket_st *bucket)
+{
+    struct cb_context_slab_st *slab, *next;
+
+    for (slab = bucket->context_slabs; slab != NULL; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    bucket->context_slabs = NULL;
+    bucket->free_contexts = NULL;
+    bucket->contexts = NULL;
+    bucket->in_flight_ops = 0;
+    bucket->in_flight_bytes = 0;
 }
 
     struct cb_context_st *
 cb_context_alloc(struct cb_bucket_st* bucket)
 {
-    struct cb_context_st *ctx = calloc(1, sizeof(*ctx));
-    if (ctx == NULL) {
-        rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for context");
+    struct cb_context_st *ctx;
+
+    if (bucket->free_contexts == NULL) {
+        struct cb_context_slab_st *slab = malloc(sizeof(struct cb_context_slab_st));
+        size_t ii;
+
+        if (slab == NULL) {
+            rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for context");
+        }
+        slab->next = bucket->context_slabs;
+        bucket->context_slabs = slab;
+        for (ii = 0; ii < CB_CONTEXT_SLAB_SIZE; ++ii) {
+            slab->items[ii].next = bucket->free_contexts;
+            bucket->free_contexts = slab->items + ii;
+        }
     }
-    cb_gc_protect_ptr(bucket, ctx, cb_context_mark);
+    ctx = bucket->free_contexts;
+    bucket->free_contexts = ctx->next;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->start = gethrtime();
+
+    ctx->next = bucket->contexts;
+    if (ctx->next) {
+        ctx->next->prev = ctx;
+    }
+    bucket->contexts = ctx;
     ctx->bucket = bucket;
     ctx->exception = Qnil;
+    ctx->batch = Qnil;
+    ctx->keys = Qnil;
+    ctx->arity = CB_ARITY_UNKNOWN;
+    return ctx;
+}
+
+/*
+ * Allocate the context for synchronous single key operation. Callbacks
+ * store the result right into ctx->rv (see cb_context_set_result).
+ */
+    struct cb_context_st *
+cb_context_alloc_single(struct cb_bucket_st *bucket, VALUE key)
+{
+    struct cb_context_st *ctx = cb_context_alloc(bucket);
+    ctx->proc = Qnil;
+    ctx->rv = Qnil;
+    ctx->keys = key;
+    ctx->single = 1;
+    ctx->nqueries = 1;
     return ctx;
 }
 
@@ -60,6 +158,291 @@ cb_context_alloc_common(struct cb_bucket_st *bucket, VALUE proc, size_t nqueries
     void
 cb_context_free(struct cb_context_st *ctx)
 {
-    cb_gc_unprotect_ptr(ctx->bucket, ctx);
-    free(ctx);
+    struct cb_bucket_st *bucket = ctx->bucket;
+
+    if (ctx->deadline) {
+        lcb_timer_destroy(bucket->handle, ctx->deadline);
+        ctx->deadline = NULL;
+    }
+    if (ctx->timed_out && ctx->nqueries > 0 && !ctx->detached) {
+        /* the responses will come later, the callback of the last one
+         * will release the context */
+        ctx->detached = 1;
+        return;
+    }
+    if (ctx->in_flight_ops || ctx->in_flight_bytes) {
+        bucket->in_flight_ops -= ctx->in_flight_ops;
+        bucket->in_flight_bytes -= ctx->in_flight_bytes;
+        ctx->in_flight_ops = 0;
+        ctx->in_flight_bytes = 0;
+        if (bucket->throttled && !cb_bucket_over_limits(bucket)) {
+            lcb_breakout(bucket->handle);
+        }
+    }
+    free(ctx->index);
+    if (ctx->prev) {
+        ctx->prev->next = ctx->next;
+    } else {
+        bucket->contexts = ctx->next;
+    }
+    if (ctx->next) {
+        ctx->next->prev = ctx->prev;
+    }
+    ctx->prev = NULL;
+    ctx->next = bucket->free_contexts;
+    bucket->free_contexts = ctx;
+}
+
+/*
+ * Account the operations of the context, which have been just scheduled.
+ * In async mode they are counted as in-flight until the context is
+ * released by the callback of the last response.
+ */
+    void
+cb_context_scheduled(struct cb_context_st *ctx, size_t nbytes)
+{
+    struct cb_bucket_st *bucket = ctx->bucket;
+
+    bucket->nbytes += nbytes;
+    if (bucket->async) {
+        ctx->in_flight_ops = ctx->nqueries;
+        ctx->in_flight_bytes = nbytes;
+        bucket->in_flight_ops += ctx->in_flight_ops;
+        bucket->in_flight_bytes += ctx->in_flight_bytes;
+    }
+}
+
+/*
+ * Remember the keys of the request (as returned by cb_params_build, without
+ * prefix) to hand them back in the responses. Several keys need an index
+ * to find the position by the key bytes.
+ */
+    void
+cb_context_index_init(struct cb_context_st *ctx, VALUE keys)
+{
+    struct cb_key_index_st *idx;
+    long nkeys, ii;
+    size_t size = 1, jj;
+    VALUE key;
+
+    ctx->keys = keys;
+    nkeys = RTEST(keys) ? RARRAY_LEN(keys) : 0;
+    if (nkeys < 2) {
+        return;
+    }
+    while (size < (size_t)nkeys * 2) {
+        size <<= 1;
+    }
+    idx = malloc(sizeof(struct cb_key_index_st) + (size - 1) * sizeof(long));
+    if (idx == NULL) {
+        rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for key index");
+    }
+    idx->mask = size - 1;
+    for (jj = 0; jj < size; ++jj) {
+        idx->slots[jj] = -1;
+    }
+    for (ii = 0; ii < nkeys; ++ii) {
+        key = RARRAY_PTR(keys)[ii];
+        jj = cb_key_index_hash(RSTRING_PTR(key), RSTRING_LEN(key)) & idx->mask;
+        while (idx->slots[jj] >= 0) {
+            jj = (jj + 1) & idx->mask;
+        }
+        idx->slots[jj] = ii;
+    }
+    ctx->index = idx;
+}
+
+/*
+ * Find the next position of the response key starting from the slot
+ * *cursor (initialize it with CB_KEY_INDEX_START). Returns -1 when there
+ * are no more positions.
+ */
+    static long
+cb_context_index_next(struct cb_context_st *ctx, const char *key, size_t nkey, size_t *cursor)
+{
+    struct cb_key_index_st *idx = ctx->index;
+    size_t ii;
+    long pos;
+    VALUE kk;
+
+    if (RTEST(ctx->bucket->key_prefix_val)) {
+        size_t nprefix = RSTRING_LEN(ctx->bucket->key_prefix_val);
+        if (nkey < nprefix) {
+            return -1;
+        }
+        key += nprefix;
+        nkey -= nprefix;
+    }
+    if (idx == NULL) {
+        /* single key */
+        if (*cursor != CB_KEY_INDEX_START || !RTEST(ctx->keys) || RARRAY_LEN(ctx->keys) == 0) {
+            return -1;
+        }
+        *cursor = 0;
+        return 0;
+    }
+    ii = (*cursor == CB_KEY_INDEX_START) ? cb_key_index_hash(key, nkey) : *cursor + 1;
+    for (ii &= idx->mask; (pos = idx->slots[ii]) >= 0; ii = (ii + 1) & idx->mask) {
+        kk = RARRAY_PTR(ctx->keys)[pos];
+        if ((size_t)RSTRING_LEN(kk) == nkey && memcmp(RSTRING_PTR(kk), key, nkey) == 0) {
+            *cursor = ii;
+            return pos;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Return the key String of the request for the key of the response.
+ * Falls back to new String when the context doesn't know the keys.
+ */
+    VALUE
+cb_context_key(struct cb_context_st *ctx, const void *key, size_t nkey)
+{
+    size_t cursor = CB_KEY_INDEX_START;
+    long pos;
+    VALUE ret;
+
+    if (TYPE(ctx->keys) == T_STRING) {
+        return ctx->keys;
+    }
+    pos = cb_context_index_next(ctx, key, nkey, &cursor);
+    if (pos >= 0) {
+        return RARRAY_PTR(ctx->keys)[pos];
+    }
+    ret = STR_NEW((const char *)key, nkey);
+    cb_strip_key_prefix(ctx->bucket, ret);
+    return ret;
+}
+
+/*
+ * Store the value into ctx->rv at every position of the response key.
+ */
+    void
+cb_context_index_store(struct cb_context_st *ctx, const void *key, size_t nkey, VALUE val)
+{
+    size_t cursor = CB_KEY_INDEX_START;
+    long pos;
+
+    while ((pos = cb_context_index_next(ctx, key, nkey, &cursor)) >= 0) {
+        rb_ary_store(ctx->rv, pos, val);
+    }
+}
+
+/*
+ * Store the result of synchronous operation for the key.
+ */
+    void
+cb_context_set_result(struct cb_context_st *ctx, VALUE key, VALUE val)
+{
+    if (ctx->single) {
+        ctx->rv = val;
+    } else {
+        rb_hash_aset(ctx->rv, key, val);
+    }
+}
+
+/*
+ * Wait for the scheduled synchronous operation, release the context and
+ * return its result or raise its error.
+ */
+    VALUE
+cb_context_wait(struct cb_context_st *ctx)
+{
+    struct cb_bucket_st *bucket = ctx->bucket;
+    VALUE rv, exc;
+
+    cb_context_wait_responses(ctx);
+    exc = ctx->exception;
+    rv = ctx->rv;
+    cb_context_free(ctx);
+    if (exc != Qnil) {
+        rb_exc_raise(exc);
+    }
+    exc = bucket->exception;
+    if (exc != Qnil) {
+        bucket->exception = Qnil;
+        rb_exc_raise(exc);
+    }
+    return rv;
+}
+
+    static void
+cb_context_deadline_callback(lcb_timer_t timer, lcb_t handle, const void *cookie)
+{
+    struct cb_context_st *ctx = (struct cb_context_st *)cookie;
+
+    /* one-shot timers are destroyed by the library */
+    ctx->deadline = NULL;
+    if (ctx->request ? ctx->request->completed : ctx->nqueries == 0) {
+        /* the operation is done already */
+        return;
+    }
+    ctx->timed_out = 1;
+    ctx->exception = cb_check_error(LCB_ETIMEDOUT, "operation timed out", Qnil);
+    if (ctx->request && ctx->request->running) {
+        lcb_cancel_http_request(handle, ctx->request->request);
+        ctx->request->running = 0;
+        ctx->request->completed = 1;
+    }
+    lcb_breakout(handle);
+    (void)timer;
+}
+
+/*
+ * Complete synchronous operation with Couchbase::Error::Timeout if it
+ * isn't done in usec microseconds, regardless of the timeout of the
+ * connection. The responses which arrive later are dropped. Asynchronous
+ * operations reject the :timeout option while parsing arguments.
+ */
+    void
+cb_context_set_deadline(struct cb_context_st *ctx, uint32_t usec)
+{
+    struct cb_bucket_st *bucket = ctx->bucket;
+    lcb_error_t err;
+
+    if (usec == 0) {
+        return;
+    }
+    ctx->deadline = lcb_timer_create(bucket->handle, ctx, usec, 0,
+            cb_context_deadline_callback, &err);
+    if (err != LCB_SUCCESS) {
+        ctx->deadline = NULL;
+        rb_exc_raise(cb_check_error(err, "failed to create deadline timer", Qnil));
+    }
+}
+
+/*
+ * Called when the last response of the operation has arrived. Destroy
+ * the deadline timer, which otherwise keeps lcb_wait running until it
+ * fires, and return from lcb_wait of synchronous operation right away,
+ * even if some other request (like streaming view) is still pending.
+ */
+    void
+cb_context_complete(struct cb_context_st *ctx)
+{
+    struct cb_bucket_st *bucket = ctx->bucket;
+
+    if (ctx->deadline) {
+        lcb_timer_destroy(bucket->handle, ctx->deadline);
+        ctx->deadline = NULL;
+    }
+    if (!bucket->async && !ctx->detached) {
+        lcb_breakout(bucket->handle);
+    }
+}
+
+/*
+ * Run the event loop until the synchronous operation gets all its
+ * responses. lcb_wait returns earlier when somebody breaks out of it,
+ * e.g. the operation completed in the row block of streaming view.
+ */
+    void
+cb_context_wait_responses(struct cb_context_st *ctx)
+{
+    struct cb_bucket_st *bucket = ctx->bucket;
+
+    while (ctx->nqueries > 0 && !ctx->timed_out && NIL_P(bucket->exception)) {
+        lcb_wait(bucket->handle);
+    }
 }
@@ -23,6 +23,8 @@ VALUE cb_cBucket;
 VALUE cb_cCouchRequest;
 VALUE cb_cResult;
 VALUE cb_cTimer;
+VALUE cb_cPrepared;
+VALUE cb_cViewParser;
 
 /* Modules */
 VALUE cb_mCouchbase;
@@ -31,24 +33,37 @@ VALUE cb_mTranscoder;
 VALUE cb_mDocument;
 VALUE cb_mPlain;
 VALUE cb_mMarshal;
+VALUE cb_mNativeJSON;
 VALUE cb_mURI;
+VALUE cb_mMultiJson;
 VALUE em_m;
 
+/* Semaphores of the static tracepoints */
+#ifdef STAP_PROBE
+CB_PROBES(CB_PROBE_SEMAPHORE)
+#endif
+
 /* Symbols */
+ID cb_sym_adaptive;
 ID cb_sym_add;
 ID cb_sym_all;
 ID cb_sym_append;
+ID cb_sym_arith;
 ID cb_sym_assemble_hash;
 ID cb_sym_async;
 ID cb_sym_body;
 ID cb_sym_bootstrap_transports;
+ID cb_sym_batch_callback;
 ID cb_sym_bucket;
 ID cb_sym_cas;
 ID cb_sym_cccp;
 ID cb_sym_chunked;
 ID cb_sym_cluster;
+ID cb_sym_collect_latency;
+ID cb_sym_compact;
 ID cb_sym_connect;
 ID cb_sym_content_type;
+ID cb_sym_count;
 ID cb_sym_create;
 ID cb_sym_decrement;
 ID cb_sym_default;
@@ -76,6 +91,7 @@ ID cb_sym_http;
 ID cb_sym_http_request;
 ID cb_sym_increment;
 ID cb_sym_initial;
+ID cb_sym_io_uring;
 ID cb_sym_iocp;
 ID cb_sym_key_prefix;
 ID cb_sym_libev;
@@ -83,12 +99,21 @@ ID cb_sym_libevent;
 ID cb_sym_lock;
 ID cb_sym_management;
 ID cb_sym_marshal;
+ID cb_sym_max;
+ID cb_sym_max_in_flight_bytes;
+ID cb_sym_max_in_flight_ops;
+ID cb_sym_max_linger;
+ID cb_sym_max_ops;
+ID cb_sym_mean;
+ID cb_sym_merge;
 ID cb_sym_method;
+ID cb_sym_min;
 ID cb_sym_node_list;
 ID cb_sym_not_found;
 ID cb_sym_num_replicas;
 ID cb_sym_observe;
 ID cb_sym_password;
+ID cb_sym_percentiles;
 ID cb_sym_periodic;
 ID cb_sym_persisted;
 ID cb_sym_plain;
@@ -101,9 +126,11 @@ ID cb_sym_put;
 ID cb_sym_quiet;
 ID cb_sym_replace;
 ID cb_sym_replica;
+ID cb_sym_reset;
 ID cb_sym_select;
 ID cb_sym_send_threshold;
 ID cb_sym_set;
+ID cb_sym_size;
 ID cb_sym_stats;
 ID cb_sym_timeout;
 ID cb_sym_touch;
@@ -150,6 +177,7 @@ ID cb_id_path;
 ID cb_id_port;
 ID cb_id_scheme;
 ID cb_id_sprintf;
+ID cb_id_to_json;
 ID cb_id_to_s;
 ID cb_id_user;
 ID cb_id_verify_observe_options;
@@ -231,6 +259,7 @@ Init_couchbase_ext(void)
     em_m = 0;
 
     cb_mURI = rb_const_get(rb_cObject, rb_intern("URI"));
+    cb_mMultiJson = rb_const_get(rb_cObject, rb_intern("MultiJson"));
     cb_mCouchbase = rb_define_module("Couchbase");
     /* Document-method: libcouchbase_version
      *
@@ -246,6 +275,60 @@ Init_couchbase_ext(void)
     cb_mMarshal = rb_const_get(cb_mTranscoder, rb_intern("Marshal"));
     cb_mPlain = rb_const_get(cb_mTranscoder, rb_intern("Plain"));
 
+    /* Document-module: Couchbase::Transcoder::NativeJSON
+     * JSON codec compiled into the extension
+     *
+     * It is used by {Couchbase::Transcoder::Document} unless
+     * {Couchbase::Transcoder::Document.native=} set to +false+.
+     *
+     * @since 1.3.8
+     */
+    cb_mNativeJSON = rb_define_module_under(cb_mTranscoder, "NativeJSON");
+    /* Document-method: dump
+     * Encode object to JSON
+     *
+     * @since 1.3.8
+     *
+     * @param [Object] obj
+     * @return [String]
+     * @raise [ArgumentError, TypeError] if the object cannot be encoded
+     */
+    rb_define_singleton_method(cb_mNativeJSON, "dump", cb_json_s_dump, 1);
+    /* Document-method: load
+     * Decode JSON string
+     *
+     * Like +MultiJson.load+ it returns +nil+ for blank strings and
+     * accepts primitive values on the top level.
+     *
+     * @since 1.3.8
+     *
+     * @param [String] blob
+     * @return [Object]
+     * @raise [ArgumentError] if the string is not valid JSON
+     */
+    rb_define_singleton_method(cb_mNativeJSON, "load", cb_json_s_load, 1);
+    /* Document-method: native?
+     * Check whether {Couchbase::Transcoder::NativeJSON} is used
+     *
+     * @since 1.3.8
+     *
+     * @return [true, false]
+     */
+    rb_define_singleton_method(cb_mDocument, "native?", cb_document_native_get, 0);
+    /* Document-method: native=
+     * Switch between embedded JSON codec and MultiJson
+     *
+     * @since 1.3.8
+     *
+     * @example Use MultiJson with custom adapter
+     *   MultiJson.use(:oj)
+     *   Couchbase::Transcoder::Document.native = false
+     *
+     * @param [true, false] val
+     * @return [true, false]
+     */
+    rb_define_singleton_method(cb_mDocument, "native=", cb_document_native_set, 1);
+
     cb_mError = rb_define_module_under(cb_mCouchbase, "Error");
     /* Document-class: Couchbase::Error::Base
      * The base error class
@@ -667,30 +750,34 @@ Init_couchbase_ext(void)
      * @since 1.0.0
      */
     cb_cResult = rb_define_class_under(cb_mCouchbase, "Result", rb_cObject);
+    rb_define_alloc_func(cb_cResult, cb_result_alloc);
     rb_define_method(cb_cResult, "inspect", cb_result_inspect, 0);
     rb_define_method(cb_cResult, "to_s", cb_result_inspect, 0);
     rb_define_method(cb_cResult, "success?", cb_result_success_p, 0);
+    rb_define_method(cb_cResult, "initialize_copy", cb_result_init_copy, 1);
+    rb_define_method(cb_cResult, "marshal_dump", cb_result_marshal_dump, 0);
+    rb_define_method(cb_cResult, "marshal_load", cb_result_marshal_load, 1);
     /* Document-method: operation
      *
      * @since 1.0.0
      *
      * @return [Symbol]
      */
-    rb_define_attr(cb_cResult, "operation", 1, 0);
+    rb_define_method(cb_cResult, "operation", cb_result_operation_get, 0);
     /* Document-method: error
      *
      * @since 1.0.0
      *
      * @return [Couchbase::Error::Base]
      */
-    rb_define_attr(cb_cResult, "error", 1, 0);
+    rb_define_method(cb_cResult, "error", cb_result_error_get, 0);
     /* Document-method: key
      *
      * @since 1.0.0
      *
      * @return [String]
      */
-    rb_define_attr(cb_cResult, "key", 1, 0);
+    rb_define_method(cb_cResult, "key", cb_result_key_get, 0);
     cb_id_iv_key = rb_intern("@key");
     /* Document-method: value
      *
@@ -698,7 +785,7 @@ Init_couchbase_ext(void)
      *
      * @return [String]
      */
-    rb_define_attr(cb_cResult, "value", 1, 0);
+    rb_define_method(cb_cResult, "value", cb_result_value_get, 0);
     rb_define_alias(cb_cResult, "bucket", "value");
     cb_id_iv_value = rb_intern("@value");
     /* Document-method: cas
@@ -707,7 +794,7 @@ Init_couchbase_ext(void)
      *
      * @return [Fixnum]
      */
-    rb_define_attr(cb_cResult, "cas", 1, 0);
+    rb_define_method(cb_cResult, "cas", cb_result_cas_get, 0);
     cb_id_iv_cas = rb_intern("@cas");
     /* Document-method: flags
      *
@@ -715,7 +802,7 @@ Init_couchbase_ext(void)
      *
      * @return [Fixnum]
      */
-    rb_define_attr(cb_cResult, "flags", 1, 0);
+    rb_define_method(cb_cResult, "flags", cb_result_flags_get, 0);
     cb_id_iv_flags = rb_intern("@flags");
     /* Document-method: node
      *
@@ -723,7 +810,7 @@ Init_couchbase_ext(void)
      *
      * @return [String]
      */
-    rb_define_attr(cb_cResult, "node", 1, 0);
+    rb_define_method(cb_cResult, "node", cb_result_node_get, 0);
     cb_id_iv_node = rb_intern("@node");
     /* Document-method: headers
      *
@@ -733,12 +820,12 @@ Init_couchbase_ext(void)
      *
      * @return [Hash]
      */
-    rb_define_attr(cb_cResult, "headers", 1, 0);
+    rb_define_method(cb_cResult, "headers", cb_result_headers_get, 0);
     cb_id_iv_headers = rb_intern("@headers");
     /* Document-method: completed
      * In {Bucket::CouchRequest} operations used to mark the final call
      * @return [Boolean] */
-    rb_define_attr(cb_cResult, "completed", 1, 0);
+    rb_define_method(cb_cResult, "completed", cb_result_completed_get, 0);
     rb_define_alias(cb_cResult, "completed?", "completed");
     cb_id_iv_completed = rb_intern("@completed");
     /* Document-method: status
@@ -754,7 +841,7 @@ Init_couchbase_ext(void)
      *
      * @return [Symbol]
      */
-    rb_define_attr(cb_cResult, "status", 1, 0);
+    rb_define_method(cb_cResult, "status", cb_result_status_get, 0);
     cb_id_iv_status = rb_intern("@status");
     /* Document-method: from_master
      *
@@ -765,7 +852,7 @@ Init_couchbase_ext(void)
      * True if key stored on master
      * @return [Boolean]
      */
-    rb_define_attr(cb_cResult, "from_master", 1, 0);
+    rb_define_method(cb_cResult, "from_master", cb_result_from_master_get, 0);
     rb_define_alias(cb_cResult, "from_master?", "from_master");
     cb_id_iv_from_master = rb_intern("@from_master");
     /* Document-method: time_to_persist
@@ -777,7 +864,7 @@ Init_couchbase_ext(void)
      * Average time needed to persist key on the disk (zero if unavailable)
      * @return [Fixnum]
      */
-    rb_define_attr(cb_cResult, "time_to_persist", 1, 0);
+    rb_define_method(cb_cResult, "time_to_persist", cb_result_time_to_persist_get, 0);
     rb_define_alias(cb_cResult, "ttp", "time_to_persist");
     cb_id_iv_time_to_persist = rb_intern("@time_to_persist");
     /* Document-method: time_to_persist
@@ -789,7 +876,7 @@ Init_couchbase_ext(void)
      * Average time needed to replicate key on the disk (zero if unavailable)
      * @return [Fixnum]
      */
-    rb_define_attr(cb_cResult, "time_to_replicate", 1, 0);
+    rb_define_method(cb_cResult, "time_to_replicate", cb_result_time_to_replicate_get, 0);
     rb_define_alias(cb_cResult, "ttr", "time_to_replicate");
     cb_id_iv_time_to_replicate = rb_intern("@time_to_replicate");
 
@@ -831,11 +918,14 @@ Init_couchbase_ext(void)
     rb_define_method(cb_cBucket, "replace", cb_bucket_replace, -1);
     rb_define_method(cb_cBucket, "set", cb_bucket_set, -1);
     rb_define_method(cb_cBucket, "get", cb_bucket_get, -1);
+    rb_define_method(cb_cBucket, "prepare", cb_bucket_prepare, -1);
     rb_define_method(cb_cBucket, "run", cb_bucket_run, -1);
     rb_define_method(cb_cBucket, "stop", cb_bucket_stop, 0);
     rb_define_method(cb_cBucket, "touch", cb_bucket_touch, -1);
     rb_define_method(cb_cBucket, "delete", cb_bucket_delete, -1);
     rb_define_method(cb_cBucket, "stats", cb_bucket_stats, -1);
+    rb_define_method(cb_cBucket, "latency_stats", cb_bucket_latency_stats, -1);
+    rb_define_method(cb_cBucket, "reset_latency_stats", cb_bucket_reset_latency_stats, 0);
     rb_define_method(cb_cBucket, "version", cb_bucket_version, -1);
     rb_define_method(cb_cBucket, "incr", cb_bucket_incr, -1);
     rb_define_method(cb_cBucket, "decr", cb_bucket_decr, -1);
@@ -877,6 +967,20 @@ Init_couchbase_ext(void)
     rb_define_method(cb_cBucket, "quiet=", cb_bucket_quiet_set, 1);
     rb_define_alias(cb_cBucket, "quiet?", "quiet");
 
+    /* Document-method: collect_latency
+     * Flag controlling if the latency of the responses is recorded
+     *
+     * @since 1.3.8
+     *
+     * Looking up the node of the key costs a little on every response,
+     * turn it off if {Bucket#latency_stats} isn't needed.
+     *
+     * @return [true, false] */
+    /* rb_define_attr(cb_cBucket, "collect_latency", 1, 1); */
+    rb_define_method(cb_cBucket, "collect_latency", cb_bucket_collect_latency_get, 0);
+    rb_define_method(cb_cBucket, "collect_latency=", cb_bucket_collect_latency_set, 1);
+    rb_define_alias(cb_cBucket, "collect_latency?", "collect_latency");
+
     /* Document-method: default_flags
      * Default flags for new values.
      *
@@ -1219,6 +1323,39 @@ Init_couchbase_ext(void)
      */
     /* rb_define_attr(cb_cBucket, "num_replicas", 1, 0); */
     rb_define_method(cb_cBucket, "num_replicas", cb_bucket_num_replicas_get, 0);
+    /* Document-method: in_flight_ops
+     *
+     * @since 1.3.8
+     *
+     * The number of operations scheduled in asynchronous mode, which
+     * haven't been completed yet
+     *
+     * @return [Fixnum]
+     */
+    /* rb_define_attr(cb_cBucket, "in_flight_ops", 1, 0); */
+    rb_define_method(cb_cBucket, "in_flight_ops", cb_bucket_in_flight_ops_get, 0);
+    /* Document-method: in_flight_bytes
+     *
+     * @since 1.3.8
+     *
+     * The number of bytes of the operations scheduled in asynchronous
+     * mode, which haven't been completed yet
+     *
+     * @return [Fixnum]
+     */
+    /* rb_define_attr(cb_cBucket, "in_flight_bytes", 1, 0); */
+    rb_define_method(cb_cBucket, "in_flight_bytes", cb_bucket_in_flight_bytes_get, 0);
+    /* Document-method: live_contexts
+     *
+     * @since 1.3.8
+     *
+     * The number of operation contexts, which haven't been released yet
+     * (pending operations and HTTP requests of both modes)
+     *
+     * @return [Fixnum]
+     */
+    /* rb_define_attr(cb_cBucket, "live_contexts", 1, 0); */
+    rb_define_method(cb_cBucket, "live_contexts", cb_bucket_live_contexts_get, 0);
     /* Document-method: default_observe_timeout
      *
      * @since 1.2.0.dp6
@@ -1241,6 +1378,7 @@ Init_couchbase_ext(void)
     rb_define_method(cb_cCouchRequest, "perform", cb_http_request_perform, 0);
     rb_define_method(cb_cCouchRequest, "pause", cb_http_request_pause, 0);
     rb_define_method(cb_cCouchRequest, "continue", cb_http_request_continue, 0);
+    rb_define_method(cb_cCouchRequest, "cancel", cb_http_request_cancel, 0);
 
     /* rb_define_attr(cb_cCouchRequest, "path", 1, 0); */
     rb_define_method(cb_cCouchRequest, "path", cb_http_request_path_get, 0);
@@ -1257,6 +1395,33 @@ Init_couchbase_ext(void)
     rb_define_method(cb_cTimer, "inspect", cb_timer_inspect, 0);
     rb_define_method(cb_cTimer, "cancel", cb_timer_cancel, 0);
 
+    /* Document-class: Couchbase::Bucket::Prepared
+     * The operation with resolved options, see {Bucket#prepare}
+     *
+     * @since 1.3.8
+     */
+    cb_cPrepared = rb_define_class_under(cb_cBucket, "Prepared", rb_cObject);
+    rb_define_alloc_func(cb_cPrepared, cb_prepared_alloc);
+    rb_define_method(cb_cPrepared, "initialize", cb_prepared_init, -1);
+    rb_define_method(cb_cPrepared, "inspect", cb_prepared_inspect, 0);
+    rb_define_method(cb_cPrepared, "call", cb_prepared_call, -1);
+    /* rb_define_attr(cb_cPrepared, "operation", 1, 0); */
+    rb_define_method(cb_cPrepared, "operation", cb_prepared_operation_get, 0);
+
+    /* Document-class: Couchbase::ViewParser
+     * Streaming parser of the view results, see {View#fetch}
+     *
+     * @since 1.3.8
+     */
+    cb_cViewParser = rb_define_class_under(cb_mCouchbase, "ViewParser", rb_cObject);
+    rb_define_alloc_func(cb_cViewParser, cb_view_parser_alloc);
+    rb_define_method(cb_cViewParser, "initialize", cb_view_parser_init, -1);
+    rb_define_method(cb_cViewParser, "on_object", cb_view_parser_on_object, 0);
+    rb_define_method(cb_cViewParser, "<<", cb_view_parser_feed, 1);
+    /* rb_define_attr(cb_cViewParser, "compact", 1, 0); */
+    rb_define_method(cb_cViewParser, "compact", cb_view_parser_compact_get, 0);
+    rb_define_alias(cb_cViewParser, "compact?", "compact");
+
     /* Define cb_symbols */
     cb_id_add_shutdown_hook = rb_intern("add_shutdown_hook");
     cb_id_arity = rb_intern("arity");
@@ -1279,24 +1444,31 @@ Init_couchbase_ext(void)
     cb_id_port = rb_intern("port");
     cb_id_scheme = rb_intern("scheme");
     cb_id_sprintf = rb_intern("sprintf");
+    cb_id_to_json = rb_intern("to_json");
     cb_id_to_s = rb_intern("to_s");
     cb_id_user = rb_intern("user");
     cb_id_verify_observe_options = rb_intern("verify_observe_options");
 
+    cb_sym_adaptive = ID2SYM(rb_intern("adaptive"));
     cb_sym_add = ID2SYM(rb_intern("add"));
     cb_sym_all = ID2SYM(rb_intern("all"));
     cb_sym_append = ID2SYM(rb_intern("append"));
+    cb_sym_arith = ID2SYM(rb_intern("arith"));
     cb_sym_assemble_hash = ID2SYM(rb_intern("assemble_hash"));
     cb_sym_async = ID2SYM(rb_intern("async"));
     cb_sym_body = ID2SYM(rb_intern("body"));
     cb_sym_bootstrap_transports = ID2SYM(rb_intern("bootstrap_transports"));
+    cb_sym_batch_callback = ID2SYM(rb_intern("batch_callback"));
     cb_sym_bucket = ID2SYM(rb_intern("bucket"));
     cb_sym_cas = ID2SYM(rb_intern("cas"));
     cb_sym_cccp = ID2SYM(rb_intern("cccp"));
     cb_sym_chunked = ID2SYM(rb_intern("chunked"));
     cb_sym_cluster = ID2SYM(rb_intern("cluster"));
+    cb_sym_collect_latency = ID2SYM(rb_intern("collect_latency"));
+    cb_sym_compact = ID2SYM(rb_intern("compact"));
     cb_sym_connect = ID2SYM(rb_intern("connect"));
     cb_sym_content_type = ID2SYM(rb_intern("content_type"));
+    cb_sym_count = ID2SYM(rb_intern("count"));
     cb_sym_create = ID2SYM(rb_intern("create"));
     cb_sym_decrement = ID2SYM(rb_intern("decrement"));
     cb_sym_default = ID2SYM(rb_intern("default"));
@@ -1323,6 +1495,7 @@ Init_couchbase_ext(void)
     cb_sym_http_request = ID2SYM(rb_intern("http_request"));
     cb_sym_increment = ID2SYM(rb_intern("increment"));
     cb_sym_initial = ID2SYM(rb_intern("initial"));
+    cb_sym_io_uring = ID2SYM(rb_intern("io_uring"));
     cb_sym_iocp = ID2SYM(rb_intern("iocp"));
     cb_sym_key_prefix = ID2SYM(rb_intern("key_prefix"));
     cb_sym_libev = ID2SYM(rb_intern("libev"));
@@ -1330,12 +1503,21 @@ Init_couchbase_ext(void)
     cb_sym_lock = ID2SYM(rb_intern("lock"));
     cb_sym_management = ID2SYM(rb_intern("management"));
     cb_sym_marshal = ID2SYM(rb_intern("marshal"));
+    cb_sym_max = ID2SYM(rb_intern("max"));
+    cb_sym_max_in_flight_bytes = ID2SYM(rb_intern("max_in_flight_bytes"));
+    cb_sym_max_in_flight_ops = ID2SYM(rb_intern("max_in_flight_ops"));
+    cb_sym_max_linger = ID2SYM(rb_intern("max_linger"));
+    cb_sym_max_ops = ID2SYM(rb_intern("max_ops"));
+    cb_sym_mean = ID2SYM(rb_intern("mean"));
+    cb_sym_merge = ID2SYM(rb_intern("merge"));
     cb_sym_method = ID2SYM(rb_intern("method"));
+    cb_sym_min = ID2SYM(rb_intern("min"));
     cb_sym_node_list = ID2SYM(rb_intern("node_list"));
     cb_sym_not_found = ID2SYM(rb_intern("not_found"));
     cb_sym_num_replicas = ID2SYM(rb_intern("num_replicas"));
     cb_sym_observe = ID2SYM(rb_intern("observe"));
     cb_sym_password = ID2SYM(rb_intern("password"));
+    cb_sym_percentiles = ID2SYM(rb_intern("percentiles"));
     cb_sym_periodic = ID2SYM(rb_intern("periodic"));
     cb_sym_persisted = ID2SYM(rb_intern("persisted"));
     cb_sym_plain = ID2SYM(rb_intern("plain"));
@@ -1348,9 +1530,11 @@ Init_couchbase_ext(void)
     cb_sym_quiet = ID2SYM(rb_intern("quiet"));
     cb_sym_replace = ID2SYM(rb_intern("replace"));
     cb_sym_replica = ID2SYM(rb_intern("replica"));
+    cb_sym_reset = ID2SYM(rb_intern("reset"));
     cb_sym_select = ID2SYM(rb_intern("select"));
     cb_sym_send_threshold = ID2SYM(rb_intern("send_threshold"));
     cb_sym_set = ID2SYM(rb_intern("set"));
+    cb_sym_size = ID2SYM(rb_intern("size"));
     cb_sym_stats = ID2SYM(rb_intern("stats"));
     cb_sym_timeout = ID2SYM(rb_intern("timeout"));
     cb_sym_touch = ID2SYM(rb_intern("touch"));
@@ -58,6 +58,49 @@ extern hrtime_t gethrtime(void);
 #define va_init_list(a,b) va_start(a)
 #endif
 
+/*
+ * Static tracepoints (USDT) of provider "couchbase". They compile to nop
+ * instructions, and the arguments are evaluated only when the probe is
+ * attached (the tracer increments the semaphore of the probe):
+ *
+ *   schedule(op, key, nkey, nbytes)
+ *   response(op, key, nkey, nbytes, elapsed_ns)
+ *   encode(flags, nbytes, elapsed_ns)
+ *   decode(flags, nbytes, elapsed_ns)
+ *   loop__enter()
+ *   loop__exit(elapsed_ns)
+ *
+ * For example:
+ *
+ *   bpftrace -e 'usdt:couchbase_ext.so:couchbase:response
+ *       /arg4 > 1000000/ { printf("%s %s\n", str(arg0), str(arg1, arg2)); }'
+ */
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#endif
+#ifdef STAP_PROBE
+#define CB_PROBES(X) X(schedule) X(response) X(encode) X(decode) X(loop__enter) X(loop__exit)
+#define CB_PROBE_SEMAPHORE(name) \
+    unsigned short couchbase_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")));
+#define CB_PROBE_DECLARE(name) extern CB_PROBE_SEMAPHORE(name)
+CB_PROBES(CB_PROBE_DECLARE)
+#define CB_PROBE_ENABLED(name) __builtin_expect(couchbase_##name##_semaphore, 0)
+#define CB_PROBE0(name) STAP_PROBE(couchbase, name)
+#define CB_PROBE1(name, a1) STAP_PROBE1(couchbase, name, a1)
+#define CB_PROBE3(name, a1, a2, a3) STAP_PROBE3(couchbase, name, a1, a2, a3)
+#define CB_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(couchbase, name, a1, a2, a3, a4)
+#define CB_PROBE5(name, a1, a2, a3, a4, a5) STAP_PROBE5(couchbase, name, a1, a2, a3, a4, a5)
+#else
+/* the arguments are never evaluated, but still considered used */
+#define CB_PROBE_ENABLED(name) 0
+#define CB_PROBE0(name) do {} while (0)
+#define CB_PROBE1(name, a1) do { if (0) { (void)(a1); } } while (0)
+#define CB_PROBE3(name, a1, a2, a3) do { if (0) { (void)(a1); (void)(a2); (void)(a3); } } while (0)
+#define CB_PROBE4(name, a1, a2, a3, a4) do { if (0) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } } while (0)
+#define CB_PROBE5(name, a1, a2, a3, a4, a5) do { if (0) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); (void)(a5); } } while (0)
+#endif
+
 #ifndef HAVE_RB_HASH_LOOKUP2
 VALUE rb_hash_lookup2(VALUE, VALUE, VALUE);
 #endif
@@ -82,7 +125,22 @@ typedef st_data_t st_index_t;
 #define CB_FMT_PLAIN       0x2
 
 #define CB_PACKET_HEADER_SIZE 24
+
+/* the argument could be handled by the single key fast path */
+#define CB_SINGLE_KEY_P(key) (TYPE(key) == T_STRING || TYPE(key) == T_SYMBOL)
 /* Structs */
+enum cb_latency_op_t {
+    cb_latency_get = 0,
+    cb_latency_set,
+    cb_latency_delete,
+    cb_latency_arith,
+    cb_latency_observe,
+    cb_latency_http,
+    CB_LATENCY_NOPS
+};
+#define CB_LATENCY_NO_SIZE ((size_t)-1)
+
+struct cb_latency_node_st;
 struct cb_bucket_st
 {
     lcb_t handle;
@@ -110,6 +168,22 @@ struct cb_bucket_st
     uint32_t timeout;
     size_t threshold;       /* the number of bytes to trigger event loop, zero if don't care */
     size_t nbytes;          /* the number of bytes scheduled to be sent */
+    size_t max_ops;         /* the number of operations to trigger event loop, zero if don't care */
+    size_t nops;            /* the number of operations scheduled since last flush */
+    hrtime_t max_linger;    /* the age of the oldest operation to trigger event loop (ns), zero if don't care */
+    hrtime_t first_op;      /* the time the oldest unflushed operation was scheduled, zero if none */
+    int adaptive;           /* tune the threshold from observed round trip and rate */
+    double flush_rtt;       /* moving average of the flush duration (ns) */
+    double flush_rate;      /* moving average of the rate of scheduled bytes (bytes/ns) */
+    size_t max_in_flight_ops;   /* the number of pending operations to block the submitter, zero if don't care */
+    size_t max_in_flight_bytes; /* the number of pending bytes to block the submitter, zero if don't care */
+    size_t in_flight_ops;   /* the number of operations scheduled in async mode and not completed yet */
+    size_t in_flight_bytes; /* the number of bytes of these operations */
+    int throttled;          /* the loop is running until in-flight limits are satisfied */
+    int collect_latency;    /* record latency histograms of the responses */
+    struct cb_latency_node_st *latency_nodes; /* latency histograms per node, see latency.c */
+    struct cb_latency_node_st **latency_index; /* latency_nodes by server index of current config */
+    size_t latency_index_size;
     VALUE exception;        /* error delivered by error_callback */
     VALUE on_error_proc;    /* is using to deliver errors in async mode */
     VALUE on_connect_proc;  /* used to notify that instance ready to handle requests in async mode */
@@ -118,14 +192,24 @@ struct cb_bucket_st
     VALUE node_list;
     VALUE bootstrap_transports;
     st_table *object_space;
+    struct cb_context_st *contexts;      /* in-flight contexts */
+    struct cb_context_st *free_contexts; /* released contexts ready for reuse */
+    struct cb_context_slab_st *context_slabs;
+    char *arena;            /* scratch memory for command arrays */
+    size_t arena_size;
+    size_t arena_used;
+    int arena_nesting;      /* the number of cb_params_build() in progress */
     char destroying;
     char async_disconnect_hook_set;
     VALUE self;             /* the pointer to bucket representation in ruby land */
 };
 
 struct cb_http_request_st;
+struct cb_key_index_st;
 struct cb_context_st
 {
+    struct cb_context_st *next;
+    struct cb_context_st *prev;
     struct cb_bucket_st* bucket;
     int extended;
     VALUE proc;
@@ -141,9 +225,23 @@ struct cb_context_st
     int quiet;
     int arith;           /* incr: +1, decr: -1, other: 0 */
     int all_replicas;    /* handle multiple responses from get_replica if non-zero */
+    int arity;           /* cached arity of the proc, CB_ARITY_UNKNOWN until first call */
+    VALUE batch;         /* results collected for :batch_callback or nil */
+    VALUE keys;          /* keys of the request without prefix (Array or single String) or nil */
+    int single;          /* rv holds the result of the single key instead of Hash */
+    struct cb_key_index_st *index; /* positions of the keys if more than one */
+    lcb_timer_t deadline;  /* timer of the :timeout option or NULL */
+    int timed_out;         /* the deadline has been reached */
+    int detached;          /* late responses are pending, the last one frees the context */
+    size_t in_flight_ops;  /* contribution to bucket->in_flight_ops */
+    size_t in_flight_bytes;/* contribution to bucket->in_flight_bytes */
+    hrtime_t start;        /* the time the context was allocated, to measure latency */
     size_t nqueries;
 };
 
+#define CB_ARITY_UNKNOWN INT_MIN
+#define CB_KEY_INDEX_START ((size_t)-1)
+
 struct cb_http_request_st {
     struct cb_bucket_st *bucket;
     VALUE bucket_obj;
@@ -151,6 +249,8 @@ struct cb_http_request_st {
     int extended;
     int running;
     int completed;
+    int paused;
+    uint32_t timeout;
     lcb_http_request_t request;
     lcb_http_cmd_t cmd;
     struct cb_context_st *ctx;
@@ -167,11 +267,34 @@ struct cb_timer_st
     VALUE callback;
 };
 
+struct cb_result_st
+{
+    VALUE operation;
+    VALUE error;
+    VALUE key;
+    VALUE value;
+    VALUE node;
+    VALUE headers;
+    VALUE status;
+    VALUE completed;
+    VALUE from_master;
+    lcb_cas_t cas;
+    lcb_uint32_t flags;
+    lcb_time_t ttp;
+    lcb_time_t ttr;
+    unsigned int has_cas : 1;
+    unsigned int has_flags : 1;
+    unsigned int has_ttp : 1;
+    unsigned int has_ttr : 1;
+};
+
 /* Classes */
 extern VALUE cb_cBucket;
 extern VALUE cb_cCouchRequest;
 extern VALUE cb_cResult;
 extern VALUE cb_cTimer;
+extern VALUE cb_cPrepared;
+extern VALUE cb_cViewParser;
 
 /* Modules */
 extern VALUE cb_mCouchbase;
@@ -180,24 +303,32 @@ extern VALUE cb_mTranscoder;
 extern VALUE cb_mDocument;
 extern VALUE cb_mPlain;
 extern VALUE cb_mMarshal;
+extern VALUE cb_mNativeJSON;
 extern VALUE cb_mURI;
+extern VALUE cb_mMultiJson;
 extern VALUE em_m;
 
 /* Symbols */
+extern ID cb_sym_adaptive;
 extern ID cb_sym_add;
 extern ID cb_sym_all;
 extern ID cb_sym_append;
+extern ID cb_sym_arith;
 extern ID cb_sym_assemble_hash;
 extern ID cb_sym_async;
 extern ID cb_sym_body;
 extern ID cb_sym_bootstrap_transports;
+extern ID cb_sym_batch_callback;
 extern ID cb_sym_bucket;
 extern ID cb_sym_cas;
 extern ID cb_sym_cccp;
 extern ID cb_sym_chunked;
 extern ID cb_sym_cluster;
+extern ID cb_sym_collect_latency;
+extern ID cb_sym_compact;
 extern ID cb_sym_connect;
 extern ID cb_sym_content_type;
+extern ID cb_sym_count;
 extern ID cb_sym_create;
 extern ID cb_sym_decrement;
 extern ID cb_sym_default;
@@ -225,6 +356,7 @@ extern ID cb_sym_http;
 extern ID cb_sym_http_request;
 extern ID cb_sym_increment;
 extern ID cb_sym_initial;
+extern ID cb_sym_io_uring;
 extern ID cb_sym_iocp;
 extern ID cb_sym_key_prefix;
 extern ID cb_sym_libev;
@@ -232,12 +364,21 @@ extern ID cb_sym_libevent;
 extern ID cb_sym_lock;
 extern ID cb_sym_management;
 extern ID cb_sym_marshal;
+extern ID cb_sym_max;
+extern ID cb_sym_max_in_flight_bytes;
+extern ID cb_sym_max_in_flight_ops;
+extern ID cb_sym_max_linger;
+extern ID cb_sym_max_ops;
+extern ID cb_sym_mean;
+extern ID cb_sym_merge;
 extern ID cb_sym_method;
+extern ID cb_sym_min;
 extern ID cb_sym_node_list;
 extern ID cb_sym_not_found;
 extern ID cb_sym_num_replicas;
 extern ID cb_sym_observe;
 extern ID cb_sym_password;
+extern ID cb_sym_percentiles;
 extern ID cb_sym_periodic;
 extern ID cb_sym_persisted;
 extern ID cb_sym_plain;
@@ -250,9 +391,11 @@ extern ID cb_sym_put;
 extern ID cb_sym_quiet;
 extern ID cb_sym_replace;
 extern ID cb_sym_replica;
+extern ID cb_sym_reset;
 extern ID cb_sym_select;
 extern ID cb_sym_send_threshold;
 extern ID cb_sym_set;
+extern ID cb_sym_size;
 extern ID cb_sym_stats;
 extern ID cb_sym_timeout;
 extern ID cb_sym_touch;
@@ -299,6 +442,7 @@ extern ID cb_id_path;
 extern ID cb_id_port;
 extern ID cb_id_scheme;
 extern ID cb_id_sprintf;
+extern ID cb_id_to_json;
 extern ID cb_id_to_s;
 extern ID cb_id_user;
 extern ID cb_id_verify_observe_options;
@@ -361,14 +505,28 @@ int cb_bucket_connected_bang(struct cb_bucket_st *bucket, VALUE operation);
 void cb_gc_protect_ptr(struct cb_bucket_st *bucket, void *ptr, mark_f mark_func);
 void cb_gc_unprotect_ptr(struct cb_bucket_st *bucket, void *ptr);
 VALUE cb_proc_call(struct cb_bucket_st *bucket, VALUE recv, int argc, ...);
+void cb_context_yield(struct cb_context_st *ctx, VALUE res);
+void cb_context_flush_batch(struct cb_context_st *ctx);
 int cb_first_value_i(VALUE key, VALUE value, VALUE arg);
 void cb_build_headers(struct cb_context_st *ctx, const char * const *headers);
 void cb_maybe_do_loop(struct cb_bucket_st *bucket);
+int cb_bucket_over_limits(struct cb_bucket_st *bucket);
 VALUE cb_unify_key(struct cb_bucket_st *bucket, VALUE key, int apply_prefix);
+VALUE cb_unify_key_frozen(struct cb_bucket_st *bucket, VALUE key, VALUE *prefixed);
 VALUE cb_encode_value(VALUE transcoder, VALUE val, uint32_t *flags, VALUE options);
+VALUE cb_encode_value_bang(VALUE transcoder, VALUE key, VALUE val, uint32_t *flags, VALUE options);
 VALUE cb_decode_value(VALUE transcoder, VALUE blob, uint32_t flags, VALUE options);
 void cb_async_error_notify(struct cb_bucket_st *bucket, VALUE exc);
 
+extern int cb_json_native;
+VALUE cb_json_dump(VALUE obj);
+VALUE cb_json_load(VALUE blob);
+VALUE cb_json_parse(const char **ptr, const char *end, VALUE eclass);
+VALUE cb_json_s_dump(VALUE klass, VALUE obj);
+VALUE cb_json_s_load(VALUE klass, VALUE blob);
+VALUE cb_document_native_get(VALUE klass);
+VALUE cb_document_native_set(VALUE klass, VALUE val);
+
 
 void cb_storage_callback(lcb_t handle, const void *cookie, lcb_storage_t operation, lcb_error_t error, const lcb_store_resp_t *resp);
 void cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_get_resp_t *resp);
@@ -383,8 +541,24 @@ void cb_observe_callback(lcb_t handle, const void *cookie, lcb_error_t error, co
 void cb_unlock_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_unlock_resp_t *resp);
 
 struct cb_context_st *cb_context_alloc(struct cb_bucket_st *bucket);
+struct cb_context_st *cb_context_alloc_single(struct cb_bucket_st *bucket, VALUE key);
 struct cb_context_st *cb_context_alloc_common(struct cb_bucket_st *bucket, VALUE proc, size_t nqueries);
 void cb_context_free(struct cb_context_st *ctx);
+void cb_context_scheduled(struct cb_context_st *ctx, size_t nbytes);
+void cb_latency_record(struct cb_context_st *ctx, enum cb_latency_op_t op, const void *key, size_t nkey, size_t nbytes);
+void cb_latency_record_size(struct cb_bucket_st *bucket, enum cb_latency_op_t op, const void *key, size_t nkey, size_t nbytes);
+void cb_latency_free(struct cb_bucket_st *bucket);
+void cb_latency_config_changed(struct cb_bucket_st *bucket);
+void cb_context_mark_all(struct cb_bucket_st *bucket);
+void cb_context_free_all(struct cb_bucket_st *bucket);
+void cb_context_index_init(struct cb_context_st *ctx, VALUE keys);
+VALUE cb_context_key(struct cb_context_st *ctx, const void *key, size_t nkey);
+void cb_context_set_result(struct cb_context_st *ctx, VALUE key, VALUE val);
+VALUE cb_context_wait(struct cb_context_st *ctx);
+void cb_context_set_deadline(struct cb_context_st *ctx, uint32_t usec);
+void cb_context_complete(struct cb_context_st *ctx);
+void cb_context_wait_responses(struct cb_context_st *ctx);
+void cb_context_index_store(struct cb_context_st *ctx, const void *key, size_t nkey, VALUE val);
 
 VALUE cb_bucket_alloc(VALUE klass);
 void cb_bucket_free(void *ptr);
@@ -415,6 +589,8 @@ VALUE cb_bucket_connected_p(VALUE self);
 VALUE cb_bucket_async_p(VALUE self);
 VALUE cb_bucket_quiet_get(VALUE self);
 VALUE cb_bucket_quiet_set(VALUE self, VALUE val);
+VALUE cb_bucket_collect_latency_get(VALUE self);
+VALUE cb_bucket_collect_latency_set(VALUE self, VALUE val);
 VALUE cb_bucket_transcoder_get(VALUE self);
 VALUE cb_bucket_transcoder_set(VALUE self, VALUE val);
 VALUE cb_bucket_default_flags_get(VALUE self);
@@ -439,6 +615,11 @@ VALUE cb_bucket_username_get(VALUE self);
 VALUE cb_bucket_password_get(VALUE self);
 VALUE cb_bucket_environment_get(VALUE self);
 VALUE cb_bucket_num_replicas_get(VALUE self);
+VALUE cb_bucket_in_flight_ops_get(VALUE self);
+VALUE cb_bucket_live_contexts_get(VALUE self);
+VALUE cb_bucket_in_flight_bytes_get(VALUE self);
+VALUE cb_bucket_latency_stats(int argc, VALUE *argv, VALUE self);
+VALUE cb_bucket_reset_latency_stats(VALUE self);
 VALUE cb_bucket_default_observe_timeout_get(VALUE self);
 VALUE cb_bucket_default_observe_timeout_set(VALUE self, VALUE val);
 VALUE cb_bucket_default_arithmetic_init_get(VALUE self);
@@ -451,12 +632,32 @@ VALUE cb_http_request_on_body(VALUE self);
 VALUE cb_http_request_perform(VALUE self);
 VALUE cb_http_request_pause(VALUE self);
 VALUE cb_http_request_continue(VALUE self);
+VALUE cb_http_request_cancel(VALUE self);
 VALUE cb_http_request_path_get(VALUE self);
 VALUE cb_http_request_extended_get(VALUE self);
 VALUE cb_http_request_chunked_get(VALUE self);
 
+extern const rb_data_type_t cb_result_type;
+VALUE cb_result_alloc(VALUE klass);
+VALUE cb_result_new(struct cb_result_st **res);
 VALUE cb_result_success_p(VALUE self);
 VALUE cb_result_inspect(VALUE self);
+VALUE cb_result_operation_get(VALUE self);
+VALUE cb_result_error_get(VALUE self);
+VALUE cb_result_key_get(VALUE self);
+VALUE cb_result_value_get(VALUE self);
+VALUE cb_result_cas_get(VALUE self);
+VALUE cb_result_flags_get(VALUE self);
+VALUE cb_result_node_get(VALUE self);
+VALUE cb_result_headers_get(VALUE self);
+VALUE cb_result_completed_get(VALUE self);
+VALUE cb_result_status_get(VALUE self);
+VALUE cb_result_from_master_get(VALUE self);
+VALUE cb_result_time_to_persist_get(VALUE self);
+VALUE cb_result_time_to_replicate_get(VALUE self);
+VALUE cb_result_init_copy(VALUE copy, VALUE orig);
+VALUE cb_result_marshal_dump(VALUE self);
+VALUE cb_result_marshal_load(VALUE self, VALUE data);
 
 VALUE cb_timer_alloc(VALUE klass);
 VALUE cb_timer_inspect(VALUE self);
@@ -604,12 +805,62 @@ struct cb_params_st
     size_t idx;
     /* the approximate size of the data to be sent */
     size_t npayload;
+    /* yield all results as single array (:batch_callback option) */
+    int batch;
+    /* client side deadline of synchronous operation in microseconds
+     * (:timeout option) or zero */
+    uint32_t timeout;
+    /* keys of the items without prefix (frozen Strings) */
+    VALUE keys;
+    /* the bucket arena offset to restore in cb_params_destroy */
+    size_t arena_mark;
+    /* resolved options of the prepared operation or NULL */
+    struct cb_prepared_st *prepared;
     VALUE ensurance;
     VALUE args;
 };
 
 void cb_params_destroy(struct cb_params_st *params);
 void cb_params_build(struct cb_params_st *params);
+void cb_params_prepare(struct cb_params_st *params, VALUE opts);
+
+struct cb_prepared_st
+{
+    struct cb_bucket_st *bucket;
+    VALUE bucket_obj;
+    VALUE operation;
+    struct cb_params_st params;  /* command with defaults and options applied */
+};
+
+VALUE cb_prepared_alloc(VALUE klass);
+VALUE cb_prepared_init(int argc, VALUE *argv, VALUE self);
+VALUE cb_prepared_inspect(VALUE self);
+VALUE cb_prepared_call(int argc, VALUE *argv, VALUE self);
+VALUE cb_prepared_operation_get(VALUE self);
+VALUE cb_bucket_prepare(int argc, VALUE *argv, VALUE self);
+VALUE cb_bucket_get_prepared(int argc, VALUE *argv, VALUE self, struct cb_prepared_st *prepared);
+VALUE cb_bucket_store_prepared(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self, struct cb_prepared_st *prepared);
+
+struct cb_view_parser_st
+{
+    char *buf;          /* unparsed data of the response */
+    size_t len;
+    size_t cap;
+    size_t pos;         /* offset of the first unparsed byte in buf */
+    int state;          /* enum cb_view_parser_state */
+    int key;            /* enum cb_view_parser_key, current envelope key */
+    int compact;
+    VALUE on_object;
+    VALUE path_total_rows;
+    VALUE path_rows;
+    VALUE path_errors;
+};
+
+VALUE cb_view_parser_alloc(VALUE klass);
+VALUE cb_view_parser_init(int argc, VALUE *argv, VALUE self);
+VALUE cb_view_parser_on_object(VALUE self);
+VALUE cb_view_parser_feed(VALUE self, VALUE chunk);
+VALUE cb_view_parser_compact_get(VALUE self);
 
 /* common plugin functions */
 lcb_ssize_t cb_io_recv(struct lcb_io_opt_st *iops, lcb_socket_t sock, void *buffer, lcb_size_t len, int flags);
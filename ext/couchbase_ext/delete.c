@@ -23,10 +23,11 @@ cb_delete_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lc
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE key, exc = Qnil, res;
+    struct cb_result_st *result;
 
     ctx->nqueries--;
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    cb_latency_record(ctx, cb_latency_delete, resp->v.v0.key, resp->v.v0.nkey, CB_LATENCY_NO_SIZE);
 
     if (error != LCB_KEY_ENOENT || !ctx->quiet) {
         exc = cb_check_error(error, "failed to remove value", key);
@@ -37,24 +38,52 @@ cb_delete_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lc
     }
     if (bucket->async) {    /* asynchronous */
         if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_operation, cb_sym_delete);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->operation = cb_sym_delete;
+            result->key = key;
+            cb_context_yield(ctx, res);
         }
     } else {                /* synchronous */
-        rb_hash_aset(ctx->rv, key, (error == LCB_SUCCESS) ? Qtrue : Qfalse);
+        cb_context_set_result(ctx, key, (error == LCB_SUCCESS) ? Qtrue : Qfalse);
     }
     if (ctx->nqueries == 0) {
+        cb_context_flush_batch(ctx);
         ctx->proc = Qnil;
-        if (bucket->async) {
+        cb_context_complete(ctx);
+        if (bucket->async || ctx->detached) {
             cb_context_free(ctx);
         }
     }
     (void)handle;
 }
 
+/* synchronous delete of the single key without options */
+    static VALUE
+cb_bucket_delete_single(struct cb_bucket_st *bucket, VALUE key)
+{
+    struct cb_context_st *ctx;
+    lcb_remove_cmd_t cmd;
+    const lcb_remove_cmd_t *ptr = &cmd;
+    lcb_error_t err;
+    VALUE prefixed, exc;
+
+    key = cb_unify_key_frozen(bucket, key, &prefixed);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.v.v0.key = RSTRING_PTR(prefixed);
+    cmd.v.v0.nkey = RSTRING_LEN(prefixed);
+    ctx = cb_context_alloc_single(bucket, key);
+    ctx->quiet = bucket->quiet;
+    err = lcb_remove(bucket->handle, (const void *)ctx, 1, &ptr);
+    exc = cb_check_error(err, "failed to schedule delete request", Qnil);
+    if (exc != Qnil) {
+        cb_context_free(ctx);
+        rb_exc_raise(exc);
+    }
+    bucket->nbytes += CB_PACKET_HEADER_SIZE + cmd.v.v0.nkey;
+    return cb_context_wait(ctx);
+}
+
 /*
  * Delete the specified key
  *
@@ -72,6 +101,14 @@ cb_delete_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lc
  *     a given key. This value is used to provide simple optimistic
  *     concurrency control when multiple clients or threads try to
  *     update/delete an item simultaneously.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @raise [Couchbase::Error::Connect] if connection closed (see {Bucket#reconnect})
  *   @raise [ArgumentError] when passing the block in synchronous mode
@@ -110,6 +147,9 @@ cb_bucket_delete(int argc, VALUE *argv, VALUE self)
     if (!cb_bucket_connected_bang(bucket, cb_sym_delete)) {
         return Qnil;
     }
+    if (argc == 1 && !bucket->async && !rb_block_given_p() && CB_SINGLE_KEY_P(argv[0])) {
+        return cb_bucket_delete_single(bucket, argv[0]);
+    }
 
     memset(&params, 0, sizeof(struct cb_params_st));
     rb_scan_args(argc, argv, "0*&", &params.args, &proc);
@@ -122,6 +162,10 @@ cb_bucket_delete(int argc, VALUE *argv, VALUE self)
     cb_params_build(&params);
 
     ctx = cb_context_alloc_common(bucket, proc, params.cmd.remove.num);
+    cb_context_index_init(ctx, params.keys);
+    if (bucket->async && params.batch) {
+        ctx->batch = rb_ary_new2(params.cmd.remove.num);
+    }
     ctx->quiet = params.cmd.remove.quiet;
     err = lcb_remove(bucket->handle, (const void *)ctx,
             params.cmd.remove.num, params.cmd.remove.ptr);
@@ -131,14 +175,15 @@ cb_bucket_delete(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_set_deadline(ctx, params.timeout);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
@@ -163,6 +163,9 @@ have_func("rb_thread_blocking_region")
 have_func("rb_thread_call_without_gvl")
 have_func("poll", "poll.h")
 have_func("ppoll", "poll.h")
+have_func("epoll_create", "sys/epoll.h")
+have_header("liburing.h") and have_library("uring", "io_uring_queue_init", "liburing.h")
+have_header("sys/sdt.h")
 have_func("rb_fiber_yield")
 define("_GNU_SOURCE")
 create_header("couchbase_config.h")
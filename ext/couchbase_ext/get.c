@@ -22,11 +22,13 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
 {
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
-    VALUE key, val, flags, cas, exc = Qnil, res, raw;
+    VALUE key, val, exc = Qnil, res, raw;
+    struct cb_result_st *result;
 
     ctx->nqueries--;
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    cb_latency_record(ctx, cb_latency_get, resp->v.v0.key, resp->v.v0.nkey,
+            error == LCB_SUCCESS ? resp->v.v0.nbytes : CB_LATENCY_NO_SIZE);
 
     if (error != LCB_KEY_ENOENT || !ctx->quiet) {
         exc = cb_check_error(error, "failed to get value", key);
@@ -37,8 +39,6 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
     }
 
     if (error == LCB_SUCCESS) {
-        flags = ULONG2NUM(resp->v.v0.flags);
-        cas = ULL2NUM(resp->v.v0.cas);
         raw = STR_NEW((const char*)resp->v.v0.bytes, resp->v.v0.nbytes);
         val = cb_decode_value(ctx->transcoder, raw, resp->v.v0.flags, ctx->transcoder_opts);
         if (rb_obj_is_kind_of(val, rb_eStandardError)) {
@@ -52,23 +52,28 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
             val = Qnil;
         }
     } else {
-        val = flags = cas = Qnil;
+        val = Qnil;
     }
     if (bucket->async) { /* asynchronous */
         if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_operation, cb_sym_get);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            rb_ivar_set(res, cb_id_iv_value, val);
-            rb_ivar_set(res, cb_id_iv_flags, flags);
-            rb_ivar_set(res, cb_id_iv_cas, cas);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->operation = cb_sym_get;
+            result->key = key;
+            result->value = val;
+            if (error == LCB_SUCCESS) {
+                result->flags = resp->v.v0.flags;
+                result->has_flags = 1;
+                result->cas = resp->v.v0.cas;
+                result->has_cas = 1;
+            }
+            cb_context_yield(ctx, res);
         }
     } else {                /* synchronous */
         if (NIL_P(exc) && error != LCB_KEY_ENOENT) {
             if (ctx->extended) {
-                val = rb_ary_new3(3, val, flags, cas);
+                val = rb_ary_new3(3, val, ULONG2NUM(resp->v.v0.flags),
+                        ULL2NUM(resp->v.v0.cas));
             }
             if (ctx->all_replicas) {
                 VALUE ary = rb_hash_aref(ctx->rv, key);
@@ -77,21 +82,54 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
                     rb_hash_aset(ctx->rv, key, ary);
                 }
                 rb_ary_push(ary, val);
+            } else if (TYPE(ctx->rv) == T_ARRAY) {
+                cb_context_index_store(ctx, resp->v.v0.key, resp->v.v0.nkey, val);
             } else {
-                rb_hash_aset(ctx->rv, key, val);
+                cb_context_set_result(ctx, key, val);
             }
         }
     }
 
     if (ctx->nqueries == 0) {
+        cb_context_flush_batch(ctx);
         ctx->proc = Qnil;
-        if (bucket->async) {
+        cb_context_complete(ctx);
+        if (bucket->async || ctx->detached) {
             cb_context_free(ctx);
         }
     }
     (void)handle;
 }
 
+/* synchronous get of the single key without options */
+    static VALUE
+cb_bucket_get_single(struct cb_bucket_st *bucket, VALUE key)
+{
+    struct cb_context_st *ctx;
+    lcb_get_cmd_t cmd;
+    const lcb_get_cmd_t *ptr = &cmd;
+    lcb_error_t err;
+    VALUE prefixed, exc;
+
+    key = cb_unify_key_frozen(bucket, key, &prefixed);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.v.v0.key = RSTRING_PTR(prefixed);
+    cmd.v.v0.nkey = RSTRING_LEN(prefixed);
+    ctx = cb_context_alloc_single(bucket, key);
+    ctx->quiet = bucket->quiet;
+    ctx->transcoder = bucket->transcoder;
+    ctx->transcoder_opts = Qnil;
+    err = lcb_get(bucket->handle, (const void *)ctx, 1, &ptr);
+    exc = cb_check_error(err, "failed to schedule get request", Qnil);
+    if (exc != Qnil) {
+        cb_context_free(ctx);
+        rb_exc_raise(exc);
+    }
+    CB_PROBE4(schedule, "get", cmd.v.v0.key, cmd.v.v0.nkey, 0);
+    bucket->nbytes += CB_PACKET_HEADER_SIZE + cmd.v.v0.nkey;
+    return cb_context_wait(ctx);
+}
+
 /*
  * Obtain an object stored in Couchbase by given key.
  *
@@ -134,6 +172,14 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
  *     and return first successful response, skipping all failures.
  *     It is also possible to query all replicas in parallel using
  *     the +:all+ option, or pass a replica index, starting from zero.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @yieldparam ret [Result] the result of operation in asynchronous mode
  *     (valid attributes: +error+, +operation+, +key+, +value+, +flags+,
@@ -227,17 +273,28 @@ cb_get_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_g
  */
     VALUE
 cb_bucket_get(int argc, VALUE *argv, VALUE self)
+{
+    return cb_bucket_get_prepared(argc, argv, self, NULL);
+}
+
+/* the body of Bucket#get, prepared is NULL unless called by Prepared#call */
+    VALUE
+cb_bucket_get_prepared(int argc, VALUE *argv, VALUE self, struct cb_prepared_st *prepared)
 {
     struct cb_bucket_st *bucket = DATA_PTR(self);
     struct cb_context_st *ctx;
     VALUE rv, proc, exc;
     size_t ii;
+    int ordered;
     lcb_error_t err = LCB_SUCCESS;
     struct cb_params_st params;
 
     if (!cb_bucket_connected_bang(bucket, cb_sym_get)) {
         return Qnil;
     }
+    if (prepared == NULL && argc == 1 && !bucket->async && !rb_block_given_p() && CB_SINGLE_KEY_P(argv[0])) {
+        return cb_bucket_get_single(bucket, argv[0]);
+    }
 
     memset(&params, 0, sizeof(struct cb_params_st));
     rb_scan_args(argc, argv, "0*&", &params.args, &proc);
@@ -246,13 +303,27 @@ cb_bucket_get(int argc, VALUE *argv, VALUE self)
     }
     params.type = cb_cmd_get;
     params.bucket = bucket;
+    params.prepared = prepared;
     params.cmd.get.keys_ary = rb_ary_new();
     cb_params_build(&params);
     ctx = cb_context_alloc_common(bucket, proc, params.cmd.get.num);
+    cb_context_index_init(ctx, params.keys);
+    if (bucket->async && params.batch) {
+        ctx->batch = rb_ary_new2(params.cmd.get.num);
+    }
     ctx->extended = params.cmd.get.extended;
     ctx->quiet = params.cmd.get.quiet;
     ctx->transcoder = params.cmd.get.transcoder;
     ctx->transcoder_opts = params.cmd.get.transcoder_opts;
+    ordered = !bucket->async && params.cmd.get.num > 0 &&
+        !params.cmd.get.gat && !params.cmd.get.assemble_hash &&
+        !(params.cmd.get.extended && (params.cmd.get.num > 1 || params.cmd.get.array)) &&
+        params.cmd.get.replica != cb_sym_all;
+    if (ordered) {
+        /* store values right into the resulting array by key position */
+        ctx->rv = rb_ary_new2(params.cmd.get.num);
+        rb_ary_store(ctx->rv, params.cmd.get.num - 1, Qnil);
+    }
     if (RTEST(params.cmd.get.replica)) {
         if (params.cmd.get.replica == cb_sym_all) {
             ctx->nqueries = lcb_get_num_replicas(bucket->handle);
@@ -264,20 +335,33 @@ cb_bucket_get(int argc, VALUE *argv, VALUE self)
         err = lcb_get(bucket->handle, (const void *)ctx,
                 params.cmd.get.num, params.cmd.get.ptr);
     }
+    if (err == LCB_SUCCESS && CB_PROBE_ENABLED(schedule)) {
+        size_t ii;
+        for (ii = 0; ii < params.cmd.get.num; ++ii) {
+            if (RTEST(params.cmd.get.replica)) {
+                CB_PROBE4(schedule, "get", params.cmd.get.ptr_gr[ii]->v.v0.key,
+                        params.cmd.get.ptr_gr[ii]->v.v0.nkey, 0);
+            } else {
+                CB_PROBE4(schedule, "get", params.cmd.get.ptr[ii]->v.v0.key,
+                        params.cmd.get.ptr[ii]->v.v0.nkey, 0);
+            }
+        }
+    }
     cb_params_destroy(&params);
     exc = cb_check_error(err, "failed to schedule get request", Qnil);
     if (exc != Qnil) {
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_set_deadline(ctx, params.timeout);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
@@ -290,6 +374,12 @@ cb_bucket_get(int argc, VALUE *argv, VALUE self)
             bucket->exception = Qnil;
             rb_exc_raise(exc);
         }
+        if (ordered) {
+            if (params.cmd.get.num > 1 || params.cmd.get.array) {
+                return rv;  /* return as an array [value1, value2, ...] */
+            }
+            return rb_ary_entry(rv, 0);
+        }
         if (params.cmd.get.gat || params.cmd.get.assemble_hash ||
                 (params.cmd.get.extended && (params.cmd.get.num > 1 || params.cmd.get.array))) {
             return rv;  /* return as a hash {key => [value, flags, cas], ...} */
@@ -28,10 +28,12 @@ cb_http_complete_callback(lcb_http_request_t request, lcb_t handle, const void *
     ctx->request->completed = 1;
 
     if (bucket->destroying) {
+        ctx->request->ctx = NULL;
         cb_context_free(ctx);
         return;
     }
 
+    cb_latency_record(ctx, cb_latency_http, NULL, 0, resp->v.v0.nbytes);
     key = STR_NEW((const char*)resp->v.v0.path, resp->v.v0.npath);
     val = resp->v.v0.nbytes ? STR_NEW((const char*)resp->v.v0.bytes, resp->v.v0.nbytes) : Qnil;
     exc = ctx->exception;
@@ -53,14 +55,15 @@ cb_http_complete_callback(lcb_http_request_t request, lcb_t handle, const void *
         ctx->headers_val = Qnil;
     }
     if (ctx->extended) {
-        res = rb_class_new_instance(0, NULL, cb_cResult);
-        rb_ivar_set(res, cb_id_iv_error, ctx->exception);
-        rb_ivar_set(res, cb_id_iv_status, status ? INT2FIX(status) : Qnil);
-        rb_ivar_set(res, cb_id_iv_operation, cb_sym_http_request);
-        rb_ivar_set(res, cb_id_iv_key, key);
-        rb_ivar_set(res, cb_id_iv_value, val);
-        rb_ivar_set(res, cb_id_iv_completed, Qtrue);
-        rb_ivar_set(res, cb_id_iv_headers, ctx->headers_val);
+        struct cb_result_st *result;
+        res = cb_result_new(&result);
+        result->error = ctx->exception;
+        result->status = status ? INT2FIX(status) : Qnil;
+        result->operation = cb_sym_http_request;
+        result->key = key;
+        result->value = val;
+        result->completed = Qtrue;
+        result->headers = ctx->headers_val;
     } else {
         res = val;
     }
@@ -71,7 +74,9 @@ cb_http_complete_callback(lcb_http_request_t request, lcb_t handle, const void *
     if (!bucket->async && ctx->exception == Qnil) {
         ctx->rv = res;
     }
+    cb_context_complete(ctx);
     if (bucket->async) {
+        ctx->request->ctx = NULL;
         cb_context_free(ctx);
     }
     (void)handle;
@@ -107,14 +112,14 @@ cb_http_data_callback(lcb_http_request_t request, lcb_t handle, const void *cook
     }
     if (ctx->proc != Qnil) {
         if (ctx->extended) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, Qnil);
-            rb_ivar_set(res, cb_id_iv_status, status ? INT2FIX(status) : Qnil);
-            rb_ivar_set(res, cb_id_iv_operation, cb_sym_http_request);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            rb_ivar_set(res, cb_id_iv_value, val);
-            rb_ivar_set(res, cb_id_iv_completed, Qfalse);
-            rb_ivar_set(res, cb_id_iv_headers, ctx->headers_val);
+            struct cb_result_st *result;
+            res = cb_result_new(&result);
+            result->status = status ? INT2FIX(status) : Qnil;
+            result->operation = cb_sym_http_request;
+            result->key = key;
+            result->value = val;
+            result->completed = Qfalse;
+            result->headers = ctx->headers_val;
         } else {
             res = val;
         }
@@ -225,6 +230,9 @@ cb_http_request_init(int argc, VALUE *argv, VALUE self)
         Check_Type(opts, T_HASH);
         request->extended = RTEST(rb_hash_aref(opts, cb_sym_extended));
         request->cmd.v.v0.chunked = RTEST(rb_hash_aref(opts, cb_sym_chunked));
+        if ((arg = rb_hash_aref(opts, cb_sym_timeout)) != Qnil) {
+            request->timeout = (uint32_t)NUM2ULONG(arg);
+        }
         if ((arg = rb_hash_aref(opts, cb_sym_type)) != Qnil) {
             if (arg == cb_sym_view) {
                 request->type = LCB_HTTP_TYPE_VIEW;
@@ -278,6 +286,41 @@ cb_http_request_on_body(VALUE self)
     return old;
 }
 
+/*
+ * Run the event loop until the request is paused by the body callback or
+ * completed. The context of completed request is released, and its result
+ * returned or its error raised.
+ */
+    static VALUE
+cb_http_request_wait(struct cb_http_request_st *req)
+{
+    struct cb_context_st *ctx = req->ctx;
+    struct cb_bucket_st *bucket = req->bucket;
+    VALUE rv, exc;
+
+    req->paused = 0;
+    while (!req->completed && !req->paused && NIL_P(bucket->exception)) {
+        lcb_wait(bucket->handle);
+    }
+    if (!req->completed) {
+        exc = bucket->exception;
+        if (exc != Qnil) {
+            bucket->exception = Qnil;
+            rb_exc_raise(exc);
+        }
+        return Qnil;
+    }
+    rv = ctx->rv;
+    exc = ctx->exception;
+    req->ctx = NULL;
+    req->running = 0;
+    cb_context_free(ctx);
+    if (exc != Qnil) {
+        rb_exc_raise(exc);
+    }
+    return rv;
+}
+
 /*
  * Execute {Bucket::CouchRequest}
  *
@@ -288,13 +331,16 @@ cb_http_request_perform(VALUE self)
 {
     struct cb_http_request_st *req = DATA_PTR(self);
     struct cb_context_st *ctx;
-    VALUE rv, exc;
+    VALUE exc;
     lcb_error_t err;
     struct cb_bucket_st *bucket = req->bucket;
 
     if (!cb_bucket_connected_bang(bucket, cb_sym_http_request)) {
         return Qnil;
     }
+    if (bucket->async && req->timeout) {
+        rb_raise(rb_eArgError, "the :timeout option is not supported in asynchronous mode");
+    }
 
     ctx = cb_context_alloc(bucket);
     ctx->rv = Qnil;
@@ -302,6 +348,7 @@ cb_http_request_perform(VALUE self)
     ctx->extended = req->extended;
     ctx->request = req;
     ctx->headers_val = rb_hash_new();
+    req->completed = 0;
 
     err = lcb_make_http_request(bucket->handle, (const void *)ctx,
             req->type, &req->cmd, &req->request);
@@ -316,18 +363,8 @@ cb_http_request_perform(VALUE self)
     if (bucket->async) {
         return Qnil;
     } else {
-        lcb_wait(bucket->handle);
-        if (req->completed) {
-            rv = ctx->rv;
-            exc = ctx->exception;
-            cb_context_free(ctx);
-            if (exc != Qnil) {
-                rb_exc_raise(exc);
-            }
-            return rv;
-        } else {
-            return Qnil;
-        }
+        cb_context_set_deadline(ctx, req->timeout);
+        return cb_http_request_wait(req);
     }
     return Qnil;
 }
@@ -336,29 +373,50 @@ cb_http_request_perform(VALUE self)
 cb_http_request_pause(VALUE self)
 {
     struct cb_http_request_st *req = DATA_PTR(self);
+    req->paused = 1;
     lcb_breakout(req->bucket->handle);
     return Qnil;
 }
 
+/*
+ * Cancel the request and release its context
+ *
+ * @since 1.3.8
+ *
+ * It is safe to call it for completed request, or the request which has
+ * not been performed yet.
+ *
+ * @return [nil]
+ */
+    VALUE
+cb_http_request_cancel(VALUE self)
+{
+    struct cb_http_request_st *req = DATA_PTR(self);
+    struct cb_context_st *ctx = req->ctx;
+
+    if (ctx == NULL) {
+        return Qnil;
+    }
+    if (!req->completed) {
+        lcb_cancel_http_request(req->bucket->handle, req->request);
+        req->completed = 1;
+    }
+    req->ctx = NULL;
+    req->running = 0;
+    cb_context_free(ctx);
+    return Qnil;
+}
+
     VALUE
 cb_http_request_continue(VALUE self)
 {
-    VALUE exc, rv;
     struct cb_http_request_st *req = DATA_PTR(self);
 
-    if (req->running) {
-        lcb_wait(req->bucket->handle);
-        if (req->completed) {
-            exc = req->ctx->exception;
-            rv = req->ctx->rv;
-            cb_context_free(req->ctx);
-            if (exc != Qnil) {
-                rb_exc_raise(exc);
-            }
-            return rv;
-        }
-    } else {
-        cb_http_request_perform(self);
+    if (req->ctx) {
+        /* performed, but the context isn't released yet */
+        return cb_http_request_wait(req);
+    } else if (!req->completed) {
+        return cb_http_request_perform(self);
     }
     return Qnil;
 }
@@ -413,6 +471,10 @@ cb_http_request_extended_get(VALUE self)
  * @option options [Boolean] :extended (false) set it to +true+ if the
  *   {Couchbase::Result} object needed. The response chunk will be
  *   accessible through +#value+ attribute.
+ * @option options [Fixnum] :timeout the deadline of synchronous request
+ *   in microseconds. When it is reached, the request is cancelled and
+ *   {Couchbase::Error::Timeout} raised. Not supported in asynchronous
+ *   mode, where {#perform} raises +ArgumentError+ (since 1.3.8)
  * @yieldparam [String,Couchbase::Result] res the response chunk if the
  *   :extended option is +false+ and result object otherwise
  *
@@ -0,0 +1,764 @@
+/* vim: ft=c et ts=8 sts=4 sw=4 cino=
+ *
+ *   Copyright 2014 Couchbase, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Embedded JSON codec used by Couchbase::Transcoder::Document. It
+ * covers the types which could be produced by JSON parser (Hash, Array,
+ * String, Integer, Float, true, false, nil) plus Symbols. Other objects
+ * are serialized using their #to_json (or #to_s) methods. */
+
+#include "couchbase_ext.h"
+#include <math.h>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define CB_JSON_SSE2 1
+#endif
+
+#define CB_JSON_MAX_DEPTH 512
+
+int cb_json_native = 1;
+
+/* Scanners */
+
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGH 0x8080808080808080ULL
+#define SWAR_HAS_ZERO(x) (((x) - SWAR_ONES) & ~(x) & SWAR_HIGH)
+#define SWAR_HAS_LESS(x, n) (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGH)
+
+/* Returns pointer to the first byte in the range which cannot be copied
+ * to/from JSON string literally, i.e. '"', '\\' or control character. */
+    static inline const char *
+json_scan_string(const char *p, const char *end)
+{
+#ifdef CB_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1f);
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i mm = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                _mm_cmpeq_epi8(chunk, bslash));
+        /* unsigned (chunk <= 0x1f) */
+        mm = _mm_or_si128(mm, _mm_cmpeq_epi8(_mm_min_epu8(chunk, ctrl), chunk));
+        int mask = _mm_movemask_epi8(mm);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#else
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        if (SWAR_HAS_ZERO(word ^ (SWAR_ONES * '"'))
+                || SWAR_HAS_ZERO(word ^ (SWAR_ONES * '\\'))
+                || SWAR_HAS_LESS(word, 0x20)) {
+            break;
+        }
+        p += 8;
+    }
+#endif
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\' || c < 0x20) {
+            break;
+        }
+        p++;
+    }
+    return p;
+}
+
+#define JSON_IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+    static inline const char *
+json_skip_space(const char *p, const char *end)
+{
+    if (p < end && !JSON_IS_SPACE(*p)) {
+        return p;
+    }
+#ifdef CB_JSON_SSE2
+    {
+        const __m128i sp = _mm_set1_epi8(' ');
+        const __m128i nl = _mm_set1_epi8('\n');
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i tab = _mm_set1_epi8('\t');
+
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            __m128i mm = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, sp), _mm_cmpeq_epi8(chunk, nl)),
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, tab)));
+            int mask = ~_mm_movemask_epi8(mm) & 0xffff;
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+    }
+#endif
+    while (p < end && JSON_IS_SPACE(*p)) {
+        p++;
+    }
+    return p;
+}
+
+/* Encoder */
+
+struct json_writer_st
+{
+    VALUE buf;
+    int depth;
+};
+
+static void json_write_value(struct json_writer_st *w, VALUE obj);
+
+    static void
+json_write_string(struct json_writer_st *w, VALUE str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *p, *end, *run;
+
+#ifdef HAVE_RUBY_ENCODING_H
+    {
+        int idx = ENCODING_GET(str);
+        if (idx != rb_utf8_encindex() && idx != rb_usascii_encindex()
+                && idx != rb_ascii8bit_encindex()) {
+            str = rb_str_export_to_enc(str, rb_utf8_encoding());
+        }
+    }
+#endif
+    p = RSTRING_PTR(str);
+    end = p + RSTRING_LEN(str);
+    rb_str_buf_cat(w->buf, "\"", 1);
+    while (p < end) {
+        run = json_scan_string(p, end);
+        if (run > p) {
+            rb_str_buf_cat(w->buf, p, run - p);
+            p = run;
+        }
+        if (p == end) {
+            break;
+        }
+        switch (*p) {
+            case '"':
+                rb_str_buf_cat(w->buf, "\\\"", 2);
+                break;
+            case '\\':
+                rb_str_buf_cat(w->buf, "\\\\", 2);
+                break;
+            case '\n':
+                rb_str_buf_cat(w->buf, "\\n", 2);
+                break;
+            case '\r':
+                rb_str_buf_cat(w->buf, "\\r", 2);
+                break;
+            case '\t':
+                rb_str_buf_cat(w->buf, "\\t", 2);
+                break;
+            case '\b':
+                rb_str_buf_cat(w->buf, "\\b", 2);
+                break;
+            case '\f':
+                rb_str_buf_cat(w->buf, "\\f", 2);
+                break;
+            default:
+                {
+                    char esc[6] = {'\\', 'u', '0', '0', 0, 0};
+                    esc[4] = hex[((unsigned char)*p >> 4) & 0xf];
+                    esc[5] = hex[(unsigned char)*p & 0xf];
+                    rb_str_buf_cat(w->buf, esc, 6);
+                }
+        }
+        p++;
+    }
+    rb_str_buf_cat(w->buf, "\"", 1);
+}
+
+struct json_pair_arg_st
+{
+    struct json_writer_st *w;
+    int first;
+};
+
+    static int
+json_write_pair_i(VALUE key, VALUE value, VALUE arg)
+{
+    struct json_pair_arg_st *a = (struct json_pair_arg_st *)arg;
+
+    if (a->first) {
+        a->first = 0;
+    } else {
+        rb_str_buf_cat(a->w->buf, ",", 1);
+    }
+    switch (TYPE(key)) {
+        case T_STRING:
+            break;
+        case T_SYMBOL:
+            key = STR_NEW_CSTR(rb_id2name(SYM2ID(key)));
+            break;
+        default:
+            key = rb_obj_as_string(key);
+    }
+    json_write_string(a->w, key);
+    rb_str_buf_cat(a->w->buf, ":", 1);
+    json_write_value(a->w, value);
+    return ST_CONTINUE;
+}
+
+    static void
+json_write_value(struct json_writer_st *w, VALUE obj)
+{
+    char buf[32];
+    int len;
+
+    switch (TYPE(obj)) {
+        case T_NIL:
+            rb_str_buf_cat(w->buf, "null", 4);
+            break;
+        case T_TRUE:
+            rb_str_buf_cat(w->buf, "true", 4);
+            break;
+        case T_FALSE:
+            rb_str_buf_cat(w->buf, "false", 5);
+            break;
+        case T_FIXNUM:
+            len = snprintf(buf, sizeof(buf), "%ld", FIX2LONG(obj));
+            rb_str_buf_cat(w->buf, buf, len);
+            break;
+        case T_BIGNUM:
+            rb_str_buf_append(w->buf, rb_big2str(obj, 10));
+            break;
+        case T_FLOAT:
+            {
+                double dd = RFLOAT_VALUE(obj);
+                if (isnan(dd) || isinf(dd)) {
+                    rb_raise(rb_eArgError, "%s is not allowed in JSON",
+                            RSTRING_PTR(rb_obj_as_string(obj)));
+                }
+                rb_str_buf_append(w->buf, rb_obj_as_string(obj));
+            }
+            break;
+        case T_STRING:
+            json_write_string(w, obj);
+            break;
+        case T_SYMBOL:
+            json_write_string(w, STR_NEW_CSTR(rb_id2name(SYM2ID(obj))));
+            break;
+        case T_ARRAY:
+            {
+                long ii;
+                if (++w->depth > CB_JSON_MAX_DEPTH) {
+                    rb_raise(rb_eArgError, "nesting of %d is too deep", w->depth);
+                }
+                rb_str_buf_cat(w->buf, "[", 1);
+                for (ii = 0; ii < RARRAY_LEN(obj); ++ii) {
+                    if (ii > 0) {
+                        rb_str_buf_cat(w->buf, ",", 1);
+                    }
+                    json_write_value(w, RARRAY_PTR(obj)[ii]);
+                }
+                rb_str_buf_cat(w->buf, "]", 1);
+                w->depth--;
+            }
+            break;
+        case T_HASH:
+            {
+                struct json_pair_arg_st arg;
+                if (++w->depth > CB_JSON_MAX_DEPTH) {
+                    rb_raise(rb_eArgError, "nesting of %d is too deep", w->depth);
+                }
+                arg.w = w;
+                arg.first = 1;
+                rb_str_buf_cat(w->buf, "{", 1);
+                rb_hash_foreach(obj, json_write_pair_i, (VALUE)&arg);
+                rb_str_buf_cat(w->buf, "}", 1);
+                w->depth--;
+            }
+            break;
+        default:
+            if (rb_respond_to(obj, cb_id_to_json)) {
+                VALUE str = rb_funcall(obj, cb_id_to_json, 0);
+                rb_str_buf_append(w->buf, StringValue(str));
+            } else if (rb_respond_to(obj, cb_id_to_s)) {
+                json_write_string(w, rb_obj_as_string(obj));
+            } else {
+                rb_raise(rb_eTypeError, "unable to convert %s to JSON",
+                        rb_obj_classname(obj));
+            }
+    }
+}
+
+/* Encode object to JSON string. Raises ArgumentError or TypeError if
+ * the object cannot be represented in JSON. */
+    VALUE
+cb_json_dump(VALUE obj)
+{
+    struct json_writer_st w;
+
+    w.buf = rb_str_buf_new(128);
+    w.depth = 0;
+    json_write_value(&w, obj);
+#ifdef HAVE_RUBY_ENCODING_H
+    rb_enc_associate(w.buf, rb_utf8_encoding());
+#endif
+    return w.buf;
+}
+
+/* Decoder */
+
+struct json_parser_st
+{
+    const char *beg;
+    const char *p;
+    const char *end;
+    int depth;
+    VALUE eclass;
+};
+
+static VALUE json_parse_value(struct json_parser_st *j);
+
+    static void
+json_parse_error(struct json_parser_st *j, const char *what)
+{
+    long off = (long)(j->p - j->beg);
+    long len = (long)(j->end - j->p);
+
+    if (len > 20) {
+        len = 20;
+    }
+    if (j->p >= j->end) {
+        rb_raise(j->eclass, "%s: unexpected end of input (offset %ld)", what, off);
+    }
+    rb_raise(j->eclass, "%s: unexpected token at '%.*s' (offset %ld)",
+            what, (int)len, j->p, off);
+}
+
+    static VALUE
+json_str_new(const char *ptr, long len)
+{
+#ifdef HAVE_RUBY_ENCODING_H
+    return rb_enc_str_new(ptr, len, rb_utf8_encoding());
+#else
+    return rb_str_new(ptr, len);
+#endif
+}
+
+    static int
+json_hex4(struct json_parser_st *j, const char *p)
+{
+    int ii, cp = 0;
+
+    if (j->end - p < 4) {
+        json_parse_error(j, "incomplete unicode escape");
+    }
+    for (ii = 0; ii < 4; ++ii) {
+        char c = p[ii];
+        cp <<= 4;
+        if (c >= '0' && c <= '9') {
+            cp |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            cp |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            cp |= c - 'A' + 10;
+        } else {
+            json_parse_error(j, "invalid unicode escape");
+        }
+    }
+    return cp;
+}
+
+    static int
+json_utf8_encode(char *out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    } else {
+        out[0] = (char)(0xf0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[3] = (char)(0x80 | (cp & 0x3f));
+        return 4;
+    }
+}
+
+/* j->p points right after opening quote */
+    static VALUE
+json_parse_string(struct json_parser_st *j)
+{
+    const char *p = j->p, *run;
+    VALUE str = Qnil;
+
+    for (;;) {
+        run = json_scan_string(p, j->end);
+        if (run == j->end) {
+            j->p = run;
+            json_parse_error(j, "unterminated string");
+        }
+        if (*run == '"') {
+            if (NIL_P(str)) {
+                /* fast path: no escapes */
+                str = json_str_new(j->p, run - j->p);
+            } else {
+                rb_str_buf_cat(str, p, run - p);
+            }
+            j->p = run + 1;
+            return str;
+        }
+        if (*run != '\\') {
+            j->p = run;
+            json_parse_error(j, "control character in string");
+        }
+        if (NIL_P(str)) {
+            str = json_str_new(NULL, 0);
+        }
+        rb_str_buf_cat(str, p, run - p);
+        p = run + 1;
+        if (p == j->end) {
+            j->p = p;
+            json_parse_error(j, "unterminated string");
+        }
+        switch (*p) {
+            case '"':
+            case '\\':
+            case '/':
+                rb_str_buf_cat(str, p, 1);
+                p++;
+                break;
+            case 'b':
+                rb_str_buf_cat(str, "\b", 1);
+                p++;
+                break;
+            case 'f':
+                rb_str_buf_cat(str, "\f", 1);
+                p++;
+                break;
+            case 'n':
+                rb_str_buf_cat(str, "\n", 1);
+                p++;
+                break;
+            case 'r':
+                rb_str_buf_cat(str, "\r", 1);
+                p++;
+                break;
+            case 't':
+                rb_str_buf_cat(str, "\t", 1);
+                p++;
+                break;
+            case 'u':
+                {
+                    char out[4];
+                    unsigned long cp = json_hex4(j, p + 1);
+                    p += 5;
+                    if (cp >= 0xd800 && cp <= 0xdbff) {
+                        /* surrogate pair */
+                        if (j->end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                            unsigned long lo = json_hex4(j, p + 2);
+                            if (lo >= 0xdc00 && lo <= 0xdfff) {
+                                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                                p += 6;
+                            }
+                        }
+                    }
+                    rb_str_buf_cat(str, out, json_utf8_encode(out, cp));
+                }
+                break;
+            default:
+                j->p = p;
+                json_parse_error(j, "invalid escape");
+        }
+    }
+}
+
+    static VALUE
+json_parse_number(struct json_parser_st *j)
+{
+    const char *p = j->p, *start = j->p;
+    int is_float = 0;
+
+    if (p < j->end && *p == '-') {
+        p++;
+    }
+    if (p == j->end || *p < '0' || *p > '9') {
+        json_parse_error(j, "invalid number");
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < j->end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (p < j->end && *p == '.') {
+        is_float = 1;
+        p++;
+        if (p == j->end || *p < '0' || *p > '9') {
+            j->p = p;
+            json_parse_error(j, "invalid number");
+        }
+        while (p < j->end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (p < j->end && (*p == 'e' || *p == 'E')) {
+        is_float = 1;
+        p++;
+        if (p < j->end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p == j->end || *p < '0' || *p > '9') {
+            j->p = p;
+            json_parse_error(j, "invalid number");
+        }
+        while (p < j->end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    j->p = p;
+    if (!is_float && p - start < 19) {
+        const char *q = start;
+        LONG_LONG val = 0;
+        int neg = 0;
+        if (*q == '-') {
+            neg = 1;
+            q++;
+        }
+        while (q < p) {
+            val = val * 10 + (*q++ - '0');
+        }
+        return LL2NUM(neg ? -val : val);
+    } else {
+        char sbuf[64];
+        VALUE tmp = Qnil;
+        char *buf = sbuf;
+        long len = p - start;
+        if (len >= (long)sizeof(sbuf)) {
+            tmp = rb_str_new(start, len);
+            buf = StringValueCStr(tmp);
+        } else {
+            memcpy(sbuf, start, len);
+            sbuf[len] = '\0';
+        }
+        if (is_float) {
+            return rb_float_new(rb_cstr_to_dbl(buf, 1));
+        } else {
+            return rb_cstr2inum(buf, 10);
+        }
+    }
+}
+
+    static VALUE
+json_parse_array(struct json_parser_st *j)
+{
+    VALUE ary = rb_ary_new();
+
+    j->p = json_skip_space(j->p, j->end);
+    if (j->p < j->end && *j->p == ']') {
+        j->p++;
+        return ary;
+    }
+    for (;;) {
+        rb_ary_push(ary, json_parse_value(j));
+        j->p = json_skip_space(j->p, j->end);
+        if (j->p < j->end && *j->p == ',') {
+            j->p++;
+        } else if (j->p < j->end && *j->p == ']') {
+            j->p++;
+            return ary;
+        } else {
+            json_parse_error(j, "expected ',' or ']'");
+        }
+    }
+}
+
+    static VALUE
+json_parse_object(struct json_parser_st *j)
+{
+    VALUE hash = rb_hash_new(), key;
+
+    j->p = json_skip_space(j->p, j->end);
+    if (j->p < j->end && *j->p == '}') {
+        j->p++;
+        return hash;
+    }
+    for (;;) {
+        j->p = json_skip_space(j->p, j->end);
+        if (j->p == j->end || *j->p != '"') {
+            json_parse_error(j, "expected object key");
+        }
+        j->p++;
+        key = json_parse_string(j);
+        j->p = json_skip_space(j->p, j->end);
+        if (j->p == j->end || *j->p != ':') {
+            json_parse_error(j, "expected ':'");
+        }
+        j->p++;
+        rb_hash_aset(hash, key, json_parse_value(j));
+        j->p = json_skip_space(j->p, j->end);
+        if (j->p < j->end && *j->p == ',') {
+            j->p++;
+        } else if (j->p < j->end && *j->p == '}') {
+            j->p++;
+            return hash;
+        } else {
+            json_parse_error(j, "expected ',' or '}'");
+        }
+    }
+}
+
+#define JSON_LITERAL(j, lit) \
+    ((j)->end - (j)->p >= (long)(sizeof(lit) - 1) && memcmp((j)->p, lit, sizeof(lit) - 1) == 0)
+
+    static VALUE
+json_parse_value(struct json_parser_st *j)
+{
+    VALUE val;
+
+    j->p = json_skip_space(j->p, j->end);
+    if (j->p == j->end) {
+        json_parse_error(j, "expected value");
+    }
+    switch (*j->p) {
+        case '{':
+            if (++j->depth > CB_JSON_MAX_DEPTH) {
+                json_parse_error(j, "nesting is too deep");
+            }
+            j->p++;
+            val = json_parse_object(j);
+            j->depth--;
+            return val;
+        case '[':
+            if (++j->depth > CB_JSON_MAX_DEPTH) {
+                json_parse_error(j, "nesting is too deep");
+            }
+            j->p++;
+            val = json_parse_array(j);
+            j->depth--;
+            return val;
+        case '"':
+            j->p++;
+            return json_parse_string(j);
+        case 't':
+            if (JSON_LITERAL(j, "true")) {
+                j->p += 4;
+                return Qtrue;
+            }
+            break;
+        case 'f':
+            if (JSON_LITERAL(j, "false")) {
+                j->p += 5;
+                return Qfalse;
+            }
+            break;
+        case 'n':
+            if (JSON_LITERAL(j, "null")) {
+                j->p += 4;
+                return Qnil;
+            }
+            break;
+        default:
+            if (*j->p == '-' || (*j->p >= '0' && *j->p <= '9')) {
+                return json_parse_number(j);
+            }
+    }
+    json_parse_error(j, "unexpected character");
+    return Qnil; /* not reached */
+}
+
+/* Decode JSON string. Like MultiJson.load, returns nil for blank input
+ * and accepts primitives (numbers, strings, booleans) at top level.
+ * Raises ArgumentError on malformed input. */
+    VALUE
+cb_json_load(VALUE blob)
+{
+    struct json_parser_st j;
+    VALUE val;
+
+    StringValue(blob);
+    j.beg = j.p = RSTRING_PTR(blob);
+    j.end = j.beg + RSTRING_LEN(blob);
+    j.depth = 0;
+    j.eclass = rb_eArgError;
+    j.p = json_skip_space(j.p, j.end);
+    if (j.p == j.end) {
+        return Qnil;
+    }
+    val = json_parse_value(&j);
+    j.p = json_skip_space(j.p, j.end);
+    if (j.p != j.end) {
+        json_parse_error(&j, "trailing data");
+    }
+    RB_GC_GUARD(blob);
+    return val;
+}
+
+/* Decode single JSON value starting at *ptr and move *ptr right after
+ * it. The view parser uses it for the rows cut out of its buffer.
+ * Raises eclass on malformed input. */
+    VALUE
+cb_json_parse(const char **ptr, const char *end, VALUE eclass)
+{
+    struct json_parser_st j;
+    VALUE val;
+
+    j.beg = j.p = *ptr;
+    j.end = end;
+    j.depth = 0;
+    j.eclass = eclass;
+    val = json_parse_value(&j);
+    *ptr = j.p;
+    return val;
+}
+
+    VALUE
+cb_json_s_dump(VALUE klass, VALUE obj)
+{
+    (void)klass;
+    return cb_json_dump(obj);
+}
+
+    VALUE
+cb_json_s_load(VALUE klass, VALUE blob)
+{
+    (void)klass;
+    return cb_json_load(blob);
+}
+
+    VALUE
+cb_document_native_get(VALUE klass)
+{
+    (void)klass;
+    return cb_json_native ? Qtrue : Qfalse;
+}
+
+    VALUE
+cb_document_native_set(VALUE klass, VALUE val)
+{
+    (void)klass;
+    cb_json_native = RTEST(val);
+    return val;
+}
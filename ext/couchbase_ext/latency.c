@@ -0,0 +1,503 @@
+/* vim: ft=c et ts=8 sts=4 sw=4 cino=
+ *
+ *   Copyright 2011, 2012 Couchbase, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "couchbase_ext.h"
+
+/*
+ * Log-linear (HDR-style) histograms. The values below 2^SUB_BITS are
+ * counted exactly, each next power of two range is split into
+ * SUB_COUNT equal buckets, so that the relative error stays below
+ * 1/SUB_COUNT (~6%) for any magnitude.
+ *
+ * The bucket is owned by one thread (all callbacks are executed under
+ * GVL from the thread running the event loop), so the counters are
+ * updated without locks.
+ */
+#define CB_HISTOGRAM_SUB_BITS 4
+#define CB_HISTOGRAM_SUB_COUNT (1 << CB_HISTOGRAM_SUB_BITS)
+#define CB_HISTOGRAM_MAX_EXP 47     /* ~78 hours in nanoseconds */
+#define CB_HISTOGRAM_MAX_VALUE ((((uint64_t)1) << (CB_HISTOGRAM_MAX_EXP + 1)) - 1)
+#define CB_HISTOGRAM_SIZE ((CB_HISTOGRAM_MAX_EXP - CB_HISTOGRAM_SUB_BITS + 2) * CB_HISTOGRAM_SUB_COUNT)
+
+struct cb_histogram_st
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[CB_HISTOGRAM_SIZE];
+};
+
+struct cb_latency_node_st
+{
+    struct cb_latency_node_st *next;
+    char *endpoint;     /* "host:port" of the node or NULL if unknown */
+    struct cb_histogram_st *latency[CB_LATENCY_NOPS];
+    struct cb_histogram_st *size[CB_LATENCY_NOPS];
+};
+
+    static size_t
+histogram_index(uint64_t value)
+{
+    int exp = CB_HISTOGRAM_SUB_BITS;
+
+    if (value < CB_HISTOGRAM_SUB_COUNT) {
+        return (size_t)value;
+    }
+    if (value > CB_HISTOGRAM_MAX_VALUE) {
+        value = CB_HISTOGRAM_MAX_VALUE;
+    }
+    while (value >> (exp + 1)) {
+        exp++;
+    }
+    return (size_t)(exp - CB_HISTOGRAM_SUB_BITS + 1) * CB_HISTOGRAM_SUB_COUNT +
+        (size_t)((value >> (exp - CB_HISTOGRAM_SUB_BITS)) & (CB_HISTOGRAM_SUB_COUNT - 1));
+}
+
+/* the highest value counted by the bucket */
+    static uint64_t
+histogram_value(size_t idx)
+{
+    int exp;
+    uint64_t sub;
+
+    if (idx < CB_HISTOGRAM_SUB_COUNT) {
+        return (uint64_t)idx;
+    }
+    exp = (int)(idx / CB_HISTOGRAM_SUB_COUNT) + CB_HISTOGRAM_SUB_BITS - 1;
+    sub = idx % CB_HISTOGRAM_SUB_COUNT;
+    return ((CB_HISTOGRAM_SUB_COUNT + sub + 1) << (exp - CB_HISTOGRAM_SUB_BITS)) - 1;
+}
+
+    static void
+histogram_record(struct cb_histogram_st **hh, uint64_t value)
+{
+    struct cb_histogram_st *h = *hh;
+
+    if (h == NULL) {
+        h = *hh = calloc(1, sizeof(struct cb_histogram_st));
+        if (h == NULL) {
+            return;
+        }
+    }
+    if (h->count == 0 || value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->count++;
+    h->sum += value;
+    h->counts[histogram_index(value)]++;
+}
+
+    static uint64_t
+histogram_percentile(struct cb_histogram_st *h, double percentile)
+{
+    uint64_t target, seen = 0;
+    size_t ii;
+
+    target = (uint64_t)(percentile / 100.0 * (double)h->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    for (ii = 0; ii < CB_HISTOGRAM_SIZE; ++ii) {
+        seen += h->counts[ii];
+        if (seen >= target) {
+            uint64_t val = histogram_value(ii);
+            return val < h->max ? val : h->max;
+        }
+    }
+    return h->max;
+}
+
+    static void
+histogram_merge(struct cb_histogram_st **hh, const struct cb_histogram_st *src)
+{
+    struct cb_histogram_st *h = *hh;
+    size_t ii;
+
+    if (src == NULL || src->count == 0) {
+        return;
+    }
+    if (h == NULL) {
+        h = *hh = calloc(1, sizeof(struct cb_histogram_st));
+        if (h == NULL) {
+            return;
+        }
+    }
+    if (h->count == 0 || src->min < h->min) {
+        h->min = src->min;
+    }
+    if (src->max > h->max) {
+        h->max = src->max;
+    }
+    h->count += src->count;
+    h->sum += src->sum;
+    for (ii = 0; ii < CB_HISTOGRAM_SIZE; ++ii) {
+        h->counts[ii] += src->counts[ii];
+    }
+}
+
+/* find or create the node by endpoint */
+    static struct cb_latency_node_st *
+latency_node_lookup(struct cb_bucket_st *bucket, const char *endpoint)
+{
+    struct cb_latency_node_st *node;
+
+    for (node = bucket->latency_nodes; node != NULL; node = node->next) {
+        if (endpoint == NULL ? node->endpoint == NULL :
+                (node->endpoint != NULL && strcmp(node->endpoint, endpoint) == 0)) {
+            return node;
+        }
+    }
+    node = calloc(1, sizeof(struct cb_latency_node_st));
+    if (node == NULL) {
+        return NULL;
+    }
+    if (endpoint) {
+        size_t len = strlen(endpoint);
+        node->endpoint = malloc(len + 1);
+        if (node->endpoint == NULL) {
+            free(node);
+            return NULL;
+        }
+        memcpy(node->endpoint, endpoint, len + 1);
+    }
+    node->next = bucket->latency_nodes;
+    bucket->latency_nodes = node;
+    return node;
+}
+
+/*
+ * Find the node serving the key using current vbucket map. The requests
+ * without key (or when the map isn't available, like for memcached
+ * buckets) are counted in the node with NULL endpoint. The nodes are
+ * cached by server index until the configuration changes, so that
+ * usually it costs one vbucket map lookup.
+ */
+    static struct cb_latency_node_st *
+latency_node(struct cb_bucket_st *bucket, const void *key, size_t nkey)
+{
+    struct cb_latency_node_st *node;
+    lcb_cntl_vbinfo_t vbi;
+    lcb_cntl_server_t srv;
+    char buf[300];
+    size_t idx;
+
+    if (key == NULL || bucket->handle == NULL) {
+        return latency_node_lookup(bucket, NULL);
+    }
+    memset(&vbi, 0, sizeof(vbi));
+    vbi.v.v0.key = key;
+    vbi.v.v0.nkey = nkey;
+    if (lcb_cntl(bucket->handle, LCB_CNTL_GET, LCB_CNTL_VBMAP, &vbi) != LCB_SUCCESS ||
+            vbi.v.v0.server_index < 0) {
+        return latency_node_lookup(bucket, NULL);
+    }
+    idx = (size_t)vbi.v.v0.server_index;
+    if (idx < bucket->latency_index_size && bucket->latency_index[idx]) {
+        return bucket->latency_index[idx];
+    }
+
+    memset(&srv, 0, sizeof(srv));
+    srv.v.v0.index = vbi.v.v0.server_index;
+    if (lcb_cntl(bucket->handle, LCB_CNTL_GET, LCB_CNTL_MEMDNODE_INFO, &srv) != LCB_SUCCESS ||
+            srv.v.v0.host == NULL) {
+        return latency_node_lookup(bucket, NULL);
+    }
+    snprintf(buf, sizeof(buf), "%s:%s", srv.v.v0.host, srv.v.v0.port ? srv.v.v0.port : "");
+    node = latency_node_lookup(bucket, buf);
+    if (node == NULL) {
+        return NULL;
+    }
+    if (idx >= bucket->latency_index_size) {
+        size_t size = idx + 1;
+        struct cb_latency_node_st **index;
+
+        index = realloc(bucket->latency_index, size * sizeof(struct cb_latency_node_st *));
+        if (index == NULL) {
+            return node;
+        }
+        memset(index + bucket->latency_index_size, 0,
+                (size - bucket->latency_index_size) * sizeof(struct cb_latency_node_st *));
+        bucket->latency_index = index;
+        bucket->latency_index_size = size;
+    }
+    bucket->latency_index[idx] = node;
+    return node;
+}
+
+/*
+ * Forget the server indexes, they might refer to other nodes in the new
+ * configuration.
+ */
+    void
+cb_latency_config_changed(struct cb_bucket_st *bucket)
+{
+    free(bucket->latency_index);
+    bucket->latency_index = NULL;
+    bucket->latency_index_size = 0;
+}
+
+/*
+ * Record the time since the context was allocated (that is the request
+ * was scheduled) for the response on the key, and the size of the
+ * payload unless it is CB_LATENCY_NO_SIZE.
+ */
+    void
+cb_latency_record(struct cb_context_st *ctx, enum cb_latency_op_t op,
+        const void *key, size_t nkey, size_t nbytes)
+{
+    static const char * const names[CB_LATENCY_NOPS] = {
+        "get", "set", "delete", "arith", "observe", "http"
+    };
+    struct cb_bucket_st *bucket = ctx->bucket;
+    struct cb_latency_node_st *node;
+    hrtime_t elapsed = gethrtime() - ctx->start;
+
+    CB_PROBE5(response, names[op], key, nkey,
+            nbytes == CB_LATENCY_NO_SIZE ? 0 : nbytes, elapsed);
+    if (!bucket->collect_latency) {
+        return;
+    }
+    node = latency_node(bucket, key, nkey);
+    if (node == NULL) {
+        return;
+    }
+    histogram_record(&node->latency[op], elapsed);
+    if (nbytes != CB_LATENCY_NO_SIZE) {
+        histogram_record(&node->size[op], nbytes);
+    }
+}
+
+/*
+ * Record the size of the payload only. It is used for the operations,
+ * which know the size of the request at the schedule time only (like
+ * store operations).
+ */
+    void
+cb_latency_record_size(struct cb_bucket_st *bucket, enum cb_latency_op_t op,
+        const void *key, size_t nkey, size_t nbytes)
+{
+    struct cb_latency_node_st *node;
+
+    if (!bucket->collect_latency) {
+        return;
+    }
+    node = latency_node(bucket, key, nkey);
+    if (node != NULL) {
+        histogram_record(&node->size[op], nbytes);
+    }
+}
+
+    void
+cb_latency_free(struct cb_bucket_st *bucket)
+{
+    struct cb_latency_node_st *node, *next;
+    int ii;
+
+    for (node = bucket->latency_nodes; node != NULL; node = next) {
+        next = node->next;
+        for (ii = 0; ii < CB_LATENCY_NOPS; ++ii) {
+            free(node->latency[ii]);
+            free(node->size[ii]);
+        }
+        free(node->endpoint);
+        free(node);
+    }
+    bucket->latency_nodes = NULL;
+    cb_latency_config_changed(bucket);
+}
+
+    static VALUE
+latency_op_sym(int op)
+{
+    switch (op) {
+        case cb_latency_get:
+            return cb_sym_get;
+        case cb_latency_set:
+            return cb_sym_set;
+        case cb_latency_delete:
+            return cb_sym_delete;
+        case cb_latency_arith:
+            return cb_sym_arith;
+        case cb_latency_observe:
+            return cb_sym_observe;
+        case cb_latency_http:
+            return cb_sym_http;
+        default:
+            return Qnil;
+    }
+}
+
+/* convert the value to microseconds for latencies, keep the bytes as is */
+#define CB_LATENCY_VALUE(val, usec) ((usec) ? DBL2NUM((double)(val) / 1000.0) : ULL2NUM(val))
+
+    static VALUE
+histogram_to_hash(struct cb_histogram_st *h, VALUE percentiles, int usec)
+{
+    VALUE rv = rb_hash_new(), pp = rb_hash_new();
+    long ii;
+
+    rb_hash_aset(rv, cb_sym_count, ULL2NUM(h->count));
+    rb_hash_aset(rv, cb_sym_min, CB_LATENCY_VALUE(h->min, usec));
+    rb_hash_aset(rv, cb_sym_max, CB_LATENCY_VALUE(h->max, usec));
+    rb_hash_aset(rv, cb_sym_mean, DBL2NUM((double)h->sum / (double)h->count / (usec ? 1000.0 : 1.0)));
+    for (ii = 0; ii < RARRAY_LEN(percentiles); ++ii) {
+        VALUE p = RARRAY_PTR(percentiles)[ii];
+        uint64_t val = histogram_percentile(h, NUM2DBL(p));
+        rb_hash_aset(pp, p, CB_LATENCY_VALUE(val, usec));
+    }
+    rb_hash_aset(rv, cb_sym_percentiles, pp);
+    return rv;
+}
+
+#undef CB_LATENCY_VALUE
+
+/* operation => stats for all histograms of the node */
+    static VALUE
+latency_node_to_hash(struct cb_latency_node_st *node, VALUE percentiles)
+{
+    VALUE ops = rb_hash_new();
+    int ii;
+
+    for (ii = 0; ii < CB_LATENCY_NOPS; ++ii) {
+        VALUE stats = Qnil;
+        if (node->latency[ii] && node->latency[ii]->count) {
+            stats = histogram_to_hash(node->latency[ii], percentiles, 1);
+        }
+        if (node->size[ii] && node->size[ii]->count) {
+            if (NIL_P(stats)) {
+                stats = rb_hash_new();
+            }
+            rb_hash_aset(stats, cb_sym_size, histogram_to_hash(node->size[ii], percentiles, 0));
+        }
+        if (!NIL_P(stats)) {
+            rb_hash_aset(ops, latency_op_sym(ii), stats);
+        }
+    }
+    return ops;
+}
+
+/*
+ * Returns latency statistics collected by the client
+ *
+ * @since 1.3.8
+ *
+ * The time between scheduling and the response is recorded for each
+ * key of +get+, +set+ (and other storage operations), +delete+,
+ * +incr+/+decr+ (as +:arith+), +observe+ (responses of the master node)
+ * and HTTP requests (as +:http+). The sizes of the values are recorded
+ * too. The statistics are grouped by the endpoint of the node, which
+ * serves the key according to the current cluster map, the requests
+ * without key are grouped under +nil+ endpoint.
+ *
+ * The percentiles are calculated from histograms with relative
+ * precision about 6%. The recording can be turned off with
+ * {Bucket#collect_latency}.
+ *
+ * @param [Hash] options
+ * @option options [Array<Numeric>] :percentiles ([50, 90, 99, 99.9])
+ *   the percentiles to calculate
+ * @option options [true, false] :reset (false) clear the statistics
+ *   after reading
+ * @option options [true, false] :merge (false) combine the histograms
+ *   of all nodes and return operation => stats
+ *
+ * @example Display 99th percentile of the get latency for each node
+ *   c.latency_stats.each do |node, ops|
+ *     puts "#{node}: #{ops[:get][:percentiles][99]}us" if ops[:get]
+ *   end
+ *
+ * @return [Hash] endpoint => {operation => stats}, where stats is Hash
+ *   with keys +:count+, +:min+, +:max+, +:mean+ and +:percentiles+
+ *   (percentile => value) in microseconds, and +:size+ with the same
+ *   keys for the payload sizes in bytes. With +:merge+ option the
+ *   endpoint level is omitted
+ *
+ * @see Bucket#reset_latency_stats
+ */
+    VALUE
+cb_bucket_latency_stats(int argc, VALUE *argv, VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    struct cb_latency_node_st *node;
+    VALUE rv, opts, percentiles = Qnil;
+    int reset = 0, merge = 0, ii;
+
+    rb_scan_args(argc, argv, "01", &opts);
+    if (!NIL_P(opts)) {
+        Check_Type(opts, T_HASH);
+        percentiles = rb_hash_aref(opts, cb_sym_percentiles);
+        if (!NIL_P(percentiles)) {
+            Check_Type(percentiles, T_ARRAY);
+            /* raise now, before the merged histograms are allocated */
+            for (ii = 0; ii < RARRAY_LEN(percentiles); ++ii) {
+                (void)NUM2DBL(RARRAY_PTR(percentiles)[ii]);
+            }
+        }
+        reset = RTEST(rb_hash_aref(opts, cb_sym_reset));
+        merge = RTEST(rb_hash_aref(opts, cb_sym_merge));
+    }
+    if (NIL_P(percentiles)) {
+        percentiles = rb_ary_new3(4, INT2FIX(50), INT2FIX(90), INT2FIX(99), DBL2NUM(99.9));
+    }
+    if (merge) {
+        struct cb_latency_node_st all;
+
+        memset(&all, 0, sizeof(all));
+        for (node = bucket->latency_nodes; node != NULL; node = node->next) {
+            for (ii = 0; ii < CB_LATENCY_NOPS; ++ii) {
+                histogram_merge(&all.latency[ii], node->latency[ii]);
+                histogram_merge(&all.size[ii], node->size[ii]);
+            }
+        }
+        rv = latency_node_to_hash(&all, percentiles);
+        for (ii = 0; ii < CB_LATENCY_NOPS; ++ii) {
+            free(all.latency[ii]);
+            free(all.size[ii]);
+        }
+    } else {
+        rv = rb_hash_new();
+        for (node = bucket->latency_nodes; node != NULL; node = node->next) {
+            rb_hash_aset(rv, node->endpoint ? STR_NEW_CSTR(node->endpoint) : Qnil,
+                    latency_node_to_hash(node, percentiles));
+        }
+    }
+    if (reset) {
+        cb_latency_free(bucket);
+    }
+    return rv;
+}
+
+/*
+ * Clear latency statistics
+ *
+ * @since 1.3.8
+ *
+ * @see Bucket#latency_stats
+ *
+ * @return [nil]
+ */
+    VALUE
+cb_bucket_reset_latency_stats(VALUE self)
+{
+    struct cb_bucket_st *bucket = DATA_PTR(self);
+    cb_latency_free(bucket);
+    return Qnil;
+}
@@ -27,6 +27,21 @@
 #ifdef HAVE_POLL
 #include <poll.h>
 #endif
+#if defined(HAVE_LIBURING) && !defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL) && !defined(HAVE_RB_THREAD_BLOCKING_REGION)
+/* io_uring loop always waits with released GVL */
+#undef HAVE_LIBURING
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <poll.h>
+#endif
+#ifdef HAVE_EPOLL_CREATE
+#include <sys/epoll.h>
+#include <unistd.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#endif
 
 /* events sorted array */
 typedef struct rb_mt_event rb_mt_event;
@@ -45,6 +60,7 @@ typedef struct rb_mt_socket_list rb_mt_socket_list;
 struct rb_mt_socket_list {
     lcb_socket_t socket;
     short flags;
+    short epoll_flags;
     rb_mt_event *first;
 };
 
@@ -125,6 +141,7 @@ events_insert(rb_mt_events *events, rb_mt_event *event)
         events->count++;
         list->socket = event->socket;
         list->flags = event->flags;
+        list->epoll_flags = -1;
         list->first = event;
         event->next = NULL;
     } else {
@@ -202,10 +219,20 @@ events_max_fd(rb_mt_events *events)
 
 /* timers heap */
 typedef struct rb_mt_timer rb_mt_timer;
+typedef struct rb_mt_timer_link rb_mt_timer_link;
+struct rb_mt_timer_link {
+    rb_mt_timer_link *next;
+    rb_mt_timer_link *prev;
+};
+
 struct rb_mt_timer {
+    rb_mt_timer_link link; /* must be first, see wheel_timer() */
     void *cb_data;
     void (*handler)(lcb_socket_t sock, short which, void *cb_data);
     int index;
+    short in_wheel;
+    short wheel_level;
+    short wheel_slot;
     hrtime_t ts;
     hrtime_t period;
 };
@@ -372,22 +399,254 @@ timers_remove_timer(rb_mt_timers *timers, rb_mt_timer *timer)
     }
 }
 
+/* timers heap end */
+
+/* timers wheel
+ *
+ * Hashed hierarchical timing wheel with millisecond ticks: four levels
+ * of 64 slots cover about 4.6 hours, the timers which expire later are
+ * kept in the heap above. The level of the timer is the highest base-64
+ * digit where its expiration tick differs from the current tick, so
+ * that the slot is always reached within the current rotation of that
+ * level and then cascaded down. Insertion and removal are O(1), the
+ * slots occupancy bitmaps allow to skip empty ticks */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK ((uint64_t)WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_TICK ((hrtime_t)1000000) /* 1 millisecond */
+#define WHEEL_LOCAL (-1) /* timer is detached for running */
+
+typedef struct rb_mt_wheel rb_mt_wheel;
+struct rb_mt_wheel {
+    uint64_t now; /* last processed tick */
+    uint32_t count;
+    uint64_t occupied[WHEEL_LEVELS];
+    rb_mt_timer_link slots[WHEEL_LEVELS][WHEEL_SIZE];
+    /* the timers detached for running, they are kept here rather than
+     * on the stack, because the handlers might raise */
+    rb_mt_timer_link expired;
+};
+
+#define wheel_timer(_link) ((rb_mt_timer *)(_link))
+
+    static inline int
+wheel_ctz(uint64_t bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int n = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* occupied slots of the level after given digit */
+    static inline uint64_t
+wheel_bits_after(rb_mt_wheel *wheel, int level, uint64_t digit)
+{
+    return wheel->occupied[level] & ~((2ULL << digit) - 1);
+}
+
     static void
-timers_run(rb_mt_timers *timers, hrtime_t now)
+wheel_init(rb_mt_wheel *wheel, hrtime_t now)
 {
-    hrtime_t next_time = timers_minimum(timers);
-    while (next_time && next_time < now) {
-        rb_mt_timer *first = timers_first(timers);
+    int l, i;
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        for (i = 0; i < WHEEL_SIZE; i++) {
+            wheel->slots[l][i].next = wheel->slots[l][i].prev = &wheel->slots[l][i];
+        }
+        wheel->occupied[l] = 0;
+    }
+    wheel->expired.next = wheel->expired.prev = &wheel->expired;
+    wheel->now = now / WHEEL_TICK;
+    wheel->count = 0;
+}
 
-        first->ts = now + first->period;
-        timers_heapify_item(timers, 0);
+    static inline void
+wheel_link(rb_mt_timer_link *head, rb_mt_timer_link *link)
+{
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+    static inline void
+wheel_unlink(rb_mt_timer_link *link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = link->prev = link;
+}
 
-        first->handler(-1, 0, first->cb_data);
+/* returns zero if the timer is too far in the future for the wheel */
+    static int
+wheel_place(rb_mt_wheel *wheel, rb_mt_timer *timer, uint64_t tick)
+{
+    uint64_t diff = tick ^ wheel->now;
+    int level = 0;
+    uint64_t slot;
 
-        next_time = timers_minimum(timers);
+    while (level < WHEEL_LEVELS && (diff >> (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    if (level == WHEEL_LEVELS) {
+        return 0;
     }
+    slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    wheel_link(&wheel->slots[level][slot], &timer->link);
+    wheel->occupied[level] |= 1ULL << slot;
+    timer->in_wheel = 1;
+    timer->wheel_level = level;
+    timer->wheel_slot = (short)slot;
+    wheel->count++;
+    return 1;
 }
-/* timers heap end */
+
+    static inline uint64_t
+wheel_tick_of(rb_mt_timer *timer)
+{
+    return (timer->ts + WHEEL_TICK - 1) / WHEEL_TICK;
+}
+
+    static int
+wheel_insert(rb_mt_wheel *wheel, rb_mt_timer *timer)
+{
+    uint64_t tick = wheel_tick_of(timer);
+    /* the empty wheel isn't stepped, so its clock might lag after idle
+     * period, and the timer would be placed by stale digits */
+    if (wheel->count == 0) {
+        uint64_t now = gethrtime() / WHEEL_TICK;
+        if (now > wheel->now) {
+            wheel->now = now;
+        }
+    }
+    /* the slot of the current tick has been processed already */
+    if (tick <= wheel->now) {
+        tick = wheel->now + 1;
+    }
+    return wheel_place(wheel, timer, tick);
+}
+
+    static void
+wheel_remove(rb_mt_wheel *wheel, rb_mt_timer *timer)
+{
+    rb_mt_timer_link *head;
+
+    wheel_unlink(&timer->link);
+    timer->in_wheel = 0;
+    if (timer->wheel_level == WHEEL_LOCAL) {
+        return;
+    }
+    head = &wheel->slots[timer->wheel_level][timer->wheel_slot];
+    if (head->next == head) {
+        wheel->occupied[timer->wheel_level] &= ~(1ULL << timer->wheel_slot);
+    }
+    wheel->count--;
+}
+
+/* move all timers of the slot to the list */
+    static void
+wheel_detach(rb_mt_wheel *wheel, int level, uint64_t slot, rb_mt_timer_link *list)
+{
+    rb_mt_timer_link *head = &wheel->slots[level][slot];
+    while (head->next != head) {
+        rb_mt_timer *timer = wheel_timer(head->next);
+        wheel_unlink(&timer->link);
+        wheel_link(list, &timer->link);
+        timer->wheel_level = WHEEL_LOCAL;
+        wheel->count--;
+    }
+    wheel->occupied[level] &= ~(1ULL << slot);
+}
+
+    static void
+wheel_cascade(rb_mt_wheel *wheel, int level, uint64_t slot)
+{
+    rb_mt_timer_link list;
+
+    list.next = list.prev = &list;
+    wheel_detach(wheel, level, slot, &list);
+    while (list.next != &list) {
+        rb_mt_timer *timer = wheel_timer(list.next);
+        uint64_t tick = wheel_tick_of(timer);
+        wheel_unlink(&timer->link);
+        /* unlike wheel_insert() the current tick isn't processed yet */
+        if (tick < wheel->now) {
+            tick = wheel->now;
+        }
+        wheel_place(wheel, timer, tick);
+    }
+}
+
+/* the tick of the nearest timer or cascade, zero if the wheel is empty */
+    static uint64_t
+wheel_next(rb_mt_wheel *wheel)
+{
+    int l;
+    if (wheel->expired.next != &wheel->expired) {
+        return wheel->now;
+    }
+    if (wheel->count == 0) {
+        return 0;
+    }
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        uint64_t digit = (wheel->now >> (WHEEL_BITS * l)) & WHEEL_MASK;
+        uint64_t bits = wheel_bits_after(wheel, l, digit);
+        if (bits) {
+            int shift = WHEEL_BITS * (l + 1);
+            return ((wheel->now >> shift) << shift) |
+                ((uint64_t)wheel_ctz(bits) << (WHEEL_BITS * l));
+        }
+    }
+    return 0;
+}
+
+/* advance the wheel to the next tick with work, but not past the
+ * target. Cascades are made on the way, the timers of the reached tick
+ * are moved to the expired list. Returns zero when the target is
+ * reached */
+    static int
+wheel_step(rb_mt_wheel *wheel, uint64_t target)
+{
+    uint64_t digit, bits, next;
+    int l;
+
+    if (wheel->now >= target) {
+        return 0;
+    }
+    if (wheel->count == 0) {
+        wheel->now = target;
+        return 0;
+    }
+    digit = wheel->now & WHEEL_MASK;
+    bits = wheel_bits_after(wheel, 0, digit);
+    if (bits) {
+        next = (wheel->now & ~WHEEL_MASK) | (uint64_t)wheel_ctz(bits);
+    } else {
+        next = (wheel->now | WHEEL_MASK) + 1;
+    }
+    if (next > target) {
+        wheel->now = target;
+        return 0;
+    }
+    wheel->now = next;
+    if ((next & WHEEL_MASK) == 0) {
+        for (l = WHEEL_LEVELS - 1; l > 0; l--) {
+            if ((next & ((1ULL << (WHEEL_BITS * l)) - 1)) == 0) {
+                wheel_cascade(wheel, l, (next >> (WHEEL_BITS * l)) & WHEEL_MASK);
+            }
+        }
+    }
+    wheel_detach(wheel, 0, next & WHEEL_MASK, &wheel->expired);
+    return 1;
+}
+/* timers wheel end */
 
 /* callbacks array */
 typedef struct rb_mt_callbacks rb_mt_callbacks;
@@ -480,22 +739,69 @@ callbacks_clean(rb_mt_callbacks *callbacks)
 }
 /* callbacks array end */
 
+#ifdef HAVE_LIBURING
+/* state of the one-shot poll request armed for the descriptor */
+typedef struct rb_mt_uring_slot rb_mt_uring_slot;
+struct rb_mt_uring_slot {
+    uint32_t gen;
+    short flags;
+};
+#endif
+
 typedef struct rb_mt_loop rb_mt_loop;
 struct rb_mt_loop {
     rb_mt_events events;
     rb_mt_timers timers;
+    rb_mt_wheel wheel;
     rb_mt_callbacks callbacks;
     short run;
+#ifdef HAVE_EPOLL_CREATE
+    /* persistent interest set, -1 if epoll isn't available */
+    int epoll_fd;
+    int epoll_capa;
+    struct epoll_event *epoll_events;
+#endif
+#ifdef HAVE_LIBURING
+    int use_uring;
+    struct io_uring ring;
+    rb_mt_uring_slot *uring_slots;
+    uint32_t uring_nslots;
+    uint32_t uring_timer_gen;
+    short uring_timer_armed;
+    hrtime_t uring_timer_ts;
+    struct __kernel_timespec uring_ts;
+#endif
 };
 
     static rb_mt_loop*
-loop_create()
+loop_create(int use_uring)
 {
     rb_mt_loop *loop = calloc(1, sizeof(*loop));
     if (loop == NULL) return NULL;
     if (!events_init(&loop->events)) goto free_loop;
     if (!timers_init(&loop->timers)) goto free_events;
     if (!callbacks_init(&loop->callbacks)) goto free_timers;
+    wheel_init(&loop->wheel, gethrtime());
+#ifdef HAVE_LIBURING
+    /* fall back to epoll/poll when the kernel doesn't support io_uring */
+    if (use_uring && io_uring_queue_init(256, &loop->ring, 0) == 0) {
+        loop->use_uring = 1;
+    }
+#else
+    (void)use_uring;
+#endif
+#ifdef HAVE_EPOLL_CREATE
+    loop->epoll_fd = -1;
+#ifdef HAVE_LIBURING
+    if (!loop->use_uring)
+#endif
+        loop->epoll_fd = epoll_create(16);
+    if (loop->epoll_fd >= 0) {
+#ifdef FD_CLOEXEC
+        fcntl(loop->epoll_fd, F_SETFD, FD_CLOEXEC);
+#endif
+    }
+#endif
     return loop;
 
 free_timers:
@@ -513,9 +819,89 @@ loop_destroy(rb_mt_loop *loop)
     events_finalize(&loop->events);
     timers_finalize(&loop->timers);
     callbacks_finalize(&loop->callbacks);
+#ifdef HAVE_EPOLL_CREATE
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+    }
+    free(loop->epoll_events);
+#endif
+#ifdef HAVE_LIBURING
+    if (loop->use_uring) {
+        io_uring_queue_exit(&loop->ring);
+    }
+    free(loop->uring_slots);
+#endif
     free(loop);
 }
 
+    static void
+loop_timer_insert(rb_mt_loop *loop, rb_mt_timer *timer)
+{
+    if (!wheel_insert(&loop->wheel, timer)) {
+        timers_insert(&loop->timers, timer);
+    }
+}
+
+    static void
+loop_timer_remove(rb_mt_loop *loop, rb_mt_timer *timer)
+{
+    if (timer->in_wheel) {
+        wheel_remove(&loop->wheel, timer);
+    } else if (timer->index != -1) {
+        timers_remove_timer(&loop->timers, timer);
+    }
+}
+
+    static inline uint32_t
+loop_timers_count(rb_mt_loop *loop)
+{
+    return loop->timers.count + loop->wheel.count;
+}
+
+    static hrtime_t
+loop_timers_minimum(rb_mt_loop *loop)
+{
+    hrtime_t heap_next = timers_minimum(&loop->timers);
+    hrtime_t wheel_next_ts = wheel_next(&loop->wheel) * WHEEL_TICK;
+    if (heap_next && (heap_next < wheel_next_ts || wheel_next_ts == 0)) {
+        return heap_next;
+    }
+    return wheel_next_ts;
+}
+
+/* rearm the periodic timer and call its handler */
+    static void
+loop_timer_fire(rb_mt_loop *loop, rb_mt_timer *timer, hrtime_t now)
+{
+    timer->ts = now + timer->period;
+    loop_timer_insert(loop, timer);
+    timer->handler(-1, 0, timer->cb_data);
+}
+
+    static void
+loop_timers_run(rb_mt_loop *loop, hrtime_t now)
+{
+    rb_mt_timer_link *expired = &loop->wheel.expired;
+    hrtime_t next_time;
+
+    do {
+        /* the handlers might remove the timers which are still in the list */
+        while (expired->next != expired) {
+            rb_mt_timer *timer = wheel_timer(expired->next);
+            wheel_remove(&loop->wheel, timer);
+            loop_timer_fire(loop, timer, now);
+        }
+    } while (wheel_step(&loop->wheel, now / WHEEL_TICK));
+
+    next_time = timers_minimum(&loop->timers);
+    while (next_time && next_time < now) {
+        rb_mt_timer *first = timers_first(&loop->timers);
+        timers_remove_timer(&loop->timers, first);
+        loop_timer_fire(loop, first, now);
+        next_time = timers_minimum(&loop->timers);
+    }
+}
+
     static void
 loop_remove_event(rb_mt_loop *loop, rb_mt_event *event)
 {
@@ -580,7 +966,7 @@ loop_run_select(VALUE argp)
     int result, max = 0;
     hrtime_t now, next_time;
 
-    next_time = timers_minimum(&loop->timers);
+    next_time = loop_timers_minimum(loop);
     if (next_time) {
         now = gethrtime();
         if (next_time <= now) {
@@ -653,9 +1039,9 @@ loop_run_select(VALUE argp)
     }
 
     if (next_time) {
-        timers_run(&loop->timers, now);
+        loop_timers_run(loop, now);
     }
-    if (loop->events.count == 0 && loop->timers.count == 0) {
+    if (loop->events.count == 0 && loop_timers_count(loop) == 0) {
         loop->run = 0;
     }
     return Qnil;
@@ -772,7 +1158,7 @@ loop_run_poll(VALUE argp)
     }
 
 retry:
-    next_time = timers_minimum(&loop->timers);
+    next_time = loop_timers_minimum(loop);
     if (next_time) {
         now = gethrtime();
         args->ts = next_time <= now ? 0 : next_time - now;
@@ -861,9 +1247,9 @@ retry:
     }
 
     if (next_time) {
-        timers_run(&loop->timers, now);
+        loop_timers_run(loop, now);
     }
-    if (loop->events.count == 0 && loop->timers.count == 0) {
+    if (loop->events.count == 0 && loop_timers_count(loop) == 0) {
         loop->run = 0;
     }
     return Qnil;
@@ -883,6 +1269,431 @@ loop_poll_cleanup(VALUE argp)
 #endif
 /* loop poll implementation end */
 
+/* loop epoll implementation */
+#ifdef HAVE_EPOLL_CREATE
+#define EPOLLIN_SET (EPOLLIN | EPOLLHUP | EPOLLERR)
+#define EPOLLOUT_SET (EPOLLOUT | EPOLLHUP | EPOLLERR)
+
+/* bring the kernel interest set in line with the flags of the socket.
+ * When the socket has been removed from the events array, it is
+ * unregistered. Errors about sockets closed behind our back are
+ * ignored, because the kernel drops them from epoll set itself */
+    static void
+loop_epoll_sync(rb_mt_loop *loop, lcb_socket_t socket)
+{
+    struct epoll_event ev;
+    uint32_t i;
+    rb_mt_socket_list *list;
+
+    if (loop->epoll_fd < 0 || socket < 0) {
+        return;
+    }
+    i = events_index(&loop->events, socket);
+    list = &loop->events.sockets[i];
+    if (i == loop->events.count || list->socket != socket) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, socket, &ev);
+        return;
+    }
+    if (list->epoll_flags == list->flags) {
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = socket;
+    ev.events =
+        (list->flags & LCB_READ_EVENT ? EPOLLIN : 0) |
+        (list->flags & LCB_WRITE_EVENT ? EPOLLOUT : 0);
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, socket, &ev) < 0) {
+        if (errno != ENOENT || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, socket, &ev) < 0) {
+            rb_sys_fail("epoll_ctl");
+        }
+    }
+    list->epoll_flags = list->flags;
+}
+
+typedef struct epoll_args le_arg;
+struct epoll_args {
+    rb_mt_loop *loop;
+    int timeout;
+    int result;
+    int lerrno;
+};
+
+    static VALUE
+loop_blocking_epoll(void *argp)
+{
+    le_arg *args = argp;
+    args->result = epoll_wait(args->loop->epoll_fd, args->loop->epoll_events,
+            args->loop->epoll_capa, args->timeout);
+    if (args->result < 0) args->lerrno = errno;
+    return Qnil;
+}
+
+    static VALUE
+loop_run_epoll(VALUE argp)
+{
+    le_arg *args = (le_arg*)argp;
+    rb_mt_loop *loop = args->loop;
+    hrtime_t now, next_time;
+
+    if (loop->epoll_capa < (int)loop->events.count || loop->epoll_events == NULL) {
+        int new_capa = loop->epoll_capa ? loop->epoll_capa : 4;
+        struct epoll_event *new_events;
+        while (new_capa < (int)loop->events.count) {
+            new_capa <<= 1;
+        }
+        new_events = realloc(loop->epoll_events, new_capa * sizeof(*new_events));
+        if (new_events == NULL) {
+            rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for epoll events");
+        }
+        loop->epoll_events = new_events;
+        loop->epoll_capa = new_capa;
+    }
+
+retry:
+    next_time = loop_timers_minimum(loop);
+    args->timeout = -1;
+    if (next_time) {
+        now = gethrtime();
+        if (next_time <= now) {
+            args->timeout = 0;
+        } else {
+            hrtime_t ms = (next_time - now + 999999) / (1000 * 1000);
+            if (ms <= (hrtime_t)(((unsigned int)~0) >> 1)) {
+                args->timeout = (int)ms;
+            }
+        }
+    }
+
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+    rb_thread_call_without_gvl((void *(*)(void*))loop_blocking_epoll, args, RUBY_UBF_IO, 0);
+#elif defined(HAVE_RB_THREAD_BLOCKING_REGION)
+    rb_thread_blocking_region(loop_blocking_epoll, args, RUBY_UBF_PROCESS, NULL);
+#else
+    {
+        /* 5 millisecond pause, when other threads want to run */
+        int exact = 1;
+        if (!rb_thread_alone() && (args->timeout < 0 || args->timeout > 5)) {
+            args->timeout = 5;
+            exact = 0;
+        }
+        TRAP_BEG;
+        loop_blocking_epoll(args);
+        TRAP_END;
+        if (args->result == 0 && !exact) {
+            args->result = -1;
+            args->lerrno = EINTR;
+        }
+    }
+#endif
+
+    if (args->result < 0) {
+        errno = args->lerrno;
+        switch (errno) {
+            case EINTR:
+#ifdef ERESTART
+            case ERESTART:
+#endif
+#ifndef HAVE_RB_THREAD_BLOCKING_REGION
+                rb_thread_schedule();
+#endif
+                goto retry;
+        }
+        rb_sys_fail("epoll_wait");
+        return Qnil;
+    }
+
+    if (next_time) {
+        now = gethrtime();
+    }
+
+    if (args->result > 0) {
+        int i;
+        for (i = 0; i < args->result; i++) {
+            struct epoll_event *res = loop->epoll_events + i;
+            uint32_t idx = events_index(&loop->events, res->data.fd);
+            rb_mt_socket_list *list = loop->events.sockets + idx;
+            short flags;
+
+            /* if plugin used correctly, this check is noop */
+            if (idx == loop->events.count || list->socket != res->data.fd) {
+                continue;
+            }
+            flags =
+                ((res->events & EPOLLIN_SET) ? LCB_READ_EVENT : 0) |
+                ((res->events & EPOLLOUT_SET) ? LCB_WRITE_EVENT : 0);
+            loop_enque_events(&loop->callbacks, list->first, flags);
+        }
+        callbacks_run(&loop->callbacks);
+    }
+
+    if (next_time) {
+        loop_timers_run(loop, now);
+    }
+    if (loop->events.count == 0 && loop_timers_count(loop) == 0) {
+        loop->run = 0;
+    }
+    return Qnil;
+}
+
+    static VALUE
+loop_epoll_cleanup(VALUE argp)
+{
+    le_arg *args = (le_arg*)argp;
+    callbacks_clean(&args->loop->callbacks);
+    return Qnil;
+}
+#else
+#define loop_epoll_sync(loop, socket) (void)0
+#endif
+/* loop epoll implementation end */
+
+/* loop io_uring implementation */
+#ifdef HAVE_LIBURING
+/* user_data of the requests is the generation in the high half and the
+ * descriptor in the low half. The requests with zero generation (poll
+ * and timeout removals) and the stale generations are ignored */
+#define URING_TIMER_FD ((uint32_t)~0)
+#define URING_DATA(gen, fd) (((uint64_t)(gen) << 32) | (uint32_t)(fd))
+#define URING_DATA_GEN(data) ((uint32_t)((data) >> 32))
+#define URING_DATA_FD(data) ((uint32_t)(data))
+#define URING_POLLIN_SET (POLLIN | POLLHUP | POLLERR)
+#define URING_POLLOUT_SET (POLLOUT | POLLHUP | POLLERR)
+
+    static struct io_uring_sqe *
+loop_uring_sqe(rb_mt_loop *loop)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&loop->ring);
+    if (sqe == NULL) {
+        /* submission queue is full, flush it to the kernel */
+        io_uring_submit(&loop->ring);
+        sqe = io_uring_get_sqe(&loop->ring);
+        if (sqe == NULL) {
+            rb_raise(cb_eClientNoMemoryError, "failed to get io_uring submission entry");
+        }
+    }
+    return sqe;
+}
+
+    static inline uint32_t
+loop_uring_next_gen(uint32_t gen)
+{
+    return ++gen ? gen : 1;
+}
+
+/* arm one-shot poll request for the socket according to its current
+ * flags, or cancel armed one when the socket isn't watched anymore.
+ * The requests are only queued here and submitted by the next loop
+ * iteration together with everything else */
+    static void
+loop_uring_sync(rb_mt_loop *loop, lcb_socket_t socket)
+{
+    struct io_uring_sqe *sqe;
+    rb_mt_uring_slot *slot;
+    uint32_t i;
+    short flags = 0;
+
+    if (socket < 0) {
+        return;
+    }
+    if ((uint32_t)socket >= loop->uring_nslots) {
+        uint32_t new_nslots = loop->uring_nslots ? loop->uring_nslots : 64;
+        rb_mt_uring_slot *new_slots;
+        while (new_nslots <= (uint32_t)socket) {
+            new_nslots <<= 1;
+        }
+        new_slots = realloc(loop->uring_slots, new_nslots * sizeof(*new_slots));
+        if (new_slots == NULL) {
+            rb_raise(cb_eClientNoMemoryError, "failed to allocate memory for io_uring slots");
+        }
+        memset(new_slots + loop->uring_nslots, 0,
+                (new_nslots - loop->uring_nslots) * sizeof(*new_slots));
+        loop->uring_slots = new_slots;
+        loop->uring_nslots = new_nslots;
+    }
+    i = events_index(&loop->events, socket);
+    if (i < loop->events.count && loop->events.sockets[i].socket == socket) {
+        flags = loop->events.sockets[i].flags & (LCB_READ_EVENT | LCB_WRITE_EVENT);
+    }
+    slot = loop->uring_slots + socket;
+    if (slot->flags == flags) {
+        return;
+    }
+    if (slot->flags) {
+        sqe = loop_uring_sqe(loop);
+        io_uring_prep_rw(IORING_OP_POLL_REMOVE, sqe, -1, NULL, 0, 0);
+        sqe->addr = URING_DATA(slot->gen, socket);
+        sqe->user_data = 0;
+        slot->flags = 0;
+    }
+    if (flags) {
+        slot->gen = loop_uring_next_gen(slot->gen);
+        sqe = loop_uring_sqe(loop);
+        io_uring_prep_poll_add(sqe, socket,
+                (flags & LCB_READ_EVENT ? POLLIN : 0) |
+                (flags & LCB_WRITE_EVENT ? POLLOUT : 0));
+        sqe->user_data = URING_DATA(slot->gen, socket);
+        slot->flags = flags;
+    }
+}
+
+/* keep single timeout request for the nearest timer */
+    static void
+loop_uring_arm_timer(rb_mt_loop *loop, hrtime_t next_time, hrtime_t now)
+{
+    struct io_uring_sqe *sqe;
+
+    if (loop->uring_timer_armed && loop->uring_timer_ts == next_time) {
+        return;
+    }
+    if (loop->uring_timer_armed) {
+        sqe = loop_uring_sqe(loop);
+        io_uring_prep_rw(IORING_OP_TIMEOUT_REMOVE, sqe, -1, NULL, 0, 0);
+        sqe->addr = URING_DATA(loop->uring_timer_gen, URING_TIMER_FD);
+        sqe->user_data = 0;
+        loop->uring_timer_armed = 0;
+    }
+    if (next_time) {
+        hrtime_t rel = next_time > now ? next_time - now : 0;
+        loop->uring_ts.tv_sec = (long long)(rel / (1000 * 1000 * 1000));
+        loop->uring_ts.tv_nsec = (long long)(rel % (1000 * 1000 * 1000));
+        loop->uring_timer_gen = loop_uring_next_gen(loop->uring_timer_gen);
+        sqe = loop_uring_sqe(loop);
+        io_uring_prep_timeout(sqe, &loop->uring_ts, 0, 0);
+        sqe->user_data = URING_DATA(loop->uring_timer_gen, URING_TIMER_FD);
+        loop->uring_timer_armed = 1;
+        loop->uring_timer_ts = next_time;
+    }
+}
+
+typedef struct uring_args lu_arg;
+struct uring_args {
+    rb_mt_loop *loop;
+    unsigned wait_nr;
+    int result;
+    int lerrno;
+};
+
+    static VALUE
+loop_blocking_uring(void *argp)
+{
+    lu_arg *args = argp;
+    args->result = io_uring_submit_and_wait(&args->loop->ring, args->wait_nr);
+    if (args->result < 0) args->lerrno = -args->result;
+    return Qnil;
+}
+
+    static VALUE
+loop_run_uring(VALUE argp)
+{
+    lu_arg *args = (lu_arg*)argp;
+    rb_mt_loop *loop = args->loop;
+    struct io_uring_cqe *cqe;
+    hrtime_t now = 0, next_time;
+    unsigned head, seen = 0;
+    uint32_t i;
+
+    /* re-arm poll requests consumed on the previous iteration */
+    for (i = 0; i < loop->events.count; i++) {
+        loop_uring_sync(loop, loop->events.sockets[i].socket);
+    }
+
+retry:
+    next_time = loop_timers_minimum(loop);
+    if (next_time) {
+        now = gethrtime();
+    }
+    loop_uring_arm_timer(loop, next_time, now);
+    args->wait_nr = (next_time && next_time <= now) ? 0 : 1;
+
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+    rb_thread_call_without_gvl((void *(*)(void*))loop_blocking_uring, args, RUBY_UBF_IO, 0);
+#else
+    rb_thread_blocking_region(loop_blocking_uring, args, RUBY_UBF_PROCESS, NULL);
+#endif
+
+    if (args->result < 0) {
+        errno = args->lerrno;
+        switch (errno) {
+            case EINTR:
+                goto retry;
+            case EAGAIN:
+            case EBUSY:
+                /* completion queue is full, reap it below */
+                break;
+            default:
+                rb_sys_fail("io_uring_enter");
+                return Qnil;
+        }
+    }
+
+    if (next_time) {
+        now = gethrtime();
+    }
+
+    io_uring_for_each_cqe(&loop->ring, head, cqe) {
+        uint32_t gen = URING_DATA_GEN(cqe->user_data);
+        uint32_t fd = URING_DATA_FD(cqe->user_data);
+
+        seen++;
+        if (gen == 0) {
+            continue;
+        }
+        if (fd == URING_TIMER_FD) {
+            if (gen == loop->uring_timer_gen) {
+                loop->uring_timer_armed = 0;
+            }
+        } else if (fd < loop->uring_nslots && loop->uring_slots[fd].gen == gen) {
+            uint32_t idx = events_index(&loop->events, fd);
+            short flags;
+
+            loop->uring_slots[fd].flags = 0;
+            if (idx == loop->events.count || loop->events.sockets[idx].socket != (lcb_socket_t)fd) {
+                continue;
+            }
+            if (cqe->res < 0) {
+                flags = LCB_READ_EVENT | LCB_WRITE_EVENT;
+            } else {
+                flags =
+                    ((cqe->res & URING_POLLIN_SET) ? LCB_READ_EVENT : 0) |
+                    ((cqe->res & URING_POLLOUT_SET) ? LCB_WRITE_EVENT : 0);
+            }
+            loop_enque_events(&loop->callbacks, loop->events.sockets[idx].first, flags);
+        }
+    }
+    io_uring_cq_advance(&loop->ring, seen);
+    callbacks_run(&loop->callbacks);
+
+    if (next_time) {
+        loop_timers_run(loop, now);
+    }
+    if (loop->events.count == 0 && loop_timers_count(loop) == 0) {
+        loop->run = 0;
+    }
+    return Qnil;
+}
+
+    static VALUE
+loop_uring_cleanup(VALUE argp)
+{
+    lu_arg *args = (lu_arg*)argp;
+    callbacks_clean(&args->loop->callbacks);
+    return Qnil;
+}
+#endif
+/* loop io_uring implementation end */
+
+    static void
+loop_sync_socket(rb_mt_loop *loop, lcb_socket_t socket)
+{
+#ifdef HAVE_LIBURING
+    if (loop->use_uring) {
+        loop_uring_sync(loop, socket);
+        return;
+    }
+#endif
+    loop_epoll_sync(loop, socket);
+}
+
     static void
 loop_run(rb_mt_loop *loop)
 {
@@ -890,6 +1701,24 @@ loop_run(rb_mt_loop *loop)
     loop->run = 1;
 
     while(loop->run) {
+#ifdef HAVE_LIBURING
+        if (loop->use_uring) {
+            lu_arg args;
+            args.loop = loop;
+            rb_ensure(loop_run_uring, (VALUE)&args, loop_uring_cleanup, (VALUE)&args);
+            continue;
+        }
+#endif
+#ifdef HAVE_EPOLL_CREATE
+        /* the interest set is maintained by update/delete event
+         * functions, so there is nothing to rebuild on each iteration */
+        if (loop->epoll_fd >= 0) {
+            le_arg args;
+            args.loop = loop;
+            rb_ensure(loop_run_epoll, (VALUE)&args, loop_epoll_cleanup, (VALUE)&args);
+            continue;
+        }
+#endif
 #ifdef HAVE_POLL
         /* prefer use of poll when it gives some benefits, but use rb_thread_fd_select when it is sufficient */
         lcb_socket_t max = events_max_fd(&loop->events);
@@ -932,6 +1761,7 @@ lcb_io_update_event(struct lcb_io_opt_st *iops,
     rb_mt_loop *loop = iops->v.v0.cookie;
     rb_mt_event *event = eventp;
     short old_flags = event->flags;
+    lcb_socket_t old_sock = event->inserted ? event->socket : -1;
 
     if (event->inserted && old_flags == flags &&
             cb_data == event->cb_data && handler == event->handler)
@@ -949,6 +1779,10 @@ lcb_io_update_event(struct lcb_io_opt_st *iops,
     if ((old_flags & flags) != old_flags) {
         events_fix_flags(&loop->events, sock);
     }
+    if (old_sock != sock) {
+        loop_sync_socket(loop, old_sock);
+    }
+    loop_sync_socket(loop, sock);
     return 0;
 }
 
@@ -957,7 +1791,12 @@ lcb_io_delete_event(struct lcb_io_opt_st *iops,
         lcb_socket_t sock,
         void *event)
 {
-    loop_remove_event((rb_mt_loop*)iops->v.v0.cookie, (rb_mt_event*)event);
+    rb_mt_loop *loop = iops->v.v0.cookie;
+    rb_mt_event *ev = event;
+    lcb_socket_t old_sock = ev->inserted ? ev->socket : -1;
+
+    loop_remove_event(loop, ev);
+    loop_sync_socket(loop, old_sock);
     (void)sock;
 }
 
@@ -974,6 +1813,7 @@ lcb_io_create_timer(struct lcb_io_opt_st *iops)
 {
     rb_mt_timer *timer = calloc(1, sizeof(*timer));
     timer->index = -1;
+    timer->link.next = timer->link.prev = &timer->link;
     (void)iops;
     return timer;
 }
@@ -990,11 +1830,8 @@ lcb_io_update_timer(struct lcb_io_opt_st *iops, void *event,
     timer->ts = gethrtime() + timer->period;
     timer->cb_data = cb_data;
     timer->handler = handler;
-    if (timer->index != -1) {
-        timers_heapify_item(&loop->timers, timer->index);
-    } else {
-        timers_insert(&loop->timers, timer);
-    }
+    loop_timer_remove(loop, timer);
+    loop_timer_insert(loop, timer);
     return 0;
 }
 
@@ -1003,9 +1840,7 @@ lcb_io_delete_timer(struct lcb_io_opt_st *iops, void *event)
 {
     rb_mt_loop *loop = iops->v.v0.cookie;
     rb_mt_timer *timer = event;
-    if (timer->index != -1) {
-        timers_remove_timer(&loop->timers, timer);
-    }
+    loop_timer_remove(loop, timer);
 }
 
     static void
@@ -1026,7 +1861,16 @@ lcb_io_stop_event_loop(struct lcb_io_opt_st *iops)
 lcb_io_run_event_loop(struct lcb_io_opt_st *iops)
 {
     rb_mt_loop *loop = iops->v.v0.cookie;
+    hrtime_t start = 0;
+
+    if (CB_PROBE_ENABLED(loop__enter) || CB_PROBE_ENABLED(loop__exit)) {
+        start = gethrtime();
+        CB_PROBE0(loop__enter);
+    }
     loop_run(loop);
+    if (start) {
+        CB_PROBE1(loop__exit, gethrtime() - start);
+    }
 }
 
     static void
@@ -1042,7 +1886,7 @@ cb_create_ruby_mt_io_opts(int version, lcb_io_opt_t *io, void *arg)
 {
     struct lcb_io_opt_st *ret;
     rb_mt_loop *loop;
-    (void)arg;
+    struct cb_bucket_st *bucket = arg;
     if (version != 0) {
         return LCB_PLUGIN_VERSION_MISMATCH;
     }
@@ -1078,7 +1922,7 @@ cb_create_ruby_mt_io_opts(int version, lcb_io_opt_t *io, void *arg)
     ret->v.v0.run_event_loop = lcb_io_run_event_loop;
     ret->v.v0.stop_event_loop = lcb_io_stop_event_loop;
 
-    loop = loop_create();
+    loop = loop_create(bucket && bucket->engine == cb_sym_io_uring);
     if (loop == NULL) {
         free(ret);
         return LCB_CLIENT_ENOMEM;
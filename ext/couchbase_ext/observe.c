@@ -23,38 +23,45 @@ cb_observe_callback(lcb_t handle, const void *cookie, lcb_error_t error, const l
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE key, res, exc;
+    struct cb_result_st *result;
 
     if (resp->v.v0.key) {
+        if (resp->v.v0.from_master) {
+            cb_latency_record(ctx, cb_latency_observe, resp->v.v0.key, resp->v.v0.nkey, CB_LATENCY_NO_SIZE);
+        }
         key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
         exc = cb_check_error(error, "failed to execute observe request", key);
         if (exc != Qnil) {
             ctx->exception = exc;
         }
-        res = rb_class_new_instance(0, NULL, cb_cResult);
-        rb_ivar_set(res, cb_id_iv_completed, Qfalse);
-        rb_ivar_set(res, cb_id_iv_error, ctx->exception);
-        rb_ivar_set(res, cb_id_iv_operation, cb_sym_observe);
-        rb_ivar_set(res, cb_id_iv_key, key);
-        rb_ivar_set(res, cb_id_iv_cas, ULL2NUM(resp->v.v0.cas));
-        rb_ivar_set(res, cb_id_iv_from_master, resp->v.v0.from_master ? Qtrue : Qfalse);
-        rb_ivar_set(res, cb_id_iv_time_to_persist, ULONG2NUM(resp->v.v0.ttp));
-        rb_ivar_set(res, cb_id_iv_time_to_replicate, ULONG2NUM(resp->v.v0.ttr));
+        res = cb_result_new(&result);
+        result->completed = Qfalse;
+        result->error = ctx->exception;
+        result->operation = cb_sym_observe;
+        result->key = key;
+        result->cas = resp->v.v0.cas;
+        result->has_cas = 1;
+        result->from_master = resp->v.v0.from_master ? Qtrue : Qfalse;
+        result->ttp = resp->v.v0.ttp;
+        result->has_ttp = 1;
+        result->ttr = resp->v.v0.ttr;
+        result->has_ttr = 1;
         switch (resp->v.v0.status) {
             case LCB_OBSERVE_FOUND:
-                rb_ivar_set(res, cb_id_iv_status, cb_sym_found);
+                result->status = cb_sym_found;
                 break;
             case LCB_OBSERVE_PERSISTED:
-                rb_ivar_set(res, cb_id_iv_status, cb_sym_persisted);
+                result->status = cb_sym_persisted;
                 break;
             case LCB_OBSERVE_NOT_FOUND:
-                rb_ivar_set(res, cb_id_iv_status, cb_sym_not_found);
+                result->status = cb_sym_not_found;
                 break;
             default:
-                rb_ivar_set(res, cb_id_iv_status, Qnil);
+                result->status = Qnil;
         }
         if (bucket->async) { /* asynchronous */
             if (ctx->proc != Qnil) {
-                cb_proc_call(bucket, ctx->proc, 1, res);
+                cb_context_yield(ctx, res);
             }
         } else {             /* synchronous */
             if (NIL_P(ctx->exception)) {
@@ -68,9 +75,9 @@ cb_observe_callback(lcb_t handle, const void *cookie, lcb_error_t error, const l
         }
     } else {
         if (bucket->async && ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_completed, Qtrue);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->completed = Qtrue;
+            cb_context_yield(ctx, res);
         }
         ctx->nqueries--;
         ctx->proc = Qnil;
@@ -140,7 +147,7 @@ cb_bucket_observe(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
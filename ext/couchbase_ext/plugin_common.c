@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <limits.h>
 
 #ifndef RUBY_WIN32_H
 #  include <unistd.h>
@@ -45,33 +46,63 @@ cb_io_recv(struct lcb_io_opt_st *iops, lcb_socket_t sock,
     return ret;
 }
 
-    lcb_ssize_t
-cb_io_recvv(struct lcb_io_opt_st *iops, lcb_socket_t sock,
-        struct lcb_iovec_st *iov, lcb_size_t niov)
+/* the vector is limited by IOV_MAX, the rest of the data will be
+ * transferred by the next call, as with any partial IO */
+#ifdef IOV_MAX
+#define CB_IOV_MAX IOV_MAX
+#else
+#define CB_IOV_MAX 1024
+#endif
+/* the vectors up to this size are built on the stack */
+#define CB_IOV_STACK 16
+
+    static lcb_ssize_t
+cb_io_msg(struct lcb_io_opt_st *iops, lcb_socket_t sock,
+        struct lcb_iovec_st *iov, lcb_size_t niov, int out)
 {
     struct msghdr msg;
-    struct iovec vec[2];
+    struct iovec stack_vec[CB_IOV_STACK], *vec = stack_vec;
+    lcb_size_t ii, nvec = 0;
     lcb_ssize_t ret;
 
-    if (niov != 2) {
-        return -1;
+    if (niov > CB_IOV_MAX) {
+        niov = CB_IOV_MAX;
+    }
+    if (niov > CB_IOV_STACK) {
+        vec = malloc(niov * sizeof(struct iovec));
+        if (vec == NULL) {
+            iops->v.v0.error = ENOMEM;
+            return -1;
+        }
+    }
+    for (ii = 0; ii < niov; ++ii) {
+        if (iov[ii].iov_len) {
+            vec[nvec].iov_base = iov[ii].iov_base;
+            vec[nvec].iov_len = iov[ii].iov_len;
+            nvec++;
+        }
     }
     memset(&msg, 0, sizeof(msg));
     msg.msg_iov = vec;
-    msg.msg_iovlen = iov[1].iov_len ? (lcb_size_t)2 : (lcb_size_t)1;
-    msg.msg_iov[0].iov_base = iov[0].iov_base;
-    msg.msg_iov[0].iov_len = iov[0].iov_len;
-    msg.msg_iov[1].iov_base = iov[1].iov_base;
-    msg.msg_iov[1].iov_len = iov[1].iov_len;
-    ret = recvmsg(sock, &msg, 0);
+    msg.msg_iovlen = nvec;
+    ret = out ? sendmsg(sock, &msg, 0) : recvmsg(sock, &msg, 0);
 
     if (ret < 0) {
         iops->v.v0.error = errno;
     }
-
+    if (vec != stack_vec) {
+        free(vec);
+    }
     return ret;
 }
 
+    lcb_ssize_t
+cb_io_recvv(struct lcb_io_opt_st *iops, lcb_socket_t sock,
+        struct lcb_iovec_st *iov, lcb_size_t niov)
+{
+    return cb_io_msg(iops, sock, iov, niov, 0);
+}
+
     lcb_ssize_t
 cb_io_send(struct lcb_io_opt_st *iops, lcb_socket_t sock,
         const void *msg, lcb_size_t len, int flags)
@@ -87,26 +118,7 @@ cb_io_send(struct lcb_io_opt_st *iops, lcb_socket_t sock,
 cb_io_sendv(struct lcb_io_opt_st *iops, lcb_socket_t sock,
         struct lcb_iovec_st *iov, lcb_size_t niov)
 {
-    struct msghdr msg;
-    struct iovec vec[2];
-    lcb_ssize_t ret;
-
-    if (niov != 2) {
-        return -1;
-    }
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_iov = vec;
-    msg.msg_iovlen = iov[1].iov_len ? (lcb_size_t)2 : (lcb_size_t)1;
-    msg.msg_iov[0].iov_base = iov[0].iov_base;
-    msg.msg_iov[0].iov_len = iov[0].iov_len;
-    msg.msg_iov[1].iov_base = iov[1].iov_base;
-    msg.msg_iov[1].iov_len = iov[1].iov_len;
-    ret = sendmsg(sock, &msg, 0);
-
-    if (ret < 0) {
-        iops->v.v0.error = errno;
-    }
-    return ret;
+    return cb_io_msg(iops, sock, iov, niov, 1);
 }
 
     static int
@@ -0,0 +1,237 @@
+/* vim: ft=c et ts=8 sts=4 sw=4 cino=
+ *
+ *   Copyright 2011, 2012 Couchbase, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "couchbase_ext.h"
+
+    void
+cb_prepared_free(void *ptr)
+{
+    xfree(ptr);
+}
+
+    void
+cb_prepared_mark(void *ptr)
+{
+    struct cb_prepared_st *prepared = ptr;
+    if (prepared) {
+        rb_gc_mark(prepared->bucket_obj);
+        rb_gc_mark(prepared->operation);
+        switch (prepared->params.type) {
+            case cb_cmd_get:
+                rb_gc_mark(prepared->params.cmd.get.replica);
+                rb_gc_mark(prepared->params.cmd.get.transcoder);
+                rb_gc_mark(prepared->params.cmd.get.transcoder_opts);
+                break;
+            case cb_cmd_store:
+                rb_gc_mark(prepared->params.cmd.store.observe);
+                rb_gc_mark(prepared->params.cmd.store.transcoder);
+                rb_gc_mark(prepared->params.cmd.store.transcoder_opts);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+    VALUE
+cb_prepared_alloc(VALUE klass)
+{
+    VALUE obj;
+    struct cb_prepared_st *prepared;
+
+    /* allocate new prepared struct and set it to zero */
+    obj = Data_Make_Struct(klass, struct cb_prepared_st, cb_prepared_mark,
+            cb_prepared_free, prepared);
+    prepared->bucket_obj = Qnil;
+    prepared->operation = Qnil;
+    return obj;
+}
+
+    static lcb_storage_t
+prepared_storage_opcode(VALUE operation)
+{
+    if (operation == cb_sym_set) {
+        return LCB_SET;
+    } else if (operation == cb_sym_add) {
+        return LCB_ADD;
+    } else if (operation == cb_sym_replace) {
+        return LCB_REPLACE;
+    } else if (operation == cb_sym_append) {
+        return LCB_APPEND;
+    } else if (operation == cb_sym_prepend) {
+        return LCB_PREPEND;
+    }
+    return 0;
+}
+
+/*
+ * Initialize prepared operation
+ *
+ * @since 1.3.8
+ *
+ * @see Bucket#prepare
+ *
+ * @param [Bucket] bucket the connection object
+ * @param [Symbol] operation the name of the operation (+:get+, +:set+,
+ *   +:add+, +:replace+, +:append+ or +:prepend+)
+ * @param [Hash] options the options of the operation. They are resolved
+ *   once, using the defaults of the bucket at this moment.
+ *
+ * @raise [ArgumentError] when the operation isn't supported or options
+ *   are invalid
+ *
+ * @return [Bucket::Prepared]
+ */
+    VALUE
+cb_prepared_init(int argc, VALUE *argv, VALUE self)
+{
+    struct cb_prepared_st *prepared = DATA_PTR(self);
+    VALUE bucket, operation, opts;
+
+    rb_scan_args(argc, argv, "21", &bucket, &operation, &opts);
+    if (!RTEST(rb_obj_is_kind_of(bucket, cb_cBucket))) {
+        rb_raise(rb_eTypeError, "wrong argument type (expected Couchbase::Bucket)");
+    }
+    if (!NIL_P(opts)) {
+        Check_Type(opts, T_HASH);
+    }
+    prepared->bucket_obj = bucket;
+    prepared->bucket = DATA_PTR(bucket);
+    prepared->params.bucket = prepared->bucket;
+    if (operation == cb_sym_get) {
+        prepared->params.type = cb_cmd_get;
+    } else if (prepared_storage_opcode(operation)) {
+        prepared->params.type = cb_cmd_store;
+        prepared->params.cmd.store.operation = prepared_storage_opcode(operation);
+    } else {
+        rb_raise(rb_eArgError, "unsupported operation: %s",
+                RSTRING_PTR(rb_inspect(operation)));
+    }
+    cb_params_prepare(&prepared->params, opts);
+    prepared->operation = operation;
+
+    return self;
+}
+
+/*
+ * Returns a string containing a human-readable representation of the
+ * Prepared.
+ *
+ * @since 1.3.8
+ *
+ * @return [String]
+ */
+    VALUE
+cb_prepared_inspect(VALUE self)
+{
+    VALUE str;
+    struct cb_prepared_st *prepared = DATA_PTR(self);
+    char buf[100];
+
+    str = rb_str_buf_new2("#<");
+    rb_str_buf_cat2(str, rb_obj_classname(self));
+    snprintf(buf, 100, ":%p operation=", (void *)self);
+    rb_str_buf_cat2(str, buf);
+    rb_str_append(str, rb_inspect(prepared->operation));
+    rb_str_buf_cat2(str, ">");
+
+    return str;
+}
+
+/*
+ * The name of the operation
+ *
+ * @since 1.3.8
+ *
+ * @return [Symbol]
+ */
+    VALUE
+cb_prepared_operation_get(VALUE self)
+{
+    struct cb_prepared_st *prepared = DATA_PTR(self);
+    return prepared->operation;
+}
+
+/*
+ * Execute the operation with prepared options
+ *
+ * @since 1.3.8
+ *
+ * Accepts the same arguments as the original operation except options
+ * Hash, which was given to {Bucket#prepare}. Note that the trailing Hash
+ * isn't treated as options, so it is possible to store Hash values with
+ * +prepared.call("key", {"foo" => "bar"})+.
+ *
+ * @example Get several keys
+ *   get = c.prepare(:get, :quiet => true, :format => :marshal)
+ *   get.call("foo", "bar")    #=> [val1, val2]
+ *
+ * @example Set the key
+ *   set = c.prepare(:set, :ttl => 30, :flags => 0x1000)
+ *   set.call("foo", "bar")    #=> cas
+ *
+ * @return [Object] the same values as the original operation
+ */
+    VALUE
+cb_prepared_call(int argc, VALUE *argv, VALUE self)
+{
+    struct cb_prepared_st *prepared = DATA_PTR(self);
+
+    if (prepared->bucket == NULL) {
+        rb_raise(rb_eArgError, "prepared operation is not initialized");
+    }
+    switch (prepared->params.type) {
+        case cb_cmd_get:
+            return cb_bucket_get_prepared(argc, argv, prepared->bucket_obj, prepared);
+        case cb_cmd_store:
+            return cb_bucket_store_prepared(prepared->params.cmd.store.operation,
+                    argc, argv, prepared->bucket_obj, prepared);
+        default:
+            return Qnil;
+    }
+}
+
+/*
+ * Prepare operation with given options
+ *
+ * @since 1.3.8
+ *
+ * Resolves the options (format, transcoder, ttl, flags, quiet etc.) once,
+ * so that calling the operation repeatedly with the same options doesn't
+ * parse them again.
+ *
+ * @param [Symbol] operation the name of the operation (+:get+, +:set+,
+ *   +:add+, +:replace+, +:append+ or +:prepend+)
+ * @param [Hash] options the options as for {Bucket#get} or {Bucket#set}
+ *
+ * @example Reuse options for the cache reads
+ *   reader = c.prepare(:get, :format => :marshal, :quiet => true)
+ *   reader.call("foo")    #=> value
+ *
+ * @return [Bucket::Prepared]
+ */
+    VALUE
+cb_bucket_prepare(int argc, VALUE *argv, VALUE self)
+{
+    VALUE operation, opts, args[3];
+
+    rb_scan_args(argc, argv, "11", &operation, &opts);
+    args[0] = self;
+    args[1] = operation;
+    args[2] = opts;
+    return rb_class_new_instance(3, args, cb_cPrepared);
+}
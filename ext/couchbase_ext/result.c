@@ -17,6 +17,101 @@
 
 #include "couchbase_ext.h"
 
+/* Results created by the library keep their attributes in the C
+ * structure. Numeric attributes (cas, flags, ttp, ttr) are converted to
+ * ruby objects only when requested. Instance variables (e.g. set by
+ * Result#initialize or instance_variable_set) take precedence over the
+ * fields. */
+
+    void
+cb_result_mark(void *ptr)
+{
+    struct cb_result_st *res = ptr;
+    if (res) {
+        rb_gc_mark(res->operation);
+        rb_gc_mark(res->error);
+        rb_gc_mark(res->key);
+        rb_gc_mark(res->value);
+        rb_gc_mark(res->node);
+        rb_gc_mark(res->headers);
+        rb_gc_mark(res->status);
+        rb_gc_mark(res->completed);
+        rb_gc_mark(res->from_master);
+    }
+}
+
+    void
+cb_result_free(void *ptr)
+{
+    xfree(ptr);
+}
+
+    static size_t
+cb_result_memsize(const void *ptr)
+{
+    return ptr ? sizeof(struct cb_result_st) : 0;
+}
+
+const rb_data_type_t cb_result_type = {
+    "Couchbase::Result",
+    {cb_result_mark, cb_result_free, cb_result_memsize,},
+    NULL, NULL, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+    VALUE
+cb_result_alloc(VALUE klass)
+{
+    VALUE obj;
+    struct cb_result_st *res;
+
+    obj = TypedData_Make_Struct(klass, struct cb_result_st, &cb_result_type, res);
+    res->operation = Qnil;
+    res->error = Qnil;
+    res->key = Qnil;
+    res->value = Qnil;
+    res->node = Qnil;
+    res->headers = Qnil;
+    res->status = Qnil;
+    res->completed = Qnil;
+    res->from_master = Qnil;
+    return obj;
+}
+
+/* Allocate new result object without calling #initialize */
+    VALUE
+cb_result_new(struct cb_result_st **res)
+{
+    VALUE obj = cb_result_alloc(cb_cResult);
+    TypedData_Get_Struct(obj, struct cb_result_st, &cb_result_type, *res);
+    return obj;
+}
+
+#define RESULT_ATTR_GET(name, iv, expr) \
+    VALUE \
+    cb_result_##name##_get(VALUE self) \
+    { \
+        struct cb_result_st *res; \
+        TypedData_Get_Struct(self, struct cb_result_st, &cb_result_type, res); \
+        if (RTEST(rb_ivar_defined(self, iv))) { \
+            return rb_ivar_get(self, iv); \
+        } \
+        return (expr); \
+    }
+
+RESULT_ATTR_GET(operation, cb_id_iv_operation, res->operation)
+RESULT_ATTR_GET(error, cb_id_iv_error, res->error)
+RESULT_ATTR_GET(key, cb_id_iv_key, res->key)
+RESULT_ATTR_GET(value, cb_id_iv_value, res->value)
+RESULT_ATTR_GET(cas, cb_id_iv_cas, res->has_cas ? ULL2NUM(res->cas) : Qnil)
+RESULT_ATTR_GET(flags, cb_id_iv_flags, res->has_flags ? ULONG2NUM(res->flags) : Qnil)
+RESULT_ATTR_GET(node, cb_id_iv_node, res->node)
+RESULT_ATTR_GET(headers, cb_id_iv_headers, res->headers)
+RESULT_ATTR_GET(completed, cb_id_iv_completed, res->completed)
+RESULT_ATTR_GET(status, cb_id_iv_status, res->status)
+RESULT_ATTR_GET(from_master, cb_id_iv_from_master, res->from_master)
+RESULT_ATTR_GET(time_to_persist, cb_id_iv_time_to_persist, res->has_ttp ? ULONG2NUM(res->ttp) : Qnil)
+RESULT_ATTR_GET(time_to_replicate, cb_id_iv_time_to_replicate, res->has_ttr ? ULONG2NUM(res->ttr) : Qnil)
+
 /*
  * Check if result of operation was successful.
  *
@@ -28,7 +123,7 @@
     VALUE
 cb_result_success_p(VALUE self)
 {
-    return RTEST(rb_attr_get(self, cb_id_iv_error)) ? Qfalse : Qtrue;
+    return RTEST(cb_result_error_get(self)) ? Qfalse : Qtrue;
 }
 
 /*
@@ -49,73 +144,73 @@ cb_result_inspect(VALUE self)
     snprintf(buf, 100, ":%p", (void *)self);
     rb_str_buf_cat2(str, buf);
 
-    attr = rb_attr_get(self, cb_id_iv_operation);
+    attr = cb_result_operation_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " operation=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_error);
+    attr = cb_result_error_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " error=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_value);
+    attr = cb_result_value_get(self);
     if (RTEST(attr) && RTEST(rb_obj_is_kind_of(attr, cb_cBucket))) {
         rb_str_buf_cat2(str, " bucket="); /* value also accessible using alias #bucket */
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_key);
+    attr = cb_result_key_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " key=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_status);
+    attr = cb_result_status_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " status=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_cas);
+    attr = cb_result_cas_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " cas=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_flags);
+    attr = cb_result_flags_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " flags=0x");
         rb_str_append(str, rb_funcall(attr, cb_id_to_s, 1, INT2FIX(16)));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_node);
+    attr = cb_result_node_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " node=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_from_master);
+    attr = cb_result_from_master_get(self);
     if (attr != Qnil) {
         rb_str_buf_cat2(str, " from_master=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_time_to_persist);
+    attr = cb_result_time_to_persist_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " time_to_persist=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_time_to_replicate);
+    attr = cb_result_time_to_replicate_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " time_to_replicate=");
         rb_str_append(str, rb_inspect(attr));
     }
 
-    attr = rb_attr_get(self, cb_id_iv_headers);
+    attr = cb_result_headers_get(self);
     if (RTEST(attr)) {
         rb_str_buf_cat2(str, " headers=");
         rb_str_append(str, rb_inspect(attr));
@@ -126,4 +221,89 @@ cb_result_inspect(VALUE self)
     return str;
 }
 
+/*
+ * Copy the structure fields along with instance variables (used by #dup
+ * and #clone)
+ *
+ * @since 1.3.8
+ */
+    VALUE
+cb_result_init_copy(VALUE copy, VALUE orig)
+{
+    struct cb_result_st *dst, *src;
+
+    if (copy == orig) {
+        return copy;
+    }
+    rb_obj_init_copy(copy, orig);
+    TypedData_Get_Struct(copy, struct cb_result_st, &cb_result_type, dst);
+    TypedData_Get_Struct(orig, struct cb_result_st, &cb_result_type, src);
+    *dst = *src;
+    return copy;
+}
+
+/*
+ * Serialize the result for Marshal.
+ *
+ * Struct fields are dumped as the instance variables they stand for,
+ * so the loaded copy reads the same values through the accessors.
+ *
+ * @since 1.3.8
+ *
+ * @return [Hash] instance variable names mapped to their values
+ */
+    VALUE
+cb_result_marshal_dump(VALUE self)
+{
+    VALUE ret = rb_hash_new(), ivars = rb_obj_instance_variables(self), name, val;
+    long ii;
 
+#define DUMP_ATTR(name, iv) \
+    val = cb_result_##name##_get(self); \
+    if (val != Qnil) { \
+        rb_hash_aset(ret, ID2SYM(iv), val); \
+    }
+    DUMP_ATTR(operation, cb_id_iv_operation);
+    DUMP_ATTR(error, cb_id_iv_error);
+    DUMP_ATTR(key, cb_id_iv_key);
+    DUMP_ATTR(value, cb_id_iv_value);
+    DUMP_ATTR(cas, cb_id_iv_cas);
+    DUMP_ATTR(flags, cb_id_iv_flags);
+    DUMP_ATTR(node, cb_id_iv_node);
+    DUMP_ATTR(headers, cb_id_iv_headers);
+    DUMP_ATTR(completed, cb_id_iv_completed);
+    DUMP_ATTR(status, cb_id_iv_status);
+    DUMP_ATTR(from_master, cb_id_iv_from_master);
+    DUMP_ATTR(time_to_persist, cb_id_iv_time_to_persist);
+    DUMP_ATTR(time_to_replicate, cb_id_iv_time_to_replicate);
+#undef DUMP_ATTR
+    for (ii = 0; ii < RARRAY_LEN(ivars); ++ii) {
+        name = rb_ary_entry(ivars, ii);
+        rb_hash_aset(ret, name, rb_ivar_get(self, SYM2ID(name)));
+    }
+    return ret;
+}
+
+    static int
+cb_result_marshal_load_i(VALUE key, VALUE value, VALUE arg)
+{
+    rb_ivar_set(arg, rb_to_id(key), value);
+    return ST_CONTINUE;
+}
+
+/*
+ * Restore the result from the value of {#marshal_dump}
+ *
+ * @since 1.3.8
+ *
+ * @param [Hash] data
+ *
+ * @return [nil]
+ */
+    VALUE
+cb_result_marshal_load(VALUE self, VALUE data)
+{
+    Check_Type(data, T_HASH);
+    rb_hash_foreach(data, cb_result_marshal_load_i, self);
+    return Qnil;
+}
@@ -23,6 +23,7 @@ cb_stat_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE stats, node, key, val, exc = Qnil, res;
+    struct cb_result_st *result;
 
     node = resp->v.v0.server_endpoint ? STR_NEW_CSTR(resp->v.v0.server_endpoint) : Qnil;
     exc = cb_check_error(error, "failed to fetch stats", node);
@@ -35,13 +36,13 @@ cb_stat_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb_
         val = STR_NEW((const char*)resp->v.v0.bytes, resp->v.v0.nbytes);
         if (bucket->async) {    /* asynchronous */
             if (ctx->proc != Qnil) {
-                res = rb_class_new_instance(0, NULL, cb_cResult);
-                rb_ivar_set(res, cb_id_iv_error, exc);
-                rb_ivar_set(res, cb_id_iv_operation, cb_sym_stats);
-                rb_ivar_set(res, cb_id_iv_node, node);
-                rb_ivar_set(res, cb_id_iv_key, key);
-                rb_ivar_set(res, cb_id_iv_value, val);
-                cb_proc_call(bucket, ctx->proc, 1, res);
+                res = cb_result_new(&result);
+                result->error = exc;
+                result->operation = cb_sym_stats;
+                result->node = node;
+                result->key = key;
+                result->value = val;
+                cb_context_yield(ctx, res);
             }
         } else {                /* synchronous */
             if (NIL_P(exc)) {
@@ -134,7 +135,7 @@ cb_bucket_stats(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
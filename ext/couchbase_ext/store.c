@@ -26,12 +26,14 @@ storage_observe_callback(VALUE args, VALUE cookie)
 
     if (ctx->proc != Qnil) {
         rb_ivar_set(res, cb_id_iv_operation, ctx->operation);
-        cb_proc_call(bucket, ctx->proc, 1, res);
+        cb_context_yield(ctx, res);
     }
     if (!RTEST(ctx->observe_options)) {
         ctx->nqueries--;
         if (ctx->nqueries == 0) {
+            cb_context_flush_batch(ctx);
             ctx->proc = Qnil;
+            cb_context_complete(ctx);
             if (bucket->async) {
                 cb_context_free(ctx);
             }
@@ -66,9 +68,10 @@ cb_storage_callback(lcb_t handle, const void *cookie, lcb_storage_t operation,
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE key, cas, exc, res;
+    struct cb_result_st *result;
 
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    cb_latency_record(ctx, cb_latency_set, resp->v.v0.key, resp->v.v0.nkey, CB_LATENCY_NO_SIZE);
 
     cas = resp->v.v0.cas > 0 ? ULL2NUM(resp->v.v0.cas) : Qnil;
     ctx->operation = storage_opcode_to_sym(operation);
@@ -89,22 +92,25 @@ cb_storage_callback(lcb_t handle, const void *cookie, lcb_storage_t operation,
                     storage_observe_callback, (VALUE)ctx);
             ctx->observe_options = Qnil;
         } else if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            rb_ivar_set(res, cb_id_iv_operation, ctx->operation);
-            rb_ivar_set(res, cb_id_iv_cas, cas);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->key = key;
+            result->operation = ctx->operation;
+            result->cas = resp->v.v0.cas;
+            result->has_cas = resp->v.v0.cas > 0;
+            cb_context_yield(ctx, res);
         }
     } else {             /* synchronous */
-        rb_hash_aset(ctx->rv, key, cas);
+        cb_context_set_result(ctx, key, cas);
     }
 
-    if (!RTEST(ctx->observe_options)) {
+    if (!bucket->async || !RTEST(ctx->observe_options)) {
         ctx->nqueries--;
         if (ctx->nqueries == 0) {
+            cb_context_flush_batch(ctx);
             ctx->proc = Qnil;
-            if (bucket->async) {
+            cb_context_complete(ctx);
+            if (bucket->async || ctx->detached) {
                 cb_context_free(ctx);
             }
         }
@@ -112,8 +118,47 @@ cb_storage_callback(lcb_t handle, const void *cookie, lcb_storage_t operation,
     (void)handle;
 }
 
-    static inline VALUE
-cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
+/* synchronous set/add/replace of the single key without options */
+    static VALUE
+cb_bucket_store_single(lcb_storage_t operation, struct cb_bucket_st *bucket, VALUE key, VALUE value)
+{
+    struct cb_context_st *ctx;
+    lcb_store_cmd_t cmd;
+    const lcb_store_cmd_t *ptr = &cmd;
+    lcb_uint32_t flags = bucket->default_flags;
+    lcb_error_t err;
+    VALUE prefixed, exc;
+
+    key = cb_unify_key_frozen(bucket, key, &prefixed);
+    value = cb_encode_value_bang(bucket->transcoder, key, value, &flags, Qnil);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.v.v0.operation = operation;
+    cmd.v.v0.key = RSTRING_PTR(prefixed);
+    cmd.v.v0.nkey = RSTRING_LEN(prefixed);
+    cmd.v.v0.bytes = RSTRING_PTR(value);
+    cmd.v.v0.nbytes = RSTRING_LEN(value);
+    cmd.v.v0.flags = flags;
+    cmd.v.v0.exptime = bucket->default_ttl;
+    ctx = cb_context_alloc_single(bucket, key);
+    err = lcb_store(bucket->handle, (const void *)ctx, 1, &ptr);
+    exc = cb_check_error(err, "failed to schedule set request", Qnil);
+    if (exc != Qnil) {
+        cb_context_free(ctx);
+        rb_exc_raise(exc);
+    }
+    bucket->nbytes += CB_PACKET_HEADER_SIZE + cmd.v.v0.nkey + cmd.v.v0.nbytes + sizeof(flags) + sizeof(cmd.v.v0.exptime);
+    cb_latency_record_size(bucket, cb_latency_set, cmd.v.v0.key, cmd.v.v0.nkey, cmd.v.v0.nbytes);
+    if (CB_PROBE_ENABLED(schedule)) {
+        CB_PROBE4(schedule, rb_id2name(SYM2ID(storage_opcode_to_sym(operation))),
+                cmd.v.v0.key, cmd.v.v0.nkey, cmd.v.v0.nbytes);
+    }
+    return cb_context_wait(ctx);
+}
+
+/* the body of the storage methods, prepared is NULL unless called by
+ * Prepared#call */
+    VALUE
+cb_bucket_store_prepared(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self, struct cb_prepared_st *prepared)
 {
     struct cb_bucket_st *bucket = DATA_PTR(self);
     struct cb_context_st *ctx;
@@ -124,6 +169,10 @@ cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
     if (!cb_bucket_connected_bang(bucket, storage_opcode_to_sym(cmd))) {
         return Qnil;
     }
+    if (prepared == NULL && argc == 2 && !bucket->async && !rb_block_given_p() && CB_SINGLE_KEY_P(argv[0]) &&
+            (cmd == LCB_SET || cmd == LCB_ADD || cmd == LCB_REPLACE)) {
+        return cb_bucket_store_single(cmd, bucket, argv[0], argv[1]);
+    }
     memset(&params, 0, sizeof(struct cb_params_st));
     rb_scan_args(argc, argv, "0*&", &params.args, &proc);
     if (!bucket->async && proc != Qnil) {
@@ -132,6 +181,7 @@ cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
     params.type = cb_cmd_store;
     params.bucket = bucket;
     params.cmd.store.operation = cmd;
+    params.prepared = prepared;
     cb_params_build(&params);
     obs = params.cmd.store.observe;
     ctx = cb_context_alloc(bucket);
@@ -140,23 +190,39 @@ cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
         ctx->observe_options = obs;
     }
     ctx->proc = proc;
+    if (bucket->async && params.batch) {
+        ctx->batch = rb_ary_new2(params.cmd.store.num);
+    }
     ctx->nqueries = params.cmd.store.num;
     err = lcb_store(bucket->handle, (const void *)ctx,
             params.cmd.store.num, params.cmd.store.ptr);
+    if (err == LCB_SUCCESS) {
+        size_t ii;
+        for (ii = 0; ii < params.cmd.store.num; ++ii) {
+            const lcb_store_cmd_t *cmd = params.cmd.store.ptr[ii];
+            cb_latency_record_size(bucket, cb_latency_set, cmd->v.v0.key,
+                    cmd->v.v0.nkey, cmd->v.v0.nbytes);
+            if (CB_PROBE_ENABLED(schedule)) {
+                CB_PROBE4(schedule, rb_id2name(SYM2ID(storage_opcode_to_sym(cmd->v.v0.operation))),
+                        cmd->v.v0.key, cmd->v.v0.nkey, cmd->v.v0.nbytes);
+            }
+        }
+    }
     cb_params_destroy(&params);
     exc = cb_check_error(err, "failed to schedule set request", Qnil);
     if (exc != Qnil) {
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_set_deadline(ctx, params.timeout);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
@@ -209,6 +275,14 @@ cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
  *   @option options [Hash] :observe Apply persistence condition before
  *     returning result. When this option specified the library will observe
  *     given condition. See {Bucket#observe_and_wait}.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @yieldparam ret [Result] the result of operation in asynchronous mode
  *     (valid attributes: +error+, +operation+, +key+).
@@ -279,7 +353,7 @@ cb_bucket_store(lcb_storage_t cmd, int argc, VALUE *argv, VALUE self)
     VALUE
 cb_bucket_set(int argc, VALUE *argv, VALUE self)
 {
-    return cb_bucket_store(LCB_SET, argc, argv, self);
+    return cb_bucket_store_prepared(LCB_SET, argc, argv, self, NULL);
 }
 
 /*
@@ -309,6 +383,14 @@ cb_bucket_set(int argc, VALUE *argv, VALUE self)
  *   @option options [Hash] :observe Apply persistence condition before
  *     returning result. When this option specified the library will observe
  *     given condition. See {Bucket#observe_and_wait}.
+ *   @option options [true, false] :batch_callback (false) In
+ *     asynchronous mode collect results for all keys of the call and
+ *     yield them once as an +Array+ of {Result} objects.
+ *   @option options [Fixnum] :timeout Deadline of the synchronous
+ *     operation in microseconds, independent of {Bucket#timeout}. When it
+ *     is reached the operation raises {Couchbase::Error::Timeout} and the
+ *     late responses are dropped. Asynchronous mode doesn't support
+ *     deadlines, there the option raises +ArgumentError+.
  *
  *   @yieldparam ret [Result] the result of operation in asynchronous mode
  *     (valid attributes: +error+, +operation+, +key+).
@@ -335,7 +417,7 @@ cb_bucket_set(int argc, VALUE *argv, VALUE self)
     VALUE
 cb_bucket_add(int argc, VALUE *argv, VALUE self)
 {
-    return cb_bucket_store(LCB_ADD, argc, argv, self);
+    return cb_bucket_store_prepared(LCB_ADD, argc, argv, self, NULL);
 }
 
 /*
@@ -383,7 +465,7 @@ cb_bucket_add(int argc, VALUE *argv, VALUE self)
     VALUE
 cb_bucket_replace(int argc, VALUE *argv, VALUE self)
 {
-    return cb_bucket_store(LCB_REPLACE, argc, argv, self);
+    return cb_bucket_store_prepared(LCB_REPLACE, argc, argv, self, NULL);
 }
 
 /*
@@ -463,7 +545,7 @@ cb_bucket_replace(int argc, VALUE *argv, VALUE self)
     VALUE
 cb_bucket_append(int argc, VALUE *argv, VALUE self)
 {
-    return cb_bucket_store(LCB_APPEND, argc, argv, self);
+    return cb_bucket_store_prepared(LCB_APPEND, argc, argv, self, NULL);
 }
 
 /*
@@ -522,7 +604,7 @@ cb_bucket_append(int argc, VALUE *argv, VALUE self)
     VALUE
 cb_bucket_prepend(int argc, VALUE *argv, VALUE self)
 {
-    return cb_bucket_store(LCB_PREPEND, argc, argv, self);
+    return cb_bucket_store_prepared(LCB_PREPEND, argc, argv, self, NULL);
 }
 
     VALUE
@@ -23,10 +23,13 @@ cb_touch_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE key, exc = Qnil, res;
+    struct cb_result_st *result;
 
     ctx->nqueries--;
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    if (CB_PROBE_ENABLED(response)) {
+        CB_PROBE5(response, "touch", resp->v.v0.key, resp->v.v0.nkey, 0, gethrtime() - ctx->start);
+    }
 
     if (error != LCB_KEY_ENOENT || !ctx->quiet) {
         exc = cb_check_error(error, "failed to touch value", key);
@@ -38,17 +41,18 @@ cb_touch_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb
 
     if (bucket->async) {    /* asynchronous */
         if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_operation, cb_sym_touch);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->operation = cb_sym_touch;
+            result->key = key;
+            cb_context_yield(ctx, res);
         }
     } else {                /* synchronous */
-        rb_hash_aset(ctx->rv, key, (error == LCB_SUCCESS) ? Qtrue : Qfalse);
+        cb_context_set_result(ctx, key, (error == LCB_SUCCESS) ? Qtrue : Qfalse);
     }
     if (ctx->nqueries == 0) {
         ctx->proc = Qnil;
+        cb_context_complete(ctx);
         if (bucket->async) {
             cb_context_free(ctx);
         }
@@ -56,6 +60,33 @@ cb_touch_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lcb
     (void)handle;
 }
 
+/* synchronous touch of the single key without options */
+    static VALUE
+cb_bucket_touch_single(struct cb_bucket_st *bucket, VALUE key)
+{
+    struct cb_context_st *ctx;
+    lcb_touch_cmd_t cmd;
+    const lcb_touch_cmd_t *ptr = &cmd;
+    lcb_error_t err;
+    VALUE prefixed, exc;
+
+    key = cb_unify_key_frozen(bucket, key, &prefixed);
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.v.v0.key = RSTRING_PTR(prefixed);
+    cmd.v.v0.nkey = RSTRING_LEN(prefixed);
+    cmd.v.v0.exptime = bucket->default_ttl;
+    ctx = cb_context_alloc_single(bucket, key);
+    ctx->quiet = bucket->quiet;
+    err = lcb_touch(bucket->handle, (const void *)ctx, 1, &ptr);
+    exc = cb_check_error(err, "failed to schedule touch request", Qnil);
+    if (exc != Qnil) {
+        cb_context_free(ctx);
+        rb_exc_raise(exc);
+    }
+    bucket->nbytes += CB_PACKET_HEADER_SIZE + cmd.v.v0.nkey + sizeof(cmd.v.v0.exptime);
+    return cb_context_wait(ctx);
+}
+
 /*
  * Update the expiry time of an item
  *
@@ -133,6 +164,9 @@ cb_bucket_touch(int argc, VALUE *argv, VALUE self)
     if (!cb_bucket_connected_bang(bucket, cb_sym_touch)) {
         return Qnil;
     }
+    if (argc == 1 && !bucket->async && !rb_block_given_p() && CB_SINGLE_KEY_P(argv[0])) {
+        return cb_bucket_touch_single(bucket, argv[0]);
+    }
 
     memset(&params, 0, sizeof(struct cb_params_st));
     rb_scan_args(argc, argv, "0*&", &params.args, &proc);
@@ -144,6 +178,7 @@ cb_bucket_touch(int argc, VALUE *argv, VALUE self)
     params.bucket = bucket;
     cb_params_build(&params);
     ctx = cb_context_alloc_common(bucket, proc, params.cmd.touch.num);
+    cb_context_index_init(ctx, params.keys);
     ctx->quiet = params.cmd.touch.quiet;
     err = lcb_touch(bucket->handle, (const void *)ctx,
             params.cmd.touch.num, params.cmd.touch.ptr);
@@ -153,14 +188,14 @@ cb_bucket_touch(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
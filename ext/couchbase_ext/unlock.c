@@ -23,10 +23,13 @@ cb_unlock_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lc
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE key, exc = Qnil, res;
+    struct cb_result_st *result;
 
     ctx->nqueries--;
-    key = STR_NEW((const char*)resp->v.v0.key, resp->v.v0.nkey);
-    cb_strip_key_prefix(bucket, key);
+    key = cb_context_key(ctx, resp->v.v0.key, resp->v.v0.nkey);
+    if (CB_PROBE_ENABLED(response)) {
+        CB_PROBE5(response, "unlock", resp->v.v0.key, resp->v.v0.nkey, 0, gethrtime() - ctx->start);
+    }
 
     if (error != LCB_KEY_ENOENT || !ctx->quiet) {
         exc = cb_check_error(error, "failed to unlock value", key);
@@ -38,17 +41,18 @@ cb_unlock_callback(lcb_t handle, const void *cookie, lcb_error_t error, const lc
 
     if (bucket->async) {    /* asynchronous */
         if (ctx->proc != Qnil) {
-            res = rb_class_new_instance(0, NULL, cb_cResult);
-            rb_ivar_set(res, cb_id_iv_error, exc);
-            rb_ivar_set(res, cb_id_iv_operation, cb_sym_unlock);
-            rb_ivar_set(res, cb_id_iv_key, key);
-            cb_proc_call(bucket, ctx->proc, 1, res);
+            res = cb_result_new(&result);
+            result->error = exc;
+            result->operation = cb_sym_unlock;
+            result->key = key;
+            cb_context_yield(ctx, res);
         }
     } else {                /* synchronous */
         rb_hash_aset(ctx->rv, key, (error == LCB_SUCCESS) ? Qtrue : Qfalse);
     }
     if (ctx->nqueries == 0) {
         ctx->proc = Qnil;
+        cb_context_complete(ctx);
         if (bucket->async) {
             cb_context_free(ctx);
         }
@@ -134,6 +138,7 @@ cb_bucket_unlock(int argc, VALUE *argv, VALUE self)
     params.bucket = bucket;
     cb_params_build(&params);
     ctx = cb_context_alloc_common(bucket, proc, params.cmd.unlock.num);
+    cb_context_index_init(ctx, params.keys);
     ctx->quiet = params.cmd.unlock.quiet;
     err = lcb_unlock(bucket->handle, (const void *)ctx,
             params.cmd.unlock.num, params.cmd.unlock.ptr);
@@ -143,14 +148,14 @@ cb_bucket_unlock(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
     } else {
         if (ctx->nqueries > 0) {
             /* we have some operations pending */
-            lcb_wait(bucket->handle);
+            cb_context_wait_responses(ctx);
         }
         exc = ctx->exception;
         rv = ctx->rv;
@@ -113,7 +113,7 @@ cb_proc_call(struct cb_bucket_st *bucket, VALUE recv, int argc, ...)
     }
     if (arity > 0) {
         va_init_list(ar, argc);
-        argv = ALLOCA_N(VALUE, argc);
+        argv = ALLOCA_N(VALUE, arity);
         for (ii = 0; ii < arity; ++ii) {
             if (ii < argc) {
                 argv[ii] = va_arg(ar, VALUE);
@@ -135,6 +135,61 @@ cb_proc_call(struct cb_bucket_st *bucket, VALUE recv, int argc, ...)
             rb_eException, (VALUE)0);
 }
 
+/* Deliver the result to the block of the context. The arity of the
+ * block is looked up once per context. When the context collects
+ * results in batch (:batch_callback option), the result is just
+ * appended to the batch and will be yielded by cb_context_flush_batch() */
+    void
+cb_context_yield(struct cb_context_st *ctx, VALUE res)
+{
+    struct proc_params_st params;
+    VALUE argv[1];
+
+    if (NIL_P(ctx->proc)) {
+        return;
+    }
+    if (!NIL_P(ctx->batch)) {
+        rb_ary_push(ctx->batch, res);
+        return;
+    }
+    if (ctx->arity == CB_ARITY_UNKNOWN) {
+        ctx->arity = FIX2INT(rb_funcall(ctx->proc, cb_id_arity, 0));
+    }
+    argv[0] = res;
+    params.bucket = ctx->bucket;
+    params.recv = ctx->proc;
+    params.mid = cb_id_call;
+    params.argc = ctx->arity == 0 ? 0 : 1;
+    params.argv = argv;
+    if (ctx->arity > 1) {
+        int ii;
+        params.argc = ctx->arity;
+        params.argv = ALLOCA_N(VALUE, ctx->arity);
+        params.argv[0] = res;
+        for (ii = 1; ii < ctx->arity; ++ii) {
+            params.argv[ii] = Qnil;
+        }
+    }
+    rb_rescue2(do_func_call, (VALUE)&params,
+            func_call_failed, (VALUE)&params,
+            rb_eException, (VALUE)0);
+}
+
+/* Yield results collected for :batch_callback as single array */
+    void
+cb_context_flush_batch(struct cb_context_st *ctx)
+{
+    VALUE batch = ctx->batch;
+
+    if (NIL_P(batch)) {
+        return;
+    }
+    ctx->batch = Qnil;
+    if (RARRAY_LEN(batch) > 0) {
+        cb_context_yield(ctx, batch);
+    }
+}
+
 VALUE
 cb_hash_delete(VALUE hash, VALUE key)
 {
@@ -427,26 +482,81 @@ coding_failed(VALUE unused, VALUE exc)
     return exc;
 }
 
-    VALUE
-cb_encode_value(VALUE transcoder, VALUE val, uint32_t *flags, VALUE options)
+/* Fast paths for the stock transcoders (Couchbase::Transcoder::Plain,
+ * ::Marshal and ::Document). They replicate the behaviour of the ruby
+ * modules, but skip method dispatch and do not set up rescue frames
+ * when the conversion cannot raise. */
+
+    static VALUE
+do_marshal_dump(VALUE val)
+{
+    return rb_marshal_dump(val, Qnil);
+}
+
+    static VALUE
+do_marshal_load(VALUE blob)
+{
+    return rb_marshal_load(blob);
+}
+
+    static VALUE
+do_json_dump(VALUE val)
+{
+    if (cb_json_native) {
+        return cb_json_dump(val);
+    }
+    return rb_funcall(cb_mMultiJson, cb_id_dump, 1, val);
+}
+
+    static VALUE
+do_json_load(VALUE blob)
+{
+    if (cb_json_native) {
+        return cb_json_load(blob);
+    }
+    return rb_funcall(cb_mMultiJson, cb_id_load, 1, blob);
+}
+
+    static int
+transcoder_forced_p(VALUE options)
+{
+    return TYPE(options) == T_HASH
+        && RTEST(rb_hash_lookup2(options, cb_sym_forced, Qfalse));
+}
+
+    static VALUE
+encode_value(VALUE transcoder, VALUE val, uint32_t *flags, VALUE options)
 {
     VALUE args[4];
 
+    /* if nil, just pass value through */
+    if (NIL_P(transcoder)) {
+        return val;
+    }
+    if (transcoder == cb_mPlain) {
+        *flags = (*flags & ~CB_FMT_MASK) | CB_FMT_PLAIN;
+        return val;
+    }
+    if (transcoder == cb_mMarshal) {
+        *flags = (*flags & ~CB_FMT_MASK) | CB_FMT_MARSHAL;
+        return rb_rescue(do_marshal_dump, val, coding_failed, 0);
+    }
+    if (transcoder == cb_mDocument) {
+        *flags = (*flags & ~CB_FMT_MASK) | CB_FMT_DOCUMENT;
+        return rb_rescue(do_json_dump, val, coding_failed, 0);
+    }
+
     args[0] = val;
     args[1] = (VALUE)flags;
     args[2] = transcoder;
-    args[3] = options;
+    args[3] = NIL_P(options) ? rb_hash_new() : options;
 
-    /* if nil, just pass value through */
-    if (NIL_P(args[2])) {
-        return val;
-    }
     /* bytestring or exception object */
     return rb_rescue(do_encode, (VALUE)args, coding_failed, 0);
 }
 
-    VALUE
-cb_decode_value(VALUE transcoder, VALUE blob, uint32_t flags, VALUE options)
+    static VALUE
+decode_value(VALUE transcoder, VALUE blob, uint32_t flags, VALUE options)
 {
     VALUE args[4];
 
@@ -454,19 +564,93 @@ cb_decode_value(VALUE transcoder, VALUE blob, uint32_t flags, VALUE options)
     if (TYPE(blob) != T_STRING) {
         return Qundef;
     }
-    args[0] = blob;
-    args[1] = (VALUE)flags;
-    args[2] = transcoder;
-    args[3] = options;
 
     /* if nil, just pass blob through */
-    if (NIL_P(args[2])) {
+    if (NIL_P(transcoder)) {
         return blob;
     }
+    /* stock transcoders with matching flags. On mismatch fall through
+     * to ruby implementation, which knows about Transcoder::Compat */
+    if (transcoder == cb_mPlain) {
+        if ((flags & CB_FMT_MASK) == CB_FMT_PLAIN || transcoder_forced_p(options)) {
+            return blob;
+        }
+    } else if (transcoder == cb_mMarshal) {
+        if ((flags & CB_FMT_MASK) == CB_FMT_MARSHAL || transcoder_forced_p(options)) {
+            return rb_rescue(do_marshal_load, blob, coding_failed, 0);
+        }
+    } else if (transcoder == cb_mDocument) {
+        if ((flags & CB_FMT_MASK) == CB_FMT_DOCUMENT || transcoder_forced_p(options)) {
+            return rb_rescue(do_json_load, blob, coding_failed, 0);
+        }
+    }
+
+    args[0] = blob;
+    args[1] = (VALUE)flags;
+    args[2] = transcoder;
+    args[3] = NIL_P(options) ? rb_hash_new() : options;
+
     /* the value or exception object */
     return rb_rescue(do_decode, (VALUE)args, coding_failed, 0);
 }
 
+    VALUE
+cb_encode_value(VALUE transcoder, VALUE val, uint32_t *flags, VALUE options)
+{
+    hrtime_t start;
+    VALUE blob;
+
+    if (!CB_PROBE_ENABLED(encode)) {
+        return encode_value(transcoder, val, flags, options);
+    }
+    start = gethrtime();
+    blob = encode_value(transcoder, val, flags, options);
+    CB_PROBE3(encode, *flags, TYPE(blob) == T_STRING ? RSTRING_LEN(blob) : 0,
+            gethrtime() - start);
+    return blob;
+}
+
+    VALUE
+cb_decode_value(VALUE transcoder, VALUE blob, uint32_t flags, VALUE options)
+{
+    hrtime_t start;
+    VALUE val;
+
+    if (!CB_PROBE_ENABLED(decode)) {
+        return decode_value(transcoder, blob, flags, options);
+    }
+    start = gethrtime();
+    val = decode_value(transcoder, blob, flags, options);
+    CB_PROBE3(decode, flags, TYPE(blob) == T_STRING ? RSTRING_LEN(blob) : 0,
+            gethrtime() - start);
+    return val;
+}
+
+/*
+ * Same as cb_encode_value(), but raises ValueFormatError when the
+ * transcoder fails or returns something other than String.
+ */
+    VALUE
+cb_encode_value_bang(VALUE transcoder, VALUE key, VALUE val, uint32_t *flags, VALUE options)
+{
+    VALUE ret = cb_encode_value(transcoder, val, flags, options);
+
+    if (rb_obj_is_kind_of(ret, rb_eStandardError)) {
+        VALUE exc_str = rb_funcall(ret, cb_id_to_s, 0);
+        VALUE msg = rb_funcall(rb_mKernel, cb_id_sprintf, 3,
+                rb_str_new2("unable to convert value for key \"%s\": %s"), key, exc_str);
+        VALUE exc = rb_exc_new3(cb_eValueFormatError, msg);
+        rb_ivar_set(exc, cb_id_iv_inner_exception, ret);
+        rb_exc_raise(exc);
+    }
+    /* the value must be string after conversion */
+    if (TYPE(ret) != T_STRING) {
+        VALUE str = rb_any_to_s(ret);
+        rb_raise(cb_eValueFormatError, "unable to convert value for key \"%s\" to string: %s", RSTRING_PTR(key), RSTRING_PTR(str));
+    }
+    return ret;
+}
+
     void
 cb_strip_key_prefix(struct cb_bucket_st *bucket, VALUE key)
 {
@@ -549,3 +733,21 @@ rb_hash_lookup2(VALUE hash, VALUE key, VALUE dflt)
     return dflt;
 }
 #endif
+
+/*
+ * Convert the key to frozen String without prefix, which is handed back to
+ * the caller in the results. *prefixed receives the String to be sent to
+ * the server.
+ */
+    VALUE
+cb_unify_key_frozen(struct cb_bucket_st *bucket, VALUE key, VALUE *prefixed)
+{
+    VALUE ret = rb_str_new4(cb_unify_key(bucket, key, 0));
+
+    if (RTEST(bucket->key_prefix_val)) {
+        *prefixed = rb_str_plus(bucket->key_prefix_val, ret);
+    } else {
+        *prefixed = ret;
+    }
+    return ret;
+}
@@ -23,6 +23,7 @@ cb_version_callback(lcb_t handle, const void *cookie, lcb_error_t error, const l
     struct cb_context_st *ctx = (struct cb_context_st *)cookie;
     struct cb_bucket_st *bucket = ctx->bucket;
     VALUE node, val, exc, res;
+    struct cb_result_st *result;
 
     node = resp->v.v0.server_endpoint ? STR_NEW_CSTR(resp->v.v0.server_endpoint) : Qnil;
     exc = cb_check_error(error, "failed to get version", node);
@@ -35,12 +36,12 @@ cb_version_callback(lcb_t handle, const void *cookie, lcb_error_t error, const l
         val = STR_NEW((const char*)resp->v.v0.vstring, resp->v.v0.nvstring);
         if (bucket->async) {    /* asynchronous */
             if (ctx->proc != Qnil) {
-                res = rb_class_new_instance(0, NULL, cb_cResult);
-                rb_ivar_set(res, cb_id_iv_error, exc);
-                rb_ivar_set(res, cb_id_iv_operation, cb_sym_version);
-                rb_ivar_set(res, cb_id_iv_node, node);
-                rb_ivar_set(res, cb_id_iv_value, val);
-                cb_proc_call(bucket, ctx->proc, 1, res);
+                res = cb_result_new(&result);
+                result->error = exc;
+                result->operation = cb_sym_version;
+                result->node = node;
+                result->value = val;
+                cb_context_yield(ctx, res);
             }
         } else {                /* synchronous */
             if (NIL_P(exc)) {
@@ -115,7 +116,7 @@ cb_bucket_version(int argc, VALUE *argv, VALUE self)
         cb_context_free(ctx);
         rb_exc_raise(exc);
     }
-    bucket->nbytes += params.npayload;
+    cb_context_scheduled(ctx, params.npayload);
     if (bucket->async) {
         cb_maybe_do_loop(bucket);
         return Qnil;
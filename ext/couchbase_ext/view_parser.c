@@ -0,0 +1,459 @@
+/* vim: ft=c et ts=8 sts=4 sw=4 cino=
+ *
+ *   Copyright 2011, 2012 Couchbase, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "couchbase_ext.h"
+
+/*
+ * Streaming parser of the view response envelope:
+ *
+ *   {"total_rows":N,"rows":[{...},...],"errors":[{...},...]}
+ *
+ * The chunks are accumulated in the buffer only until the current
+ * top-level element (the row, the error or total_rows) is complete, then
+ * the element is decoded directly into ruby objects (see cb_json_parse)
+ * and passed to the callback, and the buffer is reused. The paths passed to the callback
+ * are the same as YAJI uses: "/total_rows", "/rows/" and "/errors/".
+ */
+
+enum cb_view_parser_state {
+    cb_vp_start = 0,    /* before envelope '{' */
+    cb_vp_key,          /* before envelope key or '}' */
+    cb_vp_colon,        /* before ':' */
+    cb_vp_value,        /* before envelope value */
+    cb_vp_element,      /* before array element or ']' */
+    cb_vp_element_next, /* before ',' or ']' in array */
+    cb_vp_next_key,     /* before ',' or '}' in envelope */
+    cb_vp_done
+};
+
+enum cb_view_parser_key {
+    cb_vp_key_other = 0,
+    cb_vp_key_total_rows,
+    cb_vp_key_rows,
+    cb_vp_key_errors
+};
+
+    static void
+vp_error(const char *reason)
+{
+    rb_raise(cb_eValueFormatError, "unable to parse view response: %s", reason);
+}
+
+    static const char *
+vp_skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+/* returns pointer to the closing quote or NULL if the string is incomplete */
+    static const char *
+vp_string_end(const char *p, const char *end)
+{
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns pointer right after the JSON value started at +p+ or NULL if
+ * the value isn't complete yet. Doesn't validate the value, it is done
+ * by cb_json_parse.
+ */
+    static const char *
+vp_skip_value(const char *p, const char *end)
+{
+    int depth = 0;
+
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        p = vp_string_end(p, end);
+        return p ? p + 1 : NULL;
+    }
+    if (*p != '{' && *p != '[') {
+        /* scalar: it is complete only if followed by the delimiter */
+        for (; p < end; p++) {
+            if (*p == ',' || *p == '}' || *p == ']' || *p == ' ' ||
+                    *p == '\t' || *p == '\n' || *p == '\r') {
+                return p;
+            }
+        }
+        return NULL;
+    }
+    for (; p < end; p++) {
+        switch (*p) {
+            case '"':
+                p = vp_string_end(p, end);
+                if (p == NULL) {
+                    return NULL;
+                }
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0) {
+                    return p + 1;
+                }
+                break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Decodes only "id", "key" and "value" of the row into frozen array. The
+ * rest of the row (e.g. "doc") is skipped without allocations.
+ */
+    static VALUE
+vp_decode_compact_row(const char *p, const char *end)
+{
+    VALUE id = Qnil, key = Qnil, value = Qnil, row;
+
+    if (*p != '{') {
+        vp_error("row should be an object");
+    }
+    p = vp_skip_ws(p + 1, end);
+    while (p < end && *p != '}') {
+        const char *name = p + 1, *name_end = vp_string_end(p, end);
+        size_t len;
+
+        if (*p != '"' || name_end == NULL) {
+            vp_error("expected object key");
+        }
+        len = name_end - name;
+        p = vp_skip_ws(name_end + 1, end);
+        if (p >= end || *p != ':') {
+            vp_error("expected ':'");
+        }
+        p = vp_skip_ws(p + 1, end);
+        if (len == 2 && memcmp(name, "id", 2) == 0) {
+            id = cb_json_parse(&p, end, cb_eValueFormatError);
+        } else if (len == 3 && memcmp(name, "key", 3) == 0) {
+            key = cb_json_parse(&p, end, cb_eValueFormatError);
+        } else if (len == 5 && memcmp(name, "value", 5) == 0) {
+            value = cb_json_parse(&p, end, cb_eValueFormatError);
+        } else {
+            p = vp_skip_value(p, end);
+            if (p == NULL) {
+                vp_error("unexpected end of data");
+            }
+        }
+        p = vp_skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p = vp_skip_ws(p + 1, end);
+        }
+    }
+    if (TYPE(id) == T_STRING) {
+        rb_obj_freeze(id);
+    }
+    row = rb_ary_new3(3, id, key, value);
+    return rb_obj_freeze(row);
+}
+
+    static void
+vp_emit(struct cb_view_parser_st *parser, VALUE path, const char *ptr, const char *end, int compact)
+{
+    VALUE obj;
+
+    if (compact) {
+        obj = vp_decode_compact_row(ptr, end);
+    } else {
+        obj = cb_json_parse(&ptr, end, cb_eValueFormatError);
+        if (vp_skip_ws(ptr, end) != end) {
+            vp_error("unexpected data after value");
+        }
+    }
+    if (parser->on_object != Qnil) {
+        rb_funcall(parser->on_object, cb_id_call, 2, path, obj);
+    }
+}
+
+    static enum cb_view_parser_key
+vp_classify_key(const char *name, size_t len)
+{
+    if (len == 10 && memcmp(name, "total_rows", 10) == 0) {
+        return cb_vp_key_total_rows;
+    } else if (len == 4 && memcmp(name, "rows", 4) == 0) {
+        return cb_vp_key_rows;
+    } else if (len == 6 && memcmp(name, "errors", 6) == 0) {
+        return cb_vp_key_errors;
+    }
+    return cb_vp_key_other;
+}
+
+/*
+ * Advances the state machine as far as the buffer allows. The position
+ * is saved before each callback, so that the parser stays consistent if
+ * the callback raises.
+ */
+    static void
+vp_parse(struct cb_view_parser_st *parser)
+{
+    for (;;) {
+        const char *end = parser->buf + parser->len;
+        const char *p = vp_skip_ws(parser->buf + parser->pos, end), *q;
+
+        parser->pos = p - parser->buf;
+        if (p == end) {
+            return;
+        }
+        switch (parser->state) {
+            case cb_vp_start:
+                if (*p != '{') {
+                    vp_error("expected '{'");
+                }
+                parser->pos++;
+                parser->state = cb_vp_key;
+                break;
+            case cb_vp_key:
+                if (*p == '}') {
+                    parser->pos++;
+                    parser->state = cb_vp_done;
+                    break;
+                }
+                if (*p != '"') {
+                    vp_error("expected object key");
+                }
+                q = vp_string_end(p, end);
+                if (q == NULL) {
+                    return;
+                }
+                parser->key = vp_classify_key(p + 1, q - p - 1);
+                parser->pos = q + 1 - parser->buf;
+                parser->state = cb_vp_colon;
+                break;
+            case cb_vp_colon:
+                if (*p != ':') {
+                    vp_error("expected ':'");
+                }
+                parser->pos++;
+                parser->state = cb_vp_value;
+                break;
+            case cb_vp_value:
+                if (*p == '[' && (parser->key == cb_vp_key_rows || parser->key == cb_vp_key_errors)) {
+                    parser->pos++;
+                    parser->state = cb_vp_element;
+                    break;
+                }
+                q = vp_skip_value(p, end);
+                if (q == NULL) {
+                    return;
+                }
+                parser->pos = q - parser->buf;
+                parser->state = cb_vp_next_key;
+                if (parser->key == cb_vp_key_total_rows) {
+                    vp_emit(parser, parser->path_total_rows, p, q, 0);
+                }
+                break;
+            case cb_vp_element:
+                if (*p == ']') {
+                    parser->pos++;
+                    parser->state = cb_vp_next_key;
+                    break;
+                }
+                q = vp_skip_value(p, end);
+                if (q == NULL) {
+                    return;
+                }
+                parser->pos = q - parser->buf;
+                parser->state = cb_vp_element_next;
+                if (parser->key == cb_vp_key_rows) {
+                    vp_emit(parser, parser->path_rows, p, q, parser->compact);
+                } else {
+                    vp_emit(parser, parser->path_errors, p, q, 0);
+                }
+                break;
+            case cb_vp_element_next:
+                if (*p == ',') {
+                    parser->state = cb_vp_element;
+                } else if (*p == ']') {
+                    parser->state = cb_vp_next_key;
+                } else {
+                    vp_error("expected ',' or ']'");
+                }
+                parser->pos++;
+                break;
+            case cb_vp_next_key:
+                if (*p == ',') {
+                    parser->state = cb_vp_key;
+                } else if (*p == '}') {
+                    parser->state = cb_vp_done;
+                } else {
+                    vp_error("expected ',' or '}'");
+                }
+                parser->pos++;
+                break;
+            case cb_vp_done:
+                vp_error("unexpected data after the end of response");
+        }
+    }
+}
+
+    void
+cb_view_parser_free(void *ptr)
+{
+    struct cb_view_parser_st *parser = ptr;
+    if (parser) {
+        xfree(parser->buf);
+    }
+    xfree(parser);
+}
+
+    void
+cb_view_parser_mark(void *ptr)
+{
+    struct cb_view_parser_st *parser = ptr;
+    if (parser) {
+        rb_gc_mark(parser->on_object);
+        rb_gc_mark(parser->path_total_rows);
+        rb_gc_mark(parser->path_rows);
+        rb_gc_mark(parser->path_errors);
+    }
+}
+
+    VALUE
+cb_view_parser_alloc(VALUE klass)
+{
+    VALUE obj;
+    struct cb_view_parser_st *parser;
+
+    /* allocate new parser struct and set it to zero */
+    obj = Data_Make_Struct(klass, struct cb_view_parser_st, cb_view_parser_mark,
+            cb_view_parser_free, parser);
+    parser->on_object = Qnil;
+    parser->path_total_rows = rb_obj_freeze(STR_NEW_CSTR("/total_rows"));
+    parser->path_rows = rb_obj_freeze(STR_NEW_CSTR("/rows/"));
+    parser->path_errors = rb_obj_freeze(STR_NEW_CSTR("/errors/"));
+    return obj;
+}
+
+/*
+ * Initialize new ViewParser
+ *
+ * @since 1.3.8
+ *
+ * @param [Hash] options
+ * @option options [true, false] :compact (false) yield rows as frozen
+ *   arrays +[id, key, value]+ instead of hashes. The rest of the row
+ *   isn't decoded.
+ *
+ * @return [ViewParser]
+ */
+    VALUE
+cb_view_parser_init(int argc, VALUE *argv, VALUE self)
+{
+    struct cb_view_parser_st *parser = DATA_PTR(self);
+    VALUE opts;
+
+    rb_scan_args(argc, argv, "01", &opts);
+    if (opts != Qnil) {
+        Check_Type(opts, T_HASH);
+        parser->compact = RTEST(rb_hash_aref(opts, cb_sym_compact));
+    }
+    if (rb_block_given_p()) {
+        parser->on_object = rb_block_proc();
+    }
+    return self;
+}
+
+/*
+ * Set callback for the parsed objects
+ *
+ * @since 1.3.8
+ *
+ * @yieldparam [String] path +"/total_rows"+, +"/rows/"+ or +"/errors/"+
+ * @yieldparam [Hash, Array, Fixnum] obj the decoded object
+ *
+ * @return [Proc] the previous callback
+ */
+    VALUE
+cb_view_parser_on_object(VALUE self)
+{
+    struct cb_view_parser_st *parser = DATA_PTR(self);
+    VALUE old = parser->on_object;
+
+    if (rb_block_given_p()) {
+        parser->on_object = rb_block_proc();
+    }
+    return old;
+}
+
+/*
+ * Feed the chunk of the response to the parser
+ *
+ * @since 1.3.8
+ *
+ * The callback is executed for each object completed by this chunk.
+ *
+ * @param [String] chunk
+ *
+ * @raise [Couchbase::Error::ValueFormat] if the response is malformed
+ *
+ * @return [ViewParser] self
+ */
+    VALUE
+cb_view_parser_feed(VALUE self, VALUE chunk)
+{
+    struct cb_view_parser_st *parser = DATA_PTR(self);
+    size_t len;
+
+    Check_Type(chunk, T_STRING);
+    len = RSTRING_LEN(chunk);
+    /* drop consumed data */
+    if (parser->pos > 0) {
+        parser->len -= parser->pos;
+        memmove(parser->buf, parser->buf + parser->pos, parser->len);
+        parser->pos = 0;
+    }
+    if (parser->len + len > parser->cap) {
+        size_t cap = parser->cap ? parser->cap : 4096;
+        while (cap < parser->len + len) {
+            cap *= 2;
+        }
+        parser->buf = xrealloc(parser->buf, cap);
+        parser->cap = cap;
+    }
+    memcpy(parser->buf + parser->len, RSTRING_PTR(chunk), len);
+    parser->len += len;
+    vp_parse(parser);
+    return self;
+}
+
+/* Document-method: compact
+ *
+ * @since 1.3.8
+ *
+ * @return [Boolean] +true+ if the rows are yielded as frozen arrays
+ */
+    VALUE
+cb_view_parser_compact_get(VALUE self)
+{
+    struct cb_view_parser_st *parser = DATA_PTR(self);
+    return parser->compact ? Qtrue : Qfalse;
+}
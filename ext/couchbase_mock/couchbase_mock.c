@@ -0,0 +1,1529 @@
+/* vim: ft=c et ts=8 sts=4 sw=4 cino=
+ *
+ *   Copyright 2011, 2012 Couchbase, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Lightweight mock of the Couchbase cluster for the tests and benchmarks.
+ * Compatible with the command line of CouchbaseMock.jar:
+ *
+ *   couchbase_mock [--host HOST] [--port PORT] [--nodes N]
+ *                  [--vbuckets N] [--buckets SPEC] [--latency-us USEC]
+ *                  [--harakiri-monitor=HOST:PORT]
+ *
+ * Each node listens the REST port (cluster configuration and views) and
+ * the memcached binary protocol port. The data is shared by the nodes,
+ * they are just different entry points. The responses are delayed by
+ * --latency-us microseconds.
+ *
+ * When --harakiri-monitor is given, the mock connects to it, sends the
+ * REST port of the first node, and exits when the connection is closed.
+ * The monitor can send commands "failover,INDEX,BUCKET" and
+ * "respawn,INDEX,BUCKET", one per write like the java mock expects, or
+ * separated by new lines. Failover closes the
+ * node and moves its vbuckets to other nodes, respawn brings it back.
+ * Otherwise the REST port is written to stdout.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NODES 64
+#define MAX_BUCKETS 16
+#define TABLE_SIZE (1 << 16)
+#define HEADER_SIZE 24
+
+#define REQ_MAGIC 0x80
+#define RES_MAGIC 0x81
+
+#define CMD_GET 0x00
+#define CMD_SET 0x01
+#define CMD_ADD 0x02
+#define CMD_REPLACE 0x03
+#define CMD_DELETE 0x04
+#define CMD_INCR 0x05
+#define CMD_DECR 0x06
+#define CMD_QUIT 0x07
+#define CMD_FLUSH 0x08
+#define CMD_GETQ 0x09
+#define CMD_NOOP 0x0a
+#define CMD_VERSION 0x0b
+#define CMD_GETK 0x0c
+#define CMD_GETKQ 0x0d
+#define CMD_APPEND 0x0e
+#define CMD_PREPEND 0x0f
+#define CMD_STAT 0x10
+#define CMD_TOUCH 0x1c
+#define CMD_GAT 0x1d
+#define CMD_GATQ 0x1e
+#define CMD_SASL_LIST_MECHS 0x20
+#define CMD_SASL_AUTH 0x21
+#define CMD_OBSERVE 0x92
+#define CMD_GETL 0x94
+#define CMD_UNLOCK 0x95
+#define CMD_GET_CLUSTER_CONFIG 0xb5
+
+#define ST_SUCCESS 0x00
+#define ST_KEY_ENOENT 0x01
+#define ST_KEY_EEXISTS 0x02
+#define ST_E2BIG 0x03
+#define ST_EINVAL 0x04
+#define ST_NOT_STORED 0x05
+#define ST_DELTA_BADVAL 0x06
+#define ST_AUTH_ERROR 0x20
+#define ST_UNKNOWN_COMMAND 0x81
+#define ST_ETMPFAIL 0x86
+
+#define OBS_FOUND 0x00
+#define OBS_PERSISTED 0x01
+#define OBS_NOT_FOUND 0x80
+
+/* view results are written in pieces with a pause between them, so that
+ * the clients receive them in several chunks like from the real server */
+#define VIEW_PIECE_SIZE 4096
+#define VIEW_PIECE_DELAY 1000000 /* ns */
+
+#define REALTIME_MAXDELTA (60 * 60 * 24 * 30)
+#define DEFAULT_LOCK_TIME 15
+#define MAX_LOCK_TIME 30
+
+typedef uint64_t hrtime_t;
+
+typedef struct {
+    char *ptr;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+typedef struct item_st {
+    struct item_st *next;
+    uint64_t cas;
+    uint32_t flags;
+    time_t exptime;         /* absolute time, zero if never expires */
+    time_t locked_until;    /* zero if not locked */
+    uint16_t nkey;
+    uint32_t nbytes;
+    char *data;             /* key followed by the value */
+} item_t;
+
+typedef struct {
+    char name[128];
+    char password[128];
+    item_t **table;
+    size_t nitems;
+} bucket_t;
+
+typedef struct {
+    int kv_fd;
+    int rest_fd;
+    int kv_port;
+    int rest_port;
+    int failed;
+} node_t;
+
+enum conn_type {
+    CONN_KV,
+    CONN_REST,
+    CONN_MONITOR
+};
+
+typedef struct chunk_st {
+    struct chunk_st *next;
+    hrtime_t due;
+    size_t len;
+    size_t off;
+    char data[1];
+} chunk_t;
+
+typedef struct {
+    int fd;
+    enum conn_type type;
+    int node;
+    bucket_t *bucket;
+    int streaming;          /* REST connection subscribed to configuration updates */
+    int close_after_flush;
+    buf_t in;
+    chunk_t *out_head;
+    chunk_t *out_tail;
+} conn_t;
+
+static const char *host = "127.0.0.1";
+static int base_port = 0;
+static int nnodes = 1;
+static int nvbuckets = 64;
+static hrtime_t latency = 0;
+static node_t nodes[MAX_NODES];
+static bucket_t buckets[MAX_BUCKETS];
+static int nbuckets = 0;
+static conn_t **conns = NULL;
+static size_t nconns = 0;
+static uint64_t next_cas = 1;
+
+    static void
+die(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+    static void *
+xrealloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        die("couchbase_mock: out of memory");
+    }
+    return ptr;
+}
+
+    static hrtime_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (hrtime_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* buffers */
+
+    static void
+buf_reserve(buf_t *buf, size_t size)
+{
+    if (buf->len + size > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (cap < buf->len + size) {
+            cap *= 2;
+        }
+        buf->ptr = xrealloc(buf->ptr, cap);
+        buf->cap = cap;
+    }
+}
+
+    static void
+buf_append(buf_t *buf, const void *data, size_t len)
+{
+    buf_reserve(buf, len);
+    memcpy(buf->ptr + buf->len, data, len);
+    buf->len += len;
+}
+
+    static void
+buf_printf(buf_t *buf, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    buf_reserve(buf, len + 1);
+    va_start(ap, fmt);
+    vsnprintf(buf->ptr + buf->len, len + 1, fmt, ap);
+    va_end(ap);
+    buf->len += len;
+}
+
+    static void
+buf_json_string(buf_t *buf, const char *str, size_t len)
+{
+    size_t ii;
+
+    buf_append(buf, "\"", 1);
+    for (ii = 0; ii < len; ++ii) {
+        unsigned char c = (unsigned char)str[ii];
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            buf_append(buf, esc, 2);
+        } else if (c < 0x20) {
+            buf_printf(buf, "\\u%04x", c);
+        } else {
+            buf_append(buf, &str[ii], 1);
+        }
+    }
+    buf_append(buf, "\"", 1);
+}
+
+/* storage */
+
+    static uint32_t
+hash_key(const char *key, size_t nkey)
+{
+    uint32_t hash = 2166136261u;
+    size_t ii;
+
+    for (ii = 0; ii < nkey; ++ii) {
+        hash ^= (unsigned char)key[ii];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+    static time_t
+absolute_time(uint32_t exptime)
+{
+    if (exptime == 0) {
+        return 0;
+    }
+    if (exptime > REALTIME_MAXDELTA) {
+        return (time_t)exptime;
+    }
+    return time(NULL) + exptime;
+}
+
+    static void
+item_free(item_t *item)
+{
+    free(item->data);
+    free(item);
+}
+
+    static item_t **
+item_slot(bucket_t *bucket, const char *key, size_t nkey)
+{
+    item_t **slot = &bucket->table[hash_key(key, nkey) & (TABLE_SIZE - 1)];
+    time_t now = time(NULL);
+
+    while (*slot) {
+        item_t *item = *slot;
+        if (item->exptime && item->exptime <= now) {
+            *slot = item->next;
+            item_free(item);
+            bucket->nitems--;
+            continue;
+        }
+        if (item->nkey == nkey && memcmp(item->data, key, nkey) == 0) {
+            return slot;
+        }
+        slot = &item->next;
+    }
+    return slot;
+}
+
+    static item_t *
+item_find(bucket_t *bucket, const char *key, size_t nkey)
+{
+    return *item_slot(bucket, key, nkey);
+}
+
+    static int
+item_locked(item_t *item)
+{
+    return item->locked_until && item->locked_until > time(NULL);
+}
+
+    static item_t *
+item_store(bucket_t *bucket, const char *key, size_t nkey,
+        const char *val1, size_t nval1, const char *val2, size_t nval2,
+        uint32_t flags, time_t exptime)
+{
+    item_t **slot = item_slot(bucket, key, nkey);
+    item_t *item = *slot;
+    char *data = xrealloc(NULL, nkey + nval1 + nval2 + 1);
+
+    memcpy(data, key, nkey);
+    memcpy(data + nkey, val1, nval1);
+    memcpy(data + nkey + nval1, val2, nval2);
+    data[nkey + nval1 + nval2] = '\0';
+    if (item == NULL) {
+        item = xrealloc(NULL, sizeof(item_t));
+        memset(item, 0, sizeof(item_t));
+        *slot = item;
+        bucket->nitems++;
+    } else {
+        free(item->data);
+    }
+    item->data = data;
+    item->nkey = (uint16_t)nkey;
+    item->nbytes = (uint32_t)(nval1 + nval2);
+    item->flags = flags;
+    item->exptime = exptime;
+    item->locked_until = 0;
+    item->cas = next_cas++;
+    return item;
+}
+
+    static void
+item_remove(bucket_t *bucket, const char *key, size_t nkey)
+{
+    item_t **slot = item_slot(bucket, key, nkey);
+    item_t *item = *slot;
+
+    if (item) {
+        *slot = item->next;
+        item_free(item);
+        bucket->nitems--;
+    }
+}
+
+    static void
+bucket_flush(bucket_t *bucket)
+{
+    size_t ii;
+
+    for (ii = 0; ii < TABLE_SIZE; ++ii) {
+        item_t *item = bucket->table[ii], *next;
+        for (; item; item = next) {
+            next = item->next;
+            item_free(item);
+        }
+        bucket->table[ii] = NULL;
+    }
+    bucket->nitems = 0;
+}
+
+    static bucket_t *
+bucket_find(const char *name, size_t len)
+{
+    int ii;
+
+    for (ii = 0; ii < nbuckets; ++ii) {
+        if (strlen(buckets[ii].name) == len && memcmp(buckets[ii].name, name, len) == 0) {
+            return buckets + ii;
+        }
+    }
+    return NULL;
+}
+
+/* "default:,protected:secret,cache::memcache" */
+    static void
+parse_buckets(const char *spec)
+{
+    char *copy = strdup(spec), *save = NULL, *tok;
+
+    nbuckets = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        bucket_t *bucket;
+        char *colon;
+
+        if (nbuckets == MAX_BUCKETS) {
+            die("couchbase_mock: too many buckets");
+        }
+        bucket = buckets + nbuckets++;
+        memset(bucket, 0, sizeof(bucket_t));
+        colon = strchr(tok, ':');
+        if (colon) {
+            char *type = strchr(colon + 1, ':');
+            *colon = '\0';
+            if (type) {
+                *type = '\0';
+            }
+            snprintf(bucket->password, sizeof(bucket->password), "%s", colon + 1);
+        }
+        snprintf(bucket->name, sizeof(bucket->name), "%s", tok);
+        bucket->table = xrealloc(NULL, sizeof(item_t *) * TABLE_SIZE);
+        memset(bucket->table, 0, sizeof(item_t *) * TABLE_SIZE);
+    }
+    free(copy);
+}
+
+/* cluster configuration */
+
+    static int
+live_nodes(int *live)
+{
+    int ii, nlive = 0;
+
+    for (ii = 0; ii < nnodes; ++ii) {
+        if (!nodes[ii].failed) {
+            live[nlive++] = ii;
+        }
+    }
+    return nlive;
+}
+
+    static void
+build_config(buf_t *buf, bucket_t *bucket)
+{
+    int live[MAX_NODES], nlive = live_nodes(live), ii;
+
+    buf_printf(buf, "{\"name\":\"%s\",\"bucketType\":\"membase\",\"nodeLocator\":\"vbucket\","
+            "\"uri\":\"/pools/default/buckets/%s\","
+            "\"streamingUri\":\"/pools/default/bucketsStreaming/%s\","
+            "\"saslPassword\":", bucket->name, bucket->name, bucket->name);
+    buf_json_string(buf, bucket->password, strlen(bucket->password));
+    buf_printf(buf, ",\"nodes\":[");
+    for (ii = 0; ii < nlive; ++ii) {
+        node_t *node = nodes + live[ii];
+        buf_printf(buf, "%s{\"hostname\":\"%s:%d\",\"status\":\"healthy\","
+                "\"couchApiBase\":\"http://%s:%d/%s\","
+                "\"ports\":{\"direct\":%d,\"proxy\":0}}",
+                ii ? "," : "", host, node->rest_port, host, node->rest_port,
+                bucket->name, node->kv_port);
+    }
+    buf_printf(buf, "],\"vBucketServerMap\":{\"hashAlgorithm\":\"CRC\","
+            "\"numReplicas\":0,\"serverList\":[");
+    for (ii = 0; ii < nlive; ++ii) {
+        buf_printf(buf, "%s\"%s:%d\"", ii ? "," : "", host, nodes[live[ii]].kv_port);
+    }
+    buf_printf(buf, "],\"vBucketMap\":[");
+    for (ii = 0; ii < nvbuckets; ++ii) {
+        buf_printf(buf, "%s[%d]", ii ? "," : "", nlive ? ii % nlive : -1);
+    }
+    buf_printf(buf, "]}}");
+}
+
+/* connections */
+
+    static void
+set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+    static conn_t *
+conn_new(int fd, enum conn_type type, int node)
+{
+    conn_t *conn = xrealloc(NULL, sizeof(conn_t));
+    int one = 1;
+
+    memset(conn, 0, sizeof(conn_t));
+    conn->fd = fd;
+    conn->type = type;
+    conn->node = node;
+    conn->bucket = bucket_find("default", 7);
+    set_nonblock(fd);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conns = xrealloc(conns, sizeof(conn_t *) * (nconns + 1));
+    conns[nconns++] = conn;
+    return conn;
+}
+
+    static void
+conn_free(conn_t *conn)
+{
+    chunk_t *chunk, *next;
+    size_t ii;
+
+    for (chunk = conn->out_head; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(conn->in.ptr);
+    close(conn->fd);
+    for (ii = 0; ii < nconns; ++ii) {
+        if (conns[ii] == conn) {
+            conns[ii] = conns[--nconns];
+            break;
+        }
+    }
+    free(conn);
+}
+
+    static void
+conn_send(conn_t *conn, const void *data, size_t len, hrtime_t delay)
+{
+    chunk_t *chunk = xrealloc(NULL, sizeof(chunk_t) + len);
+
+    chunk->next = NULL;
+    chunk->due = delay ? now_ns() + delay : 0;
+    chunk->len = len;
+    chunk->off = 0;
+    memcpy(chunk->data, data, len);
+    if (conn->out_tail) {
+        conn->out_tail->next = chunk;
+    } else {
+        conn->out_head = chunk;
+    }
+    conn->out_tail = chunk;
+}
+
+/* returns -1 if connection has to be closed */
+    static int
+conn_flush(conn_t *conn, hrtime_t now)
+{
+    while (conn->out_head && conn->out_head->due <= now) {
+        chunk_t *chunk = conn->out_head;
+        ssize_t rv = write(conn->fd, chunk->data + chunk->off, chunk->len - chunk->off);
+        if (rv < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return -1;
+        }
+        chunk->off += rv;
+        if (chunk->off < chunk->len) {
+            return 0;
+        }
+        conn->out_head = chunk->next;
+        if (conn->out_head == NULL) {
+            conn->out_tail = NULL;
+        }
+        free(chunk);
+    }
+    if (conn->out_head == NULL && conn->close_after_flush) {
+        return -1;
+    }
+    return 0;
+}
+
+/* memcached binary protocol */
+
+    static uint64_t
+ntohll_(const unsigned char *p)
+{
+    uint64_t val = 0;
+    int ii;
+    for (ii = 0; ii < 8; ++ii) {
+        val = (val << 8) | p[ii];
+    }
+    return val;
+}
+
+    static void
+htonll_(unsigned char *p, uint64_t val)
+{
+    int ii;
+    for (ii = 7; ii >= 0; --ii) {
+        p[ii] = (unsigned char)(val & 0xff);
+        val >>= 8;
+    }
+}
+
+    static void
+kv_respond(buf_t *out, uint8_t opcode, uint16_t status, uint32_t opaque, uint64_t cas,
+        const void *extras, size_t nextras, const void *key, size_t nkey,
+        const void *value, size_t nvalue)
+{
+    unsigned char hdr[HEADER_SIZE];
+    uint32_t bodylen = (uint32_t)(nextras + nkey + nvalue);
+
+    memset(hdr, 0, sizeof(hdr));
+    hdr[0] = RES_MAGIC;
+    hdr[1] = opcode;
+    hdr[2] = (unsigned char)(nkey >> 8);
+    hdr[3] = (unsigned char)nkey;
+    hdr[4] = (unsigned char)nextras;
+    hdr[6] = (unsigned char)(status >> 8);
+    hdr[7] = (unsigned char)status;
+    hdr[8] = (unsigned char)(bodylen >> 24);
+    hdr[9] = (unsigned char)(bodylen >> 16);
+    hdr[10] = (unsigned char)(bodylen >> 8);
+    hdr[11] = (unsigned char)bodylen;
+    memcpy(hdr + 12, &opaque, 4);   /* opaque is copied as is */
+    htonll_(hdr + 16, cas);
+    buf_append(out, hdr, HEADER_SIZE);
+    buf_append(out, extras, nextras);
+    buf_append(out, key, nkey);
+    buf_append(out, value, nvalue);
+}
+
+    static void
+kv_error(buf_t *out, uint8_t opcode, uint16_t status, uint32_t opaque)
+{
+    const char *msg;
+
+    switch (status) {
+        case ST_KEY_ENOENT:
+            msg = "Not found";
+            break;
+        case ST_KEY_EEXISTS:
+            msg = "Data exists for key";
+            break;
+        case ST_NOT_STORED:
+            msg = "Not stored";
+            break;
+        case ST_DELTA_BADVAL:
+            msg = "Non-numeric server-side value for incr or decr";
+            break;
+        case ST_AUTH_ERROR:
+            msg = "Auth failure";
+            break;
+        case ST_ETMPFAIL:
+            msg = "Temporary failure";
+            break;
+        case ST_UNKNOWN_COMMAND:
+            msg = "Unknown command";
+            break;
+        default:
+            msg = "Error";
+    }
+    kv_respond(out, opcode, status, opaque, 0, NULL, 0, NULL, 0, msg, strlen(msg));
+}
+
+    static void
+kv_stat(buf_t *out, uint32_t opaque, const char *key, const char *fmt, ...)
+{
+    char val[128];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(val, sizeof(val), fmt, ap);
+    va_end(ap);
+    kv_respond(out, CMD_STAT, ST_SUCCESS, opaque, 0, NULL, 0, key, strlen(key), val, strlen(val));
+}
+
+    static void
+kv_sasl_auth(conn_t *conn, buf_t *out, uint32_t opaque, const char *value, size_t nvalue)
+{
+    /* PLAIN: authzid \0 authcid \0 passwd */
+    const char *user, *pass, *end = value + nvalue;
+    bucket_t *bucket;
+
+    user = memchr(value, '\0', nvalue);
+    user = user ? user + 1 : end;
+    pass = memchr(user, '\0', end - user);
+    pass = pass ? pass + 1 : end;
+    bucket = bucket_find(user, (pass > user ? pass - 1 : end) - user);
+    if (bucket && strlen(bucket->password) == (size_t)(end - pass) &&
+            memcmp(bucket->password, pass, end - pass) == 0) {
+        conn->bucket = bucket;
+        kv_respond(out, CMD_SASL_AUTH, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, "Authenticated", 13);
+    } else {
+        kv_error(out, CMD_SASL_AUTH, ST_AUTH_ERROR, opaque);
+    }
+}
+
+    static void
+kv_observe(bucket_t *bucket, buf_t *out, uint32_t opaque, const unsigned char *body, size_t nbody)
+{
+    buf_t res = {NULL, 0, 0};
+    size_t pos = 0;
+
+    while (pos + 4 <= nbody) {
+        uint16_t vb = (uint16_t)((body[pos] << 8) | body[pos + 1]);
+        uint16_t nkey = (uint16_t)((body[pos + 2] << 8) | body[pos + 3]);
+        const char *key = (const char *)body + pos + 4;
+        unsigned char tail[9];
+        item_t *item;
+
+        if (pos + 4 + nkey > nbody) {
+            break;
+        }
+        item = item_find(bucket, key, nkey);
+        buf_append(&res, body + pos, 4 + nkey);
+        tail[0] = item ? OBS_PERSISTED : OBS_NOT_FOUND;
+        htonll_(tail + 1, item ? item->cas : 0);
+        buf_append(&res, tail, sizeof(tail));
+        pos += 4 + nkey;
+        (void)vb;
+    }
+    kv_respond(out, CMD_OBSERVE, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, res.ptr, res.len);
+    free(res.ptr);
+}
+
+    static void
+kv_execute(conn_t *conn, buf_t *out, const unsigned char *hdr, const unsigned char *body)
+{
+    uint8_t opcode = hdr[1];
+    uint16_t nkey = (uint16_t)((hdr[2] << 8) | hdr[3]);
+    uint8_t nextras = hdr[4];
+    uint32_t nbody = ((uint32_t)hdr[8] << 24) | ((uint32_t)hdr[9] << 16) | ((uint32_t)hdr[10] << 8) | hdr[11];
+    uint32_t opaque;
+    uint64_t cas = ntohll_(hdr + 16);
+    const unsigned char *extras = body;
+    const char *key = (const char *)body + nextras;
+    const char *value = key + nkey;
+    size_t nvalue = nbody - nextras - nkey;
+    bucket_t *bucket = conn->bucket;
+    item_t *item = NULL;
+    unsigned char ext[8];
+
+    memcpy(&opaque, hdr + 12, 4);
+    switch (opcode) {
+        case CMD_SASL_LIST_MECHS:
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, "PLAIN", 5);
+            return;
+        case CMD_SASL_AUTH:
+            kv_sasl_auth(conn, out, opaque, value, nvalue);
+            return;
+        case CMD_NOOP:
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_VERSION:
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, "2.0.0-mock", 10);
+            return;
+        case CMD_QUIT:
+            conn->close_after_flush = 1;
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, NULL, 0);
+            return;
+    }
+    if (bucket == NULL) {
+        kv_error(out, opcode, ST_AUTH_ERROR, opaque);
+        return;
+    }
+    switch (opcode) {
+        case CMD_GET:
+        case CMD_GETQ:
+        case CMD_GETK:
+        case CMD_GETKQ:
+        case CMD_GAT:
+        case CMD_GATQ:
+        case CMD_GETL:
+            item = item_find(bucket, key, nkey);
+            if (item == NULL) {
+                if (opcode != CMD_GETQ && opcode != CMD_GETKQ && opcode != CMD_GATQ) {
+                    kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                }
+                return;
+            }
+            if (opcode == CMD_GAT || opcode == CMD_GATQ) {
+                if (nextras == 4) {
+                    item->exptime = absolute_time(ntohl(*(uint32_t *)extras));
+                }
+            } else if (opcode == CMD_GETL) {
+                uint32_t lock_time = nextras == 4 ? ntohl(*(uint32_t *)extras) : 0;
+                if (item_locked(item)) {
+                    kv_error(out, opcode, ST_ETMPFAIL, opaque);
+                    return;
+                }
+                if (lock_time == 0 || lock_time > MAX_LOCK_TIME) {
+                    lock_time = DEFAULT_LOCK_TIME;
+                }
+                item->locked_until = time(NULL) + lock_time;
+                item->cas = next_cas++;
+            }
+            {
+                uint32_t flags = htonl(item->flags);
+                int with_key = opcode == CMD_GETK || opcode == CMD_GETKQ;
+                kv_respond(out, opcode, ST_SUCCESS, opaque, item->cas, &flags, 4,
+                        with_key ? item->data : NULL, with_key ? item->nkey : 0,
+                        item->data + item->nkey, item->nbytes);
+            }
+            return;
+        case CMD_SET:
+        case CMD_ADD:
+        case CMD_REPLACE:
+            if (nextras != 8) {
+                kv_error(out, opcode, ST_EINVAL, opaque);
+                return;
+            }
+            item = item_find(bucket, key, nkey);
+            if (opcode == CMD_ADD && item) {
+                kv_error(out, opcode, ST_KEY_EEXISTS, opaque);
+                return;
+            }
+            if (opcode == CMD_REPLACE && item == NULL) {
+                kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                return;
+            }
+            if (item && ((cas && cas != item->cas) || (!cas && item_locked(item)))) {
+                kv_error(out, opcode, ST_KEY_EEXISTS, opaque);
+                return;
+            }
+            if (!item && cas) {
+                kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                return;
+            }
+            item = item_store(bucket, key, nkey, value, nvalue, NULL, 0,
+                    ntohl(*(uint32_t *)extras), absolute_time(ntohl(*(uint32_t *)(extras + 4))));
+            kv_respond(out, opcode, ST_SUCCESS, opaque, item->cas, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_APPEND:
+        case CMD_PREPEND:
+            item = item_find(bucket, key, nkey);
+            if (item == NULL) {
+                kv_error(out, opcode, ST_NOT_STORED, opaque);
+                return;
+            }
+            if ((cas && cas != item->cas) || (!cas && item_locked(item))) {
+                kv_error(out, opcode, ST_KEY_EEXISTS, opaque);
+                return;
+            }
+            {
+                /* the item will be replaced, so copy the old value */
+                size_t nold = item->nbytes;
+                char *old = xrealloc(NULL, nold + 1);
+                memcpy(old, item->data + item->nkey, nold);
+                if (opcode == CMD_APPEND) {
+                    item = item_store(bucket, key, nkey, old, nold, value, nvalue, item->flags, item->exptime);
+                } else {
+                    item = item_store(bucket, key, nkey, value, nvalue, old, nold, item->flags, item->exptime);
+                }
+                free(old);
+            }
+            kv_respond(out, opcode, ST_SUCCESS, opaque, item->cas, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_DELETE:
+            item = item_find(bucket, key, nkey);
+            if (item == NULL) {
+                kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                return;
+            }
+            if ((cas && cas != item->cas) || (!cas && item_locked(item))) {
+                kv_error(out, opcode, ST_KEY_EEXISTS, opaque);
+                return;
+            }
+            item_remove(bucket, key, nkey);
+            kv_respond(out, opcode, ST_SUCCESS, opaque, next_cas++, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_INCR:
+        case CMD_DECR:
+            {
+                uint64_t delta, initial, val;
+                uint32_t exptime;
+                char num[32];
+                int len;
+
+                if (nextras != 20) {
+                    kv_error(out, opcode, ST_EINVAL, opaque);
+                    return;
+                }
+                delta = ntohll_(extras);
+                initial = ntohll_(extras + 8);
+                exptime = ntohl(*(uint32_t *)(extras + 16));
+                item = item_find(bucket, key, nkey);
+                if (item) {
+                    char *end = NULL;
+                    const char *data = item->data + item->nkey;
+                    if (item_locked(item) && cas != item->cas) {
+                        kv_error(out, opcode, ST_KEY_EEXISTS, opaque);
+                        return;
+                    }
+                    if (item->nbytes == 0 || item->nbytes > 20 || data[0] < '0' || data[0] > '9') {
+                        kv_error(out, opcode, ST_DELTA_BADVAL, opaque);
+                        return;
+                    }
+                    val = strtoull(data, &end, 10);
+                    if (end != data + item->nbytes) {
+                        kv_error(out, opcode, ST_DELTA_BADVAL, opaque);
+                        return;
+                    }
+                    if (opcode == CMD_INCR) {
+                        val += delta;
+                    } else {
+                        val = val > delta ? val - delta : 0;
+                    }
+                    exptime = 0;
+                } else if (exptime != 0xffffffff) {
+                    val = initial;
+                } else {
+                    kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                    return;
+                }
+                len = snprintf(num, sizeof(num), "%llu", (unsigned long long)val);
+                item = item_store(bucket, key, nkey, num, len, NULL, 0,
+                        item ? item->flags : 0, item ? item->exptime : absolute_time(exptime));
+                htonll_(ext, val);
+                kv_respond(out, opcode, ST_SUCCESS, opaque, item->cas, NULL, 0, NULL, 0, ext, 8);
+            }
+            return;
+        case CMD_TOUCH:
+            item = item_find(bucket, key, nkey);
+            if (item == NULL) {
+                kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                return;
+            }
+            if (nextras == 4) {
+                item->exptime = absolute_time(ntohl(*(uint32_t *)extras));
+            }
+            kv_respond(out, opcode, ST_SUCCESS, opaque, item->cas, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_UNLOCK:
+            item = item_find(bucket, key, nkey);
+            if (item == NULL) {
+                kv_error(out, opcode, ST_KEY_ENOENT, opaque);
+                return;
+            }
+            if (!item_locked(item) || cas != item->cas) {
+                kv_error(out, opcode, ST_ETMPFAIL, opaque);
+                return;
+            }
+            item->locked_until = 0;
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_OBSERVE:
+            kv_observe(bucket, out, opaque, (const unsigned char *)value, nvalue);
+            return;
+        case CMD_STAT:
+            kv_stat(out, opaque, "pid", "%ld", (long)getpid());
+            kv_stat(out, opaque, "version", "%s", "2.0.0-mock");
+            kv_stat(out, opaque, "curr_items", "%lu", (unsigned long)bucket->nitems);
+            kv_stat(out, opaque, "time", "%ld", (long)time(NULL));
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_FLUSH:
+            bucket_flush(bucket);
+            kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, NULL, 0);
+            return;
+        case CMD_GET_CLUSTER_CONFIG:
+            {
+                buf_t cfg = {NULL, 0, 0};
+                build_config(&cfg, bucket);
+                kv_respond(out, opcode, ST_SUCCESS, opaque, 0, NULL, 0, NULL, 0, cfg.ptr, cfg.len);
+                free(cfg.ptr);
+            }
+            return;
+        default:
+            kv_error(out, opcode, ST_UNKNOWN_COMMAND, opaque);
+    }
+}
+
+    static int
+kv_process(conn_t *conn)
+{
+    buf_t out = {NULL, 0, 0};
+    size_t pos = 0;
+
+    while (conn->in.len - pos >= HEADER_SIZE) {
+        const unsigned char *hdr = (const unsigned char *)conn->in.ptr + pos;
+        uint32_t nbody = ((uint32_t)hdr[8] << 24) | ((uint32_t)hdr[9] << 16) | ((uint32_t)hdr[10] << 8) | hdr[11];
+        uint16_t nkey = (uint16_t)((hdr[2] << 8) | hdr[3]);
+
+        if (hdr[0] != REQ_MAGIC || (uint32_t)nkey + hdr[4] > nbody) {
+            free(out.ptr);
+            return -1;
+        }
+        if (conn->in.len - pos < HEADER_SIZE + nbody) {
+            break;
+        }
+        kv_execute(conn, &out, hdr, hdr + HEADER_SIZE);
+        pos += HEADER_SIZE + nbody;
+    }
+    if (pos) {
+        memmove(conn->in.ptr, conn->in.ptr + pos, conn->in.len - pos);
+        conn->in.len -= pos;
+    }
+    if (out.len) {
+        conn_send(conn, out.ptr, out.len, latency);
+    }
+    free(out.ptr);
+    return 0;
+}
+
+/* REST */
+
+    static void
+http_respond(conn_t *conn, int status, const char *reason, const char *body, size_t nbody, hrtime_t delay)
+{
+    buf_t out = {NULL, 0, 0};
+
+    buf_printf(&out, "HTTP/1.1 %d %s\r\nServer: couchbase_mock\r\n"
+            "Content-Type: application/json\r\nContent-Length: %lu\r\n"
+            "Connection: close\r\n\r\n", status, reason, (unsigned long)nbody);
+    buf_append(&out, body, nbody);
+    conn_send(conn, out.ptr, out.len, delay);
+    conn->close_after_flush = 1;
+    free(out.ptr);
+}
+
+    static void
+http_respond_pieces(conn_t *conn, const char *body, size_t nbody, hrtime_t delay)
+{
+    buf_t out = {NULL, 0, 0};
+    size_t off, len;
+
+    buf_printf(&out, "HTTP/1.1 200 OK\r\nServer: couchbase_mock\r\n"
+            "Content-Type: application/json\r\nContent-Length: %lu\r\n"
+            "Connection: close\r\n\r\n", (unsigned long)nbody);
+    conn_send(conn, out.ptr, out.len, delay);
+    for (off = 0; off < nbody; off += len) {
+        len = nbody - off < VIEW_PIECE_SIZE ? nbody - off : VIEW_PIECE_SIZE;
+        delay += VIEW_PIECE_DELAY;
+        conn_send(conn, body + off, len, delay);
+    }
+    conn->close_after_flush = 1;
+    free(out.ptr);
+}
+
+    static void
+http_stream_config(conn_t *conn)
+{
+    buf_t cfg = {NULL, 0, 0}, out = {NULL, 0, 0};
+
+    build_config(&cfg, conn->bucket);
+    buf_append(&cfg, "\n\n\n\n", 4);
+    buf_printf(&out, "%lx\r\n", (unsigned long)cfg.len);
+    buf_append(&out, cfg.ptr, cfg.len);
+    buf_append(&out, "\r\n", 2);
+    conn_send(conn, out.ptr, out.len, 0);
+    free(cfg.ptr);
+    free(out.ptr);
+}
+
+    static int
+item_compare(const void *a, const void *b)
+{
+    const item_t *ia = *(const item_t * const *)a, *ib = *(const item_t * const *)b;
+    size_t len = ia->nkey < ib->nkey ? ia->nkey : ib->nkey;
+    int rv = memcmp(ia->data, ib->data, len);
+    return rv ? rv : (int)ia->nkey - (int)ib->nkey;
+}
+
+    static long
+query_param(const char *query, const char *name, long def)
+{
+    size_t len = strlen(name);
+    const char *p = query;
+
+    while (p && *p) {
+        if (strncmp(p, name, len) == 0 && p[len] == '=') {
+            if (strncmp(p + len + 1, "true", 4) == 0) {
+                return 1;
+            }
+            if (strncmp(p + len + 1, "false", 5) == 0) {
+                return 0;
+            }
+            return strtol(p + len + 1, NULL, 10);
+        }
+        p = strchr(p, '&');
+        if (p) {
+            p++;
+        }
+    }
+    return def;
+}
+
+/*
+ * All views return the same rows: the documents of the bucket sorted by
+ * key, with null values. Supports limit, skip and include_docs. The
+ * result is written in pieces of VIEW_PIECE_SIZE bytes.
+ */
+    static void
+http_view(conn_t *conn, bucket_t *bucket, const char *query)
+{
+    buf_t out = {NULL, 0, 0};
+    item_t **items = NULL;
+    size_t nitems = 0, ii;
+    long limit = query_param(query, "limit", -1);
+    long skip = query_param(query, "skip", 0);
+    long include_docs = query_param(query, "include_docs", 0);
+    time_t now = time(NULL);
+    int first = 1;
+
+    items = xrealloc(NULL, sizeof(item_t *) * (bucket->nitems + 1));
+    for (ii = 0; ii < TABLE_SIZE; ++ii) {
+        item_t *item;
+        for (item = bucket->table[ii]; item; item = item->next) {
+            if (!item->exptime || item->exptime > now) {
+                items[nitems++] = item;
+            }
+        }
+    }
+    qsort(items, nitems, sizeof(item_t *), item_compare);
+    buf_printf(&out, "{\"total_rows\":%lu,\"rows\":[\n", (unsigned long)nitems);
+    for (ii = (size_t)skip; ii < nitems && (limit < 0 || ii < (size_t)(skip + limit)); ++ii) {
+        item_t *item = items[ii];
+        buf_printf(&out, "%s{\"id\":", first ? "" : ",\n");
+        buf_json_string(&out, item->data, item->nkey);
+        buf_printf(&out, ",\"key\":");
+        buf_json_string(&out, item->data, item->nkey);
+        buf_printf(&out, ",\"value\":null");
+        if (include_docs) {
+            const char *val = item->data + item->nkey;
+            buf_printf(&out, ",\"doc\":{\"meta\":{\"id\":");
+            buf_json_string(&out, item->data, item->nkey);
+            buf_printf(&out, ",\"rev\":\"1-%016llx\",\"flags\":%lu,\"expiration\":%ld},\"json\":",
+                    (unsigned long long)item->cas, (unsigned long)item->flags, (long)item->exptime);
+            if (item->nbytes && (val[0] == '{' || val[0] == '[')) {
+                buf_append(&out, val, item->nbytes);
+            } else {
+                buf_json_string(&out, val, item->nbytes);
+            }
+            buf_printf(&out, "}");
+        }
+        buf_printf(&out, "}");
+        first = 0;
+    }
+    buf_printf(&out, "\n]\n}\n");
+    http_respond_pieces(conn, out.ptr, out.len, latency);
+    free(items);
+    free(out.ptr);
+}
+
+    static int
+http_process(conn_t *conn)
+{
+    char *end, *path, *query, *p, *cl;
+    size_t hlen, clen = 0;
+    bucket_t *bucket;
+    char name[128];
+
+    buf_reserve(&conn->in, 1);
+    conn->in.ptr[conn->in.len] = '\0';
+    end = strstr(conn->in.ptr, "\r\n\r\n");
+    if (end == NULL) {
+        return 0;
+    }
+    hlen = end - conn->in.ptr + 4;
+    cl = strstr(conn->in.ptr, "Content-Length:");
+    if (cl && cl < end) {
+        clen = strtoul(cl + 15, NULL, 10);
+    }
+    if (conn->in.len < hlen + clen) {
+        return 0;
+    }
+    path = strchr(conn->in.ptr, ' ');
+    if (path == NULL) {
+        return -1;
+    }
+    path++;
+    p = strchr(path, ' ');
+    if (p == NULL) {
+        return -1;
+    }
+    *p = '\0';
+    query = strchr(path, '?');
+    if (query) {
+        *query++ = '\0';
+    } else {
+        query = "";
+    }
+    conn->in.len = 0;
+
+    if (sscanf(path, "/pools/default/bucketsStreaming/%127[^/]", name) == 1 ||
+            sscanf(path, "/pools/default/bs/%127[^/]", name) == 1) {
+        bucket = bucket_find(name, strlen(name));
+        if (bucket) {
+            const char *hdr = "HTTP/1.1 200 OK\r\nServer: couchbase_mock\r\n"
+                "Content-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+            conn->bucket = bucket;
+            conn->streaming = 1;
+            conn_send(conn, hdr, strlen(hdr), 0);
+            http_stream_config(conn);
+            return 0;
+        }
+    } else if (sscanf(path, "/pools/default/buckets/%127[^/]", name) == 1 ||
+            sscanf(path, "/pools/default/b/%127[^/]", name) == 1) {
+        bucket = bucket_find(name, strlen(name));
+        if (bucket) {
+            buf_t cfg = {NULL, 0, 0};
+            build_config(&cfg, bucket);
+            http_respond(conn, 200, "OK", cfg.ptr, cfg.len, 0);
+            free(cfg.ptr);
+            return 0;
+        }
+    } else if (strcmp(path, "/pools") == 0) {
+        const char *body = "{\"pools\":[{\"name\":\"default\",\"uri\":\"/pools/default\"}]}";
+        http_respond(conn, 200, "OK", body, strlen(body), 0);
+        return 0;
+    } else if (strcmp(path, "/pools/default") == 0) {
+        buf_t out = {NULL, 0, 0};
+        int live[MAX_NODES], nlive = live_nodes(live), ii;
+        buf_printf(&out, "{\"name\":\"default\",\"nodes\":[");
+        for (ii = 0; ii < nlive; ++ii) {
+            buf_printf(&out, "%s{\"hostname\":\"%s:%d\",\"status\":\"healthy\"}",
+                    ii ? "," : "", host, nodes[live[ii]].rest_port);
+        }
+        buf_printf(&out, "]}");
+        http_respond(conn, 200, "OK", out.ptr, out.len, 0);
+        free(out.ptr);
+        return 0;
+    } else if (sscanf(path, "/%127[^/]", name) == 1 &&
+            (bucket = bucket_find(name, strlen(name))) != NULL &&
+            (strstr(path, "/_view/") || strstr(path, "/_all_docs"))) {
+        http_view(conn, bucket, query);
+        return 0;
+    }
+    {
+        const char *body = "{\"error\":\"not_found\",\"reason\":\"missing\"}";
+        http_respond(conn, 404, "Object Not Found", body, strlen(body), latency);
+    }
+    return 0;
+}
+
+/* cluster control */
+
+    static int
+listen_on(int port, int *bound)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+    if (fd < 0) {
+        die("couchbase_mock: socket: %s", strerror(errno));
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        die("couchbase_mock: unable to listen port %d: %s", port, strerror(errno));
+    }
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    *bound = ntohs(addr.sin_port);
+    set_nonblock(fd);
+    return fd;
+}
+
+    static void
+broadcast_config(void)
+{
+    size_t ii;
+
+    for (ii = 0; ii < nconns; ++ii) {
+        if (conns[ii]->type == CONN_REST && conns[ii]->streaming) {
+            http_stream_config(conns[ii]);
+        }
+    }
+}
+
+    static void
+node_failover(int idx)
+{
+    size_t ii;
+
+    if (idx < 0 || idx >= nnodes || nodes[idx].failed) {
+        return;
+    }
+    nodes[idx].failed = 1;
+    close(nodes[idx].kv_fd);
+    nodes[idx].kv_fd = -1;
+    for (ii = 0; ii < nconns; ) {
+        if (conns[ii]->type == CONN_KV && conns[ii]->node == idx) {
+            conn_free(conns[ii]);
+        } else {
+            ++ii;
+        }
+    }
+    broadcast_config();
+}
+
+    static void
+node_respawn(int idx)
+{
+    if (idx < 0 || idx >= nnodes || !nodes[idx].failed) {
+        return;
+    }
+    nodes[idx].kv_fd = listen_on(nodes[idx].kv_port, &nodes[idx].kv_port);
+    nodes[idx].failed = 0;
+    broadcast_config();
+}
+
+    static void
+monitor_command(const char *line)
+{
+    int idx;
+
+    if (sscanf(line, "failover,%d", &idx) == 1) {
+        node_failover(idx);
+    } else if (sscanf(line, "respawn,%d", &idx) == 1) {
+        node_respawn(idx);
+    }
+}
+
+/* the unterminated tail of the read is the last command */
+    static void
+monitor_process(conn_t *conn)
+{
+    char *line, *nl;
+
+    buf_reserve(&conn->in, 1);
+    conn->in.ptr[conn->in.len] = '\0';
+    line = conn->in.ptr;
+    while ((nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        monitor_command(line);
+        line = nl + 1;
+    }
+    if (*line) {
+        monitor_command(line);
+    }
+    conn->in.len = 0;
+}
+
+    static void
+connect_monitor(const char *spec)
+{
+    char mhost[256];
+    char port[32];
+    const char *colon = strrchr(spec, ':');
+    struct addrinfo hints, *res;
+    int fd, len;
+    char msg[32];
+
+    if (colon == NULL || colon - spec >= (long)sizeof(mhost)) {
+        die("couchbase_mock: invalid monitor address: %s", spec);
+    }
+    memcpy(mhost, spec, colon - spec);
+    mhost[colon - spec] = '\0';
+    snprintf(port, sizeof(port), "%s", colon + 1);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(mhost[0] ? mhost : "127.0.0.1", port, &hints, &res) != 0) {
+        die("couchbase_mock: unable to resolve monitor address: %s", spec);
+    }
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        die("couchbase_mock: unable to connect to monitor: %s", strerror(errno));
+    }
+    freeaddrinfo(res);
+    len = snprintf(msg, sizeof(msg), "%d", nodes[0].rest_port);
+    if (write(fd, msg, len) != len) {
+        die("couchbase_mock: unable to write to monitor");
+    }
+    conn_new(fd, CONN_MONITOR, -1);
+}
+
+    static void
+run(void)
+{
+    struct pollfd *fds = NULL;
+    size_t cap = 0;
+
+    for (;;) {
+        size_t nfds = 0, nlisten, ii;
+        hrtime_t now = now_ns(), next = 0;
+        int timeout = -1, rv;
+
+        if (cap < nconns + 2 * nnodes) {
+            cap = nconns + 2 * nnodes;
+            fds = xrealloc(fds, sizeof(struct pollfd) * cap);
+        }
+        for (ii = 0; ii < (size_t)nnodes; ++ii) {
+            fds[nfds].fd = nodes[ii].rest_fd;
+            fds[nfds++].events = POLLIN;
+            fds[nfds].fd = nodes[ii].kv_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        nlisten = nfds;
+        for (ii = 0; ii < nconns; ++ii) {
+            conn_t *conn = conns[ii];
+            fds[nfds].fd = conn->fd;
+            fds[nfds].events = POLLIN;
+            if (conn->out_head) {
+                if (conn->out_head->due <= now) {
+                    fds[nfds].events |= POLLOUT;
+                } else if (next == 0 || conn->out_head->due < next) {
+                    next = conn->out_head->due;
+                }
+            }
+            nfds++;
+        }
+        if (next) {
+            timeout = (int)((next - now + 999999) / 1000000);
+        }
+        rv = poll(fds, nfds, timeout);
+        if (rv < 0 && errno != EINTR) {
+            die("couchbase_mock: poll: %s", strerror(errno));
+        }
+        now = now_ns();
+        /* connections (iterate backwards as conn_free reorders the tail) */
+        for (ii = nfds; ii > nlisten; --ii) {
+            struct pollfd *pfd = fds + ii - 1;
+            conn_t *conn = conns[ii - 1 - nlisten];
+            int failed = 0;
+
+            if (rv > 0 && (pfd->revents & (POLLIN | POLLHUP | POLLERR))) {
+                char tmp[65536];
+                ssize_t nr = read(conn->fd, tmp, sizeof(tmp));
+                if (nr > 0) {
+                    buf_append(&conn->in, tmp, nr);
+                    switch (conn->type) {
+                        case CONN_KV:
+                            failed = kv_process(conn) < 0;
+                            break;
+                        case CONN_REST:
+                            failed = http_process(conn) < 0;
+                            break;
+                        case CONN_MONITOR:
+                            monitor_process(conn);
+                            break;
+                    }
+                } else if (nr == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    if (conn->type == CONN_MONITOR) {
+                        exit(0);
+                    }
+                    failed = 1;
+                }
+            }
+            if (failed || conn_flush(conn, now) < 0) {
+                conn_free(conn);
+            }
+        }
+        if (rv > 0) {
+            for (ii = 0; ii < nlisten; ++ii) {
+                if (fds[ii].fd >= 0 && (fds[ii].revents & POLLIN)) {
+                    int fd = accept(fds[ii].fd, NULL, NULL);
+                    if (fd >= 0) {
+                        conn_new(fd, ii % 2 ? CONN_KV : CONN_REST, (int)(ii / 2));
+                    }
+                }
+            }
+        }
+    }
+}
+
+    int
+main(int argc, char **argv)
+{
+    const char *monitor = NULL;
+    const char *spec = "default:";
+    int ii;
+
+    for (ii = 1; ii < argc; ++ii) {
+        const char *arg = argv[ii];
+        const char *val = ii + 1 < argc ? argv[ii + 1] : NULL;
+
+        if (strncmp(arg, "--harakiri-monitor=", 19) == 0) {
+            monitor = arg + 19;
+        } else if (val == NULL) {
+            die("couchbase_mock: missing value for %s", arg);
+        } else if (strcmp(arg, "--host") == 0) {
+            host = val;
+            ii++;
+        } else if (strcmp(arg, "--port") == 0) {
+            base_port = atoi(val);
+            ii++;
+        } else if (strcmp(arg, "--nodes") == 0) {
+            nnodes = atoi(val);
+            ii++;
+        } else if (strcmp(arg, "--vbuckets") == 0) {
+            nvbuckets = atoi(val);
+            ii++;
+        } else if (strcmp(arg, "--buckets") == 0) {
+            spec = val;
+            ii++;
+        } else if (strcmp(arg, "--latency-us") == 0) {
+            latency = (hrtime_t)strtoull(val, NULL, 10) * 1000;
+            ii++;
+        } else {
+            die("couchbase_mock: unknown option %s", arg);
+        }
+    }
+    if (nnodes < 1 || nnodes > MAX_NODES) {
+        die("couchbase_mock: number of nodes should be in range 1..%d", MAX_NODES);
+    }
+    if (nvbuckets < 1 || (nvbuckets & (nvbuckets - 1)) != 0) {
+        die("couchbase_mock: number of vbuckets should be a power of two");
+    }
+    signal(SIGPIPE, SIG_IGN);
+    parse_buckets(spec);
+    for (ii = 0; ii < nnodes; ++ii) {
+        nodes[ii].rest_fd = listen_on(ii == 0 ? base_port : 0, &nodes[ii].rest_port);
+        nodes[ii].kv_fd = listen_on(0, &nodes[ii].kv_port);
+    }
+    if (monitor) {
+        connect_monitor(monitor);
+    } else {
+        printf("%d\n", nodes[0].rest_port);
+        fflush(stdout);
+    }
+    run();
+    return 0;
+}
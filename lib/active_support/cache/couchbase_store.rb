@@ -44,6 +44,10 @@ module ActiveSupport
       #
       #   ActiveSupport::Cache::CouchbaseStore.new(:bucket => "cache")
       #
+      # Pass <tt>:shared_connection => true</tt> to use single
+      # {Couchbase::SharedBucket} for all threads instead of locking the
+      # connection on each operation.
+      #
       # If no options are specified, then CouchbaseStore will connect to
       # localhost port 8091 (default Couchbase Server port) and will use
       # bucket named "default" which is always open for unauthorized access
@@ -57,6 +61,7 @@ module ActiveSupport
         options[:key_prefix] ||= options.delete(:namespace)
         @key_prefix = options[:key_prefix]
         options[:connection_pool] ||= options.delete(:connection_pool)
+        shared = options.delete(:shared_connection)
         args.push(options)
 
         if options[:connection_pool]
@@ -66,6 +71,9 @@ module ActiveSupport
             @data = ::Couchbase::ConnectionPool.new(options[:connection_pool], *args)
           end
         end
+        if !@data && shared
+          @data = ::Couchbase::SharedBucket.new(*args)
+        end
         unless @data
           @data = ::Couchbase::Bucket.new(*args)
           @data.extend(Threadsafe)
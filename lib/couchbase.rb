@@ -16,7 +16,6 @@
 #
 
 require 'couchbase/version'
-require 'yaji'
 require 'uri'
 require 'couchbase/transcoder'
 require 'couchbase_ext'
@@ -35,6 +34,7 @@ module Couchbase
   if RUBY_VERSION.to_f >= 1.9
     autoload(:ConnectionPool, 'couchbase/connection_pool')
   end
+  autoload(:SharedBucket, 'couchbase/shared_bucket')
 
   class << self
     # The method +connect+ initializes new Bucket instance with all arguments passed.
@@ -0,0 +1,195 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+require 'thread'
+
+module Couchbase
+
+  # Single connection shared by many threads.
+  #
+  # The bucket is owned by the dispatcher thread. Other threads put their
+  # requests into the queue and block until the request is completed.
+  # Single key get, store and arithmetic operations of all waiting
+  # threads are scheduled together and executed in one pass of the event
+  # loop (see {Bucket#run}), so they are pipelined over the same set of
+  # sockets. Other operations are executed one by one in synchronous
+  # mode.
+  #
+  # @since 1.3.8
+  #
+  # @example Share the connection between the threads of the web server
+  #   Couchbase.bucket = Couchbase::SharedBucket.new(:bucket => "default")
+  #
+  class SharedBucket
+
+    STORE = [:set, :add, :replace, :append, :prepend]
+    ARITH = [:incr, :decr, :increment, :decrement]
+    PIPELINED = [:get] + STORE + ARITH
+    # options which don't change the shape of the result
+    OPTIONS = [:quiet, :format, :transcoder, :extended, :ttl, :lock,
+               :flags, :cas, :create, :initial, :delta]
+
+    # @private
+    class Request
+      attr_reader :name, :args, :block, :options
+
+      def initialize(name, args, block, options)
+        @name, @args, @block, @options = name, args, block, options
+        @done = Queue.new
+        @completed = false
+      end
+
+      def complete(value, error = nil)
+        return if @completed
+        @completed = true
+        @done.push([value, error])
+      end
+
+      def wait
+        value, error = @done.pop
+        raise error if error
+        value
+      end
+    end
+
+    # Initialize new connection and start dispatcher thread
+    #
+    # @see Bucket#initialize
+    def initialize(*args)
+      @bucket = ::Couchbase::Bucket.new(*args)
+      @queue = Queue.new
+      @mutex = Mutex.new
+      @error = nil
+      @dispatcher = Thread.new { run_dispatcher }
+    end
+
+    # Stop the dispatcher thread and close the connection
+    #
+    # The requests which are already executing are completed, the queued
+    # and the following ones raise {Couchbase::Error::Connect}.
+    #
+    # @return [nil]
+    def disconnect
+      shutdown(Error::Connect.new("shared bucket is closed"))
+      @queue.push(nil) # wake up the dispatcher
+      @dispatcher.join
+      @bucket.disconnect if @bucket.connected?
+      nil
+    end
+    alias :close :disconnect
+
+    def respond_to_missing?(id, include_private = false)
+      @bucket.respond_to?(id, include_private) || super
+    end
+
+    def method_missing(name, *args, &block)
+      request = Request.new(name, args, block, pipeline_options(name, args, block))
+      @mutex.synchronize do
+        raise @error if @error
+        unless @dispatcher.alive?
+          raise Error::Connect, "shared bucket dispatcher is stopped"
+        end
+        @queue.push(request)
+      end
+      request.wait
+    end
+
+    protected
+
+    def run_dispatcher
+      requests = []
+      until @error
+        requests = [@queue.pop]
+        requests << @queue.pop until @queue.empty?
+        dispatch(requests.compact)
+      end
+    rescue Exception => ex
+      shutdown(ex)
+    ensure
+      # the thread is stopped or died, nobody else completes the requests
+      shutdown(Error::Connect.new("shared bucket dispatcher is stopped"))
+      requests.each { |req| req.complete(nil, @error) if req }
+    end
+
+    # Fail the queued and all following requests with the error
+    def shutdown(error)
+      @mutex.synchronize do
+        @error ||= error
+        until @queue.empty?
+          req = @queue.pop
+          req.complete(nil, @error) if req
+        end
+      end
+    end
+
+    # Returns options of the request if it could be pipelined
+    def pipeline_options(name, args, block)
+      return nil if block || !PIPELINED.include?(name)
+      key = args.first
+      return nil unless key.is_a?(String) || key.is_a?(Symbol)
+      rest = args[(STORE.include?(name) ? 2 : 1)..-1]
+      return nil unless rest
+      if ARITH.include?(name) && rest.first.is_a?(Integer)
+        rest = rest[1..-1]
+      end
+      return nil if rest.size > 1
+      options = rest.first || {}
+      return nil unless options.is_a?(Hash) && (options.keys - OPTIONS).empty?
+      options
+    end
+
+    def dispatch(requests)
+      pipelined, others = requests.partition { |req| req.options }
+      unless pipelined.empty?
+        begin
+          @bucket.run do |conn|
+            pipelined.each { |req| schedule(conn, req) }
+          end
+        rescue Exception => ex
+          pipelined.each { |req| req.complete(nil, ex) }
+        end
+      end
+      others.each do |req|
+        begin
+          req.complete(@bucket.send(req.name, *req.args, &req.block))
+        rescue Exception => ex
+          req.complete(nil, ex)
+        end
+      end
+    end
+
+    def schedule(conn, req)
+      conn.send(req.name, *req.args) do |res|
+        if res.error
+          req.complete(nil, res.error)
+        elsif req.name == :get
+          req.complete(req.options[:extended] ? [res.value, res.flags, res.cas] : res.value)
+        elsif ARITH.include?(req.name)
+          req.complete(req.options[:extended] ? [res.value, res.cas] : res.value)
+        else
+          req.complete(res.cas)
+        end
+      end
+    rescue Exception => ex
+      # failed to schedule (e.g. Couchbase::Error::ValueFormat), the
+      # other requests of the pass are not affected
+      req.complete(nil, ex)
+    end
+
+  end
+
+end
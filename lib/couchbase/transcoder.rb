@@ -38,7 +38,7 @@ module Couchbase
       def self.guess_and_load(blob, flags, options = {})
         case flags & Bucket::FMT_MASK
         when Bucket::FMT_DOCUMENT
-          MultiJson.load(blob)
+          Document.decode(blob)
         when Bucket::FMT_MARSHAL
           ::Marshal.load(blob)
         when Bucket::FMT_PLAIN
@@ -49,17 +49,28 @@ module Couchbase
       end
     end
 
+    # Stores values as JSON documents. By default it uses
+    # {Transcoder::NativeJSON} codec from the extension, set
+    # {Document.native=} to +false+ to go through MultiJson instead.
     module Document
+      def self.encode(obj)
+        native? ? NativeJSON.dump(obj) : MultiJson.dump(obj)
+      end
+
+      def self.decode(blob)
+        native? ? NativeJSON.load(blob) : MultiJson.load(blob)
+      end
+
       def self.dump(obj, flags, options = {})
         [
-          MultiJson.dump(obj),
+          encode(obj),
           (flags & ~Bucket::FMT_MASK) | Bucket::FMT_DOCUMENT
         ]
       end
 
       def self.load(blob, flags, options = {})
         if (flags & Bucket::FMT_MASK) == Bucket::FMT_DOCUMENT || options[:forced]
-          MultiJson.load(blob)
+          decode(blob)
         else
           if Compat.enabled?
             return Compat.guess_and_load(blob, flags, options)
@@ -74,14 +74,17 @@ module Couchbase
     class AsyncHelper # :nodoc:
       include Constants
       EMPTY = []
+      PENDING = Object.new.freeze
 
-      def initialize(wrapper_class, bucket, include_docs, quiet, block)
+      def initialize(wrapper_class, bucket, include_docs, quiet, window, block)
         @wrapper_class = wrapper_class
         @bucket = bucket
         @block = block
         @quiet = quiet
         @include_docs = include_docs
+        @window = window
         @queue = []
+        @batch = []
         @first = @shift = 0
         @completed = false
       end
@@ -89,18 +92,9 @@ module Couchbase
       # Register object in the emitter.
       def push(obj)
         if @include_docs
-          @queue << obj
-          @bucket.get(obj[S_ID], :extended => true, :quiet => @quiet) do |res|
-            obj[S_DOC] = {
-              S_VALUE => res.value,
-              S_META => {
-                S_ID => obj[S_ID],
-                S_FLAGS => res.flags,
-                S_CAS => res.cas
-              }
-            }
-            check_for_ready_documents
-          end
+          @batch << [@queue.size + @shift, obj]
+          @queue << PENDING
+          flush if @window && @batch.size >= @window
         else
           old_obj = @queue.shift
           @queue << obj
@@ -108,21 +102,49 @@ module Couchbase
         end
       end
 
+      # Fetch the documents for the rows collected since the last flush
+      # with single multi-get.
+      def flush
+        return if @batch.empty?
+        batch, @batch = @batch, []
+        ids = batch.map { |_, obj| View.row_id(obj) }.compact.uniq
+        if ids.empty?
+          attach_docs(batch, {})
+        else
+          @bucket.get(ids, :extended => true, :quiet => @quiet, :batch_callback => true) do |results|
+            found = {}
+            results.each { |res| found[res.key] = res }
+            attach_docs(batch, found)
+          end
+        end
+      end
+
       def complete!
         if @include_docs
           @completed = true
+          flush
           check_for_ready_documents
         elsif !@queue.empty?
           obj = @queue.shift
-          obj[S_IS_LAST] = true
+          obj[S_IS_LAST] = true if obj.is_a?(Hash)
           block_call obj
         end
       end
 
       private
 
+      def attach_docs(batch, found)
+        batch.each do |pos, obj|
+          res = found[View.row_id(obj)]
+          val, flags, cas = res.value, res.flags, res.cas if res
+          @queue[pos - @shift] = View.with_doc(obj, val, flags, cas)
+        end
+        check_for_ready_documents
+      end
+
+      # Compact rows (wrapper_class is nil) are yielded as is
       def block_call(obj)
-        @block.call @wrapper_class.wrap(@bucket, obj)
+        @block.call(@wrapper_class ? @wrapper_class.wrap(@bucket, obj) : obj)
       end
 
       def check_for_ready_documents
@@ -131,10 +153,10 @@ module Couchbase
         save_last = @completed ? 0 : 1
         while @first < queue.size + shift - save_last
           obj = queue[@first - shift]
-          break unless obj[S_DOC]
+          break if obj.equal?(PENDING)
           queue[@first - shift] = nil
           @first += 1
-          if @completed && @first == queue.size + shift
+          if @completed && @first == queue.size + shift && obj.is_a?(Hash)
             obj[S_IS_LAST] = true
           end
           block_call obj
@@ -269,6 +291,10 @@ module Couchbase
     #   is fetched from the in memory cache where it may have been changed
     #   or even deleted. See also +:quiet+ parameter below to control error
     #   reporting during fetch.
+    # @option params [Fixnum] :include_docs_window The maximum number of
+    #   documents fetched by single multi-get for +:include_docs+. By
+    #   default the documents are fetched for all rows of the received
+    #   chunk of the response at once (since 1.3.8)
     # @option params [true, false] :quiet (true) Do not raise error if
     #   associated document not found in the memory. If the parameter +true+
     #   will use +nil+ value instead.
@@ -316,6 +342,12 @@ module Couchbase
     #   :ok::           Allow stale views
     #   :update_after:: Allow stale view, update view after it has been
     #                   accessed
+    # @option params [true, false] :compact (false) Yield rows as frozen
+    #   arrays +[id, key, value]+ (+[id, key, value, doc]+ with
+    #   +:include_docs+) instead of {ViewRow} instances (or instances of
+    #   +:wrapper_class+). It is cheaper for large result sets. Compact rows
+    #   don't mark the last row, so {View#fetch_all} doesn't support it in
+    #   asynchronous mode (since 1.3.8)
     # @option params [Hash] :body Accepts the same parameters, except
     #   +:body+ of course, but sends them in POST body instead of query
     #   string. It could be useful for really large and complex parameters.
@@ -361,6 +393,8 @@ module Couchbase
       params = @params.merge(params)
       include_docs = params.delete(:include_docs)
       quiet = params.delete(:quiet){ true }
+      compact = params.delete(:compact)
+      window = params.delete(:include_docs_window)
 
       options = {:chunked => true, :extended => true, :type => :view}
       if body = params.delete(:body)
@@ -372,10 +406,10 @@ module Couchbase
 
       if @bucket.async?
         if block
-          fetch_async(request, include_docs, quiet, block)
+          fetch_async(request, include_docs, quiet, compact, window, block)
         end
       else
-        fetch_sync(request, include_docs, quiet, block)
+        fetch_sync(request, include_docs, quiet, compact, window, block)
       end
     end
 
@@ -393,6 +427,9 @@ module Couchbase
     def fetch_all(params = {}, &block)
       return fetch(params) unless @bucket.async?
       raise ArgumentError, "Block needed for fetch_all in async mode" unless block
+      if @params.merge(params)[:compact]
+        raise ArgumentError, "fetch_all doesn't support compact rows in async mode"
+      end
 
       all = []
       fetch(params) do |row|
@@ -411,6 +448,29 @@ module Couchbase
       %(#<#{self.class.name}:#{self.object_id} @endpoint=#{@endpoint.inspect} @params=#{@params.inspect}>)
     end
 
+    # Returns the document id of the row
+    def self.row_id(obj) # :nodoc:
+      obj.is_a?(Array) ? obj[0] : obj[S_ID]
+    end
+
+    # Attaches the document fetched for +:include_docs+ to the row.
+    # Compact rows are frozen, so new row is returned.
+    def self.with_doc(obj, val, flags, cas) # :nodoc:
+      if obj.is_a?(Array)
+        [obj[0], obj[1], obj[2], val].freeze
+      else
+        obj[S_DOC] = {
+          S_VALUE => val,
+          S_META => {
+            S_ID => obj[S_ID],
+            S_FLAGS => flags,
+            S_CAS => cas
+          }
+        }
+        obj
+      end
+    end
+
     private
 
     def send_error(*args)
@@ -421,15 +481,18 @@ module Couchbase
       end
     end
 
-    def fetch_async(request, include_docs, quiet, block)
-      filter = ["/rows/", "/errors/"]
-      parser = YAJI::Parser.new(:filter => filter, :with_path => true)
-      helper = AsyncHelper.new(@wrapper_class, @bucket, include_docs, quiet, block)
+    def fetch_async(request, include_docs, quiet, compact, window, block)
+      parser = ViewParser.new(:compact => compact)
+      helper = AsyncHelper.new(compact ? nil : @wrapper_class, @bucket, include_docs, quiet, window, block)
 
       request.on_body do |chunk|
         if chunk.success?
           parser << chunk.value if chunk.value
-          helper.complete! if chunk.completed?
+          if chunk.completed?
+            helper.complete!
+          else
+            helper.flush
+          end
         else
           send_error("http_error", chunk.error)
         end
@@ -437,6 +500,8 @@ module Couchbase
 
       parser.on_object do |path, obj|
         case path
+        when "/total_rows"
+          # not used for streaming
         when "/errors/"
           from, reason = obj["from"], obj["reason"]
           send_error(from, reason)
@@ -449,58 +514,103 @@ module Couchbase
       nil
     end
 
-    def fetch_sync(request, include_docs, quiet, block)
-      res = []
-      filter = ["/rows/", "/errors/"]
-      unless block
-        filter << "/total_rows"
-        docs = ArrayWithTotalRows.new
+    # The rows are parsed as the chunks arrive. The request is paused
+    # after each chunk, which produced rows, so that the rows are
+    # yielded outside of the event loop, and the server is not read
+    # while the block is running. Therefore only one chunk is kept in
+    # the memory at a time.
+    def fetch_sync(request, include_docs, quiet, compact, window, block)
+      pending = []
+      docs = ArrayWithTotalRows.new unless block
+      emit = lambda do |obj|
+        doc = compact ? obj : @wrapper_class.wrap(@bucket, obj)
+        block ? block.call(doc) : docs << doc
       end
-      parser = YAJI::Parser.new(:filter => filter, :with_path => true)
+      parser = ViewParser.new(:compact => compact)
       last_chunk = nil
+      completed = false
+      waiting = false
 
       request.on_body do |chunk|
         last_chunk = chunk
-        res << chunk.value  if chunk.success?
+        completed = chunk.completed?
+        if chunk.success?
+          parser << chunk.value if chunk.value
+          # the operations called from the row block run the event loop
+          # too, pause only own wait and just buffer the rows otherwise
+          request.pause if waiting && !completed && !pending.empty?
+        end
       end
 
       parser.on_object do |path, obj|
-        case path
-        when "/total_rows"
-          # if total_rows key present, save it and take next object
-          docs.total_rows = obj
-        when "/errors/"
-          from, reason = obj["from"], obj["reason"]
-          send_error(from, reason)
-        else
-          if include_docs
-            val, flags, cas = @bucket.get(obj[S_ID], :extended => true, :quiet => quiet)
-            obj[S_DOC] = {
-              S_VALUE => val,
-              S_META => {
-                S_ID => obj[S_ID],
-                S_FLAGS => flags,
-                S_CAS => cas
-              }
-            }
-          end
-          doc = @wrapper_class.wrap(@bucket, obj)
-          block ? block.call(doc) : docs << doc
+        pending << path << obj
+      end
+
+      # returns true when the request is finished and released, even if
+      # the last chunk arrived while the row block was running
+      resume = lambda do
+        waiting = true
+        begin
+          request.continue
+        ensure
+          waiting = false
         end
+        completed
       end
 
-      request.continue
+      finished = false
+      begin
+        finished = resume.call
+        loop do
+          rows = []
+          while path = pending.shift
+            obj = pending.shift
+            case path
+            when "/total_rows"
+              # if total_rows key present, save it and take next object
+              docs.total_rows = obj if docs
+            when "/errors/"
+              from, reason = obj["from"], obj["reason"]
+              send_error(from, reason)
+            when "/rows/"
+              if include_docs
+                rows << obj
+                if window && rows.size >= window
+                  fetch_docs_sync(rows, quiet).each(&emit)
+                  rows = []
+                end
+              else
+                emit.call(obj)
+              end
+            end
+          end
+          fetch_docs_sync(rows, quiet).each(&emit) unless rows.empty?
+          break if finished
+          finished = resume.call
+        end
 
-      if last_chunk.success?
-        while value = res.shift
-          parser << value
+        unless last_chunk.nil? || last_chunk.success?
+          send_error("http_error", last_chunk.error, nil)
         end
-      else
-        send_error("http_error", last_chunk.error, nil)
+      ensure
+        # the block might leave early (break, exception, error entry),
+        # don't let the rest of the view pile up in the closure
+        request.cancel unless finished
       end
 
       # return nil for call with block
       docs
     end
+
+    # Fetches the documents for the rows with single multi-get and
+    # returns the rows with documents attached
+    def fetch_docs_sync(rows, quiet)
+      ids = rows.map { |obj| View.row_id(obj) }.compact.uniq
+      found = ids.empty? ? {} : @bucket.get(ids, :extended => true, :quiet => quiet)
+      rows.map do |obj|
+        val, flags, cas = found[View.row_id(obj)]
+        View.with_doc(obj, val, flags, cas)
+      end
+    end
   end
 end
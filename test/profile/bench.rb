@@ -0,0 +1,267 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Self-contained benchmark. It doesn't need the cluster, the operations
+# are executed against local native mock server (see
+# ext/couchbase_mock, built with "rake mock"), and the results are
+# written as JSON.
+#
+# Useful environment variables:
+#
+# NODES (1)
+#   number of nodes in the cluster
+#
+# LATENCY_US (0)
+#   the latency injected into each response in microseconds
+#
+# LOOPS (10000)
+#   how many operations to run in each scenario
+#
+# TEST ('')
+#   run only scenarios which names match this regular expression, e.g.
+#   "get/sync"
+#
+# ENGINES (default)
+#   comma separated list of the engines (see :engine option of
+#   Couchbase::Bucket#initialize). Unsupported engines are skipped
+#
+# VALUE_SIZES (32,4096)
+#   comma separated list of value sizes in bytes
+#
+# MULTI_SIZES (10,100)
+#   comma separated list of the number of keys for multi-get
+#
+# OUTPUT ('')
+#   write JSON report to the file instead of stdout
+#
+# BASELINE ('')
+#   compare results with the report from previous run and exit with
+#   non-zero status if some scenario regressed
+#
+# TOLERANCE (0.1)
+#   relative difference of ops/sec and latency, considered as regression
+#
+
+require "rubygems"
+
+$LOAD_PATH << File.join(File.dirname(__FILE__), "..", "..", "lib")
+require 'couchbase'
+
+# Wrapper for the native mock server
+class NativeMock
+  attr_reader :host, :port, :bucket
+
+  def initialize(path, params = {})
+    @path = path
+    @host = "127.0.0.1"
+    @bucket = "default"
+    @num_nodes = params[:num_nodes] || 1
+    @latency_us = params[:latency_us] || 0
+  end
+
+  def start
+    @io = IO.popen([@path, "--host", @host, "--nodes", @num_nodes.to_s,
+                    "--latency-us", @latency_us.to_s, "--buckets", "#{@bucket}:"])
+    @port = @io.gets.to_i
+    self
+  end
+
+  def stop
+    return unless @io
+    Process.kill("TERM", @io.pid)
+    @io.close
+    @io = nil
+  end
+end
+
+class Bench
+  NUM_KEYS = 1000
+  PERCENTILES = [50, 99, 99.9]
+
+  def initialize(server)
+    @server = server
+    @loops = (ENV['LOOPS'] || 10000).to_i
+    @filter = ENV['TEST'] && !ENV['TEST'].empty? ? Regexp.new(ENV['TEST']) : nil
+    @engines = list(ENV['ENGINES'] || "default").map(&:to_sym)
+    @value_sizes = list(ENV['VALUE_SIZES'] || "32,4096").map(&:to_i)
+    @multi_sizes = list(ENV['MULTI_SIZES'] || "10,100").map(&:to_i)
+  end
+
+  def scenarios
+    res = []
+    @engines.each do |engine|
+      [:sync, :async].each do |mode|
+        @value_sizes.each do |size|
+          [false, true].each do |prefix|
+            common = {:engine => engine, :mode => mode, :size => size, :prefix => prefix}
+            res << common.merge(:op => :get, :multi => 1)
+            res << common.merge(:op => :set, :multi => 1)
+            @multi_sizes.each do |multi|
+              res << common.merge(:op => :get, :multi => multi)
+            end
+          end
+        end
+      end
+    end
+    res.each do |s|
+      s[:name] = [s[:multi] > 1 ? "get-multi#{s[:multi]}" : s[:op], s[:mode],
+        s[:engine], "#{s[:size]}b", s[:prefix] ? "prefix" : "noprefix"].join("/")
+    end
+    res.select { |s| @filter.nil? || s[:name] =~ @filter }
+  end
+
+  def run
+    report = {
+      "ruby" => RUBY_DESCRIPTION,
+      "server" => @server.class.name,
+      "libcouchbase" => Couchbase.libcouchbase_version,
+      "loops" => @loops,
+      "results" => {}
+    }
+    scenarios.each do |s|
+      result = run_scenario(s)
+      report["results"][s[:name]] = result if result
+    end
+    report
+  end
+
+  protected
+
+  def list(str)
+    str.split(",").map(&:strip).reject(&:empty?)
+  end
+
+  def connect(s)
+    Couchbase.new(:hostname => @server.host, :port => @server.port,
+                  :bucket => @server.bucket, :engine => s[:engine],
+                  :bootstrap_transports => [:http],
+                  :default_format => :plain,
+                  :key_prefix => s[:prefix] ? "bench:" : nil)
+  rescue ArgumentError, Couchbase::Error::Base => ex
+    $stderr.puts "#{s[:name]}: skipped (#{ex.message})"
+    nil
+  end
+
+  def run_scenario(s)
+    conn = connect(s) or return
+    keys = Array.new(NUM_KEYS) { |ii| "bench-#{ii}" }
+    value = "x" * s[:size]
+    keys.each { |key| conn.set(key, value) }
+    batches = keys.each_slice(s[:multi]).to_a
+    nbatches = @loops / s[:multi]
+    ops = nbatches * s[:multi]
+
+    conn.reset_latency_stats
+    GC.start
+    allocated = allocated_objects
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    if s[:mode] == :sync
+      nbatches.times { |ii| exercise(conn, s, batches[ii % batches.size], value) }
+    else
+      conn.run do
+        nbatches.times { |ii| exercise(conn, s, batches[ii % batches.size], value) { |r| } }
+      end
+    end
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+    allocated = allocated_objects - allocated if allocated
+
+    latency = conn.latency_stats(:merge => true, :percentiles => PERCENTILES)[s[:op]]
+    result = {
+      "ops" => ops,
+      "ops_per_sec" => (ops / elapsed).round(1),
+      "allocations_per_op" => allocated ? (allocated.to_f / ops).round(2) : nil
+    }
+    if latency
+      result["p50_us"] = latency[:percentiles][50].round(1)
+      result["p99_us"] = latency[:percentiles][99].round(1)
+      result["p999_us"] = latency[:percentiles][99.9].round(1)
+    end
+    $stderr.puts "#{s[:name]}: #{result["ops_per_sec"]} ops/sec"
+    result
+  ensure
+    conn.disconnect if conn
+  end
+
+  def exercise(conn, s, batch, value, &block)
+    if s[:op] == :set
+      conn.set(batch.first, value, &block)
+    elsif batch.size == 1
+      conn.get(batch.first, &block)
+    else
+      conn.get(batch, &block)
+    end
+  end
+
+  def allocated_objects
+    GC.stat[:total_allocated_objects]
+  end
+end
+
+# Returns the list of regressions of current report comparing to the
+# baseline
+def compare(baseline, current, tolerance)
+  regressions = []
+  current["results"].each do |name, cur|
+    base = baseline["results"][name] or next
+    if cur["ops_per_sec"] < base["ops_per_sec"] * (1 - tolerance)
+      regressions << "#{name}: ops/sec #{base["ops_per_sec"]} -> #{cur["ops_per_sec"]}"
+    end
+    %w(p50_us p99_us).each do |metric|
+      next unless base[metric] && cur[metric]
+      if cur[metric] > base[metric] * (1 + tolerance)
+        regressions << "#{name}: #{metric} #{base[metric]} -> #{cur[metric]}"
+      end
+    end
+    if base["allocations_per_op"] && cur["allocations_per_op"] &&
+        cur["allocations_per_op"] > base["allocations_per_op"] + 0.5
+      regressions << "#{name}: allocations/op #{base["allocations_per_op"]} -> #{cur["allocations_per_op"]}"
+    end
+  end
+  regressions
+end
+
+native_path = File.join(File.dirname(__FILE__), "..", "couchbase_mock")
+unless File.executable?(native_path)
+  abort "#{native_path} not found, build it with \"rake mock\""
+end
+server = NativeMock.new(native_path, :num_nodes => (ENV['NODES'] || 1).to_i,
+                        :latency_us => (ENV['LATENCY_US'] || 0).to_i)
+server.start
+begin
+  report = Bench.new(server).run
+ensure
+  server.stop
+end
+
+json = MultiJson.dump(report, :pretty => true)
+if ENV['OUTPUT'] && !ENV['OUTPUT'].empty?
+  File.open(ENV['OUTPUT'], "w") { |f| f.puts(json) }
+else
+  puts json
+end
+
+if ENV['BASELINE'] && !ENV['BASELINE'].empty?
+  baseline = MultiJson.load(File.read(ENV['BASELINE']))
+  regressions = compare(baseline, report, (ENV['TOLERANCE'] || 0.1).to_f)
+  if regressions.empty?
+    $stderr.puts "no regressions comparing to #{ENV['BASELINE']}"
+  else
+    $stderr.puts "regressions comparing to #{ENV['BASELINE']}:"
+    regressions.each { |line| $stderr.puts "  #{line}" }
+    exit(1)
+  end
+end
@@ -63,12 +63,18 @@ end
 class CouchbaseMock
   Monitor = Struct.new(:pid, :client, :socket, :port)
 
-  attr_accessor :host, :port, :buckets_spec, :num_nodes, :num_vbuckets
+  attr_accessor :host, :port, :buckets_spec, :num_nodes, :num_vbuckets, :latency_us
 
   def real?
     false
   end
 
+  # Use native mock server (see ext/couchbase_mock) instead of
+  # CouchbaseMock.jar
+  def native?
+    ENV['COUCHBASE_MOCK'] == 'native'
+  end
+
   def initialize(params = {})
     @host = "127.0.0.1"
     @port = 0
@@ -90,7 +96,7 @@ class CouchbaseMock
     @monitor.socket.listen(10)
     _, @monitor.port, _, _ = @monitor.socket.addr
     trap("CLD") do
-      puts "CouchbaseMock.jar died unexpectedly during startup"
+      puts "#{native? ? "couchbase_mock" : "CouchbaseMock.jar"} died unexpectedly during startup"
       exit(1)
     end
     @monitor.pid = fork
@@ -121,7 +127,12 @@ class CouchbaseMock
   protected
 
   def command_line(extra = nil)
-    cmd = "java -jar #{File.dirname(__FILE__)}/CouchbaseMock.jar"
+    if native?
+      cmd = "#{File.dirname(__FILE__)}/couchbase_mock"
+      cmd << " --latency-us #{@latency_us}" if @latency_us
+    else
+      cmd = "java -jar #{File.dirname(__FILE__)}/CouchbaseMock.jar"
+    end
     cmd << " --host #{@host}" if @host
     cmd << " --port #{@port}" if @port
     cmd << " --nodes #{@num_nodes}" if @num_nodes
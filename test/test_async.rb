@@ -38,6 +38,72 @@ class TestAsync < MiniTest::Test
     assert obj.respond_to?(:flags)
   end
 
+  def test_result_object_could_be_initialized_with_attributes
+    obj = Couchbase::Result.new(:key => "foo", :operation => :get, :cas => 1)
+    assert_equal "foo", obj.key
+    assert_equal :get, obj.operation
+    assert_equal 1, obj.cas
+    assert_nil obj.flags
+    assert obj.success?
+    assert_match(/operation=:get key="foo" cas=1/, obj.inspect)
+  end
+
+  def test_async_result_exposes_all_attributes
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    cas = connection.set(uniq_id, "foo", :flags => 0x100)
+    res = nil
+    connection.run do |conn|
+      conn.get(uniq_id) { |ret| res = ret }
+    end
+    assert res.success?
+    assert_equal :get, res.operation
+    assert_equal uniq_id, res.key
+    assert_equal "foo", res.value
+    assert_equal cas, res.cas
+    assert_equal 0x100, res.flags & ~Couchbase::Bucket::FMT_MASK
+    res.instance_variable_set("@operation", :custom)
+    assert_equal :custom, res.operation
+  end
+
+  def test_result_could_be_copied_and_marshalled
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    cas = connection.set(uniq_id, "foo")
+    res = nil
+    connection.run do |conn|
+      conn.get(uniq_id) { |ret| res = ret }
+    end
+    [res.dup, res.clone, Marshal.load(Marshal.dump(res))].each do |copy|
+      assert_equal :get, copy.operation
+      assert_equal uniq_id, copy.key
+      assert_equal "foo", copy.value
+      assert_equal cas, copy.cas
+      assert copy.success?
+    end
+  end
+
+  def test_batch_callback_yields_all_results_at_once
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    keys = (1..5).map { |i| uniq_id(i) }
+    calls = []
+    connection.run do |conn|
+      conn.set(Hash[keys.map { |k| [k, k] }], :batch_callback => true) do |results|
+        calls << results
+      end
+    end
+    assert_equal 1, calls.size
+    assert_equal keys.sort, calls[0].map(&:key).sort
+    assert calls[0].all? { |r| r.success? && r.operation == :set }
+
+    calls.clear
+    connection.run do |conn|
+      conn.get(keys, :batch_callback => true) { |results| calls << results }
+      conn.delete(keys.first, :batch_callback => true) { |results| calls << results }
+    end
+    assert_equal 2, calls.size
+    assert_equal keys.sort, calls[0].map(&:value).sort
+    assert_equal [:delete], calls[1].map(&:operation)
+  end
+
   def test_it_requires_block_for_running_loop
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
     refute connection.async?
@@ -250,6 +316,50 @@ class TestAsync < MiniTest::Test
     end
   end
 
+  def test_max_ops_flush_policy
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+
+    sent = 0
+    connection.run(:max_ops => 3) do
+      connection.set(uniq_id(1), "foo") {|r| sent += 1}
+      connection.set(uniq_id(2), "foo") {|r| sent += 1}
+      assert_equal 0, sent
+      connection.set(uniq_id(3), "foo") {|r| sent += 1}
+      assert_equal 3, sent
+    end
+  end
+
+  def test_adaptive_flush_policy
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+
+    sent = 0
+    connection.run(:adaptive => true, :max_linger => 1_000_000) do
+      100.times do |ii|
+        connection.set(uniq_id(ii), "x" * 1000) {|r| sent += 1}
+      end
+      assert sent > 0, "adaptive threshold (8Kb initially) must flush the buffer"
+    end
+    assert_equal 100, sent
+  end
+
+  def test_in_flight_limits
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+
+    sent = 0
+    connection.run(:max_in_flight_ops => 2) do
+      connection.set(uniq_id(1), "foo") {|r| sent += 1}
+      assert_equal 1, connection.in_flight_ops
+      assert connection.in_flight_bytes > 0
+      connection.set(uniq_id(2), "foo") {|r| sent += 1}
+      assert sent > 0, "the limit must block the submitter until the response"
+      assert connection.in_flight_ops < 2
+      connection.set(uniq_id(3), "foo") {|r| sent += 1}
+    end
+    assert_equal 3, sent
+    assert_equal 0, connection.in_flight_ops
+    assert_equal 0, connection.in_flight_bytes
+  end
+
   def test_asynchronous_connection
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :async => true)
     refute connection.connected?, "new asynchronous connection must be disconnected"
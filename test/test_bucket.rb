@@ -285,4 +285,21 @@ class TestBucket < MiniTest::Test
       assert double.connected?, "duplicate connection should be alive"
     end
   end
+
+  def test_it_supports_io_uring_engine
+    with_mock do |mock|
+      begin
+        connection = Couchbase.new(:hostname => mock.host,
+                                   :port => mock.port,
+                                   :engine => :io_uring)
+      rescue ArgumentError
+        skip "io_uring engine isn't available in this build"
+      end
+      connection.set(uniq_id, "bar")
+      assert_equal "bar", connection.get(uniq_id)
+      connection.run do |conn|
+        conn.get(uniq_id, uniq_id) { |res| assert_equal "bar", res.value }
+      end
+    end
+  end
 end
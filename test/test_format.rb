@@ -73,6 +73,31 @@ class TestFormat < MiniTest::Test
     end
   end
 
+  def test_native_json_codec_round_trip
+    orig_doc = {"name" => "Twoflower", "tags" => ["tourist", nil, true, false],
+                "luggage" => {"legs" => 100, "weight" => 12.5}, "quote" => "\"Hi\"\n\u00e9"}
+    blob = Couchbase::Transcoder::NativeJSON.dump(orig_doc)
+    assert_equal orig_doc, MultiJson.load(blob)
+    assert_equal orig_doc, Couchbase::Transcoder::NativeJSON.load(blob)
+    assert_equal 42, Couchbase::Transcoder::NativeJSON.load("42")
+    assert_nil Couchbase::Transcoder::NativeJSON.load("  ")
+    assert_raises(ArgumentError) do
+      Couchbase::Transcoder::NativeJSON.load('{"foo":')
+    end
+  end
+
+  def test_document_format_could_use_multi_json
+    orig_doc = {'name' => 'Twoflower', 'role' => 'The tourist'}
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    assert Couchbase::Transcoder::Document.native?
+    Couchbase::Transcoder::Document.native = false
+    connection.set(uniq_id, orig_doc)
+    Couchbase::Transcoder::Document.native = true
+    assert_equal orig_doc, connection.get(uniq_id)
+  ensure
+    Couchbase::Transcoder::Document.native = true
+  end
+
   def test_it_could_dump_arbitrary_class_using_marshal_format
     orig_doc = ArbitraryClass.new("Twoflower", "The tourist")
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
@@ -84,6 +109,22 @@ class TestFormat < MiniTest::Test
     assert_equal 'The tourist', doc.role
   end
 
+  def test_it_respects_forced_format_for_stock_transcoders
+    orig_doc = ArbitraryClass.new("Twoflower", "The tourist")
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.set(uniq_id, orig_doc, :format => :marshal)
+    blob = connection.get(uniq_id, :format => :plain)
+    assert_equal Marshal.dump(orig_doc), blob
+    doc = connection.get(uniq_id, :format => :marshal)
+    assert_equal orig_doc, doc
+  end
+
+  def test_it_falls_back_to_compat_mode_on_flags_mismatch
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :default_format => :plain)
+    connection.set(uniq_id, {"foo" => "bar"}, :format => :document)
+    assert_equal({"foo" => "bar"}, connection.get(uniq_id))
+  end
+
   def test_it_accepts_only_string_in_plain_mode
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :default_format => :plain)
     connection.set(uniq_id, "1")
@@ -61,6 +61,17 @@ class TestGet < MiniTest::Test
     assert_equal "foo2", val2
   end
 
+  def test_multi_get_preserves_order_of_keys
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :quiet => true)
+
+    connection.set(uniq_id(1), "foo1")
+    connection.set(uniq_id(2), "foo2")
+
+    keys = [uniq_id(2), uniq_id(:missing), uniq_id(1), uniq_id(2)]
+    assert_equal ["foo2", nil, "foo1", "foo2"], connection.get(keys)
+    assert_equal ["foo1"], connection.get([uniq_id(1)])
+  end
+
   def test_multi_get_extended
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
 
@@ -194,6 +205,20 @@ class TestGet < MiniTest::Test
     checks.call
   end
 
+  def test_asynchronous_get_returns_request_keys
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :key_prefix => "prefix:")
+    keys = [uniq_id(1).freeze, uniq_id(2).freeze]
+    connection.set(keys[0] => "foo1", keys[1] => "foo2")
+
+    res = {}
+    connection.run do |conn|
+      conn.get(keys) {|ret| res[ret.value] = ret.key}
+    end
+    assert_same keys[0], res["foo1"]
+    assert_same keys[1], res["foo2"]
+    assert_equal({keys[0] => "foo1"}, connection.get(keys[0], :assemble_hash => true))
+  end
+
   def test_asynchronous_multi_get
     connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
     connection.set(uniq_id(1), "foo")
@@ -404,4 +429,37 @@ class TestGet < MiniTest::Test
     expected = {uniq_id(1) => "foo", uniq_id(2) => "bar"}
     assert_equal expected, connection.get(uniq_id(1), uniq_id(2), :assemble_hash => true)
   end
+
+  def test_get_with_timeout_option_returns_before_deadline
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.set(uniq_id, "bar")
+    started = Time.now
+    assert_equal "bar", connection.get(uniq_id, :timeout => 5_000_000)
+    assert_operator Time.now - started, :<, 1
+  end
+
+  def test_get_with_timeout_option_in_async_mode
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.run do |conn|
+      assert_raises(ArgumentError) do
+        conn.get(uniq_id, :timeout => 1_000_000) {}
+      end
+    end
+  end
+
+  def test_get_with_timeout_option_raises_past_deadline
+    unless @mock.respond_to?(:native?) && @mock.native?
+      skip("latency requires native mock (COUCHBASE_MOCK=native)")
+    end
+    with_mock(:latency_us => 200_000) do |mock|
+      connection = Couchbase.new(:hostname => mock.host, :port => mock.port)
+      connection.set(uniq_id, "bar")
+      assert_raises(Couchbase::Error::Timeout) do
+        connection.get(uniq_id, :timeout => 50_000)
+      end
+      # late response of timed out operation doesn't affect the next ones
+      assert_equal "bar", connection.get(uniq_id)
+      assert_equal ["bar", nil], connection.get(uniq_id, uniq_id(1), :quiet => true)
+    end
+  end
 end
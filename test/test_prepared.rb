@@ -0,0 +1,69 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+require File.join(File.dirname(__FILE__), 'setup')
+
+class TestPrepared < MiniTest::Test
+
+  def setup
+    @mock = start_mock
+  end
+
+  def teardown
+    stop_mock(@mock)
+  end
+
+  def test_prepared_set_and_get
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    set = connection.prepare(:set, :format => :marshal, :flags => 0x100)
+    get = connection.prepare(:get, :format => :marshal, :extended => true)
+    assert_equal :set, set.operation
+
+    value = {:foo => [1, 2]}
+    cas = set.call(uniq_id, value)
+    assert cas.is_a?(Numeric)
+    val, flags, cas2 = get.call(uniq_id)
+    assert_equal value, val
+    assert_equal 0x100 | Couchbase::Bucket::FMT_MARSHAL, flags
+    assert_equal cas, cas2
+  end
+
+  def test_prepared_get_multiple_keys
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.set(uniq_id(1), "foo1")
+    connection.set(uniq_id(2), "foo2")
+    get = connection.prepare(:get, :quiet => true)
+    assert_equal ["foo1", nil, "foo2"], get.call(uniq_id(1), uniq_id(:missing), uniq_id(2))
+  end
+
+  def test_prepared_store_treats_hash_as_value
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    add = connection.prepare(:add)
+    add.call(uniq_id, "foo" => "bar")
+    assert_equal({"foo" => "bar"}, connection.get(uniq_id))
+    assert_raises(Couchbase::Error::KeyExists) do
+      add.call(uniq_id, "baz")
+    end
+  end
+
+  def test_it_rejects_unsupported_operations
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    assert_raises(ArgumentError) do
+      connection.prepare(:stats)
+    end
+  end
+end
@@ -0,0 +1,89 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+require File.join(File.dirname(__FILE__), 'setup')
+
+class TestSharedBucket < MiniTest::Test
+
+  def setup
+    @mock = start_mock
+    @shared = Couchbase::SharedBucket.new(:hostname => @mock.host, :port => @mock.port)
+  end
+
+  def teardown
+    stop_mock(@mock)
+  end
+
+  def test_multithreaded_usage
+    threads = (1..15).map do |ii|
+      Thread.new do
+        @shared.set(uniq_id(ii), ii)
+        @shared.incr(uniq_id(:counter), :create => true, :initial => 1)
+        @shared.get(uniq_id(ii))
+      end
+    end
+    assert_equal (1..15).to_a, threads.map(&:value)
+    assert_equal 15, @shared.get(uniq_id(:counter))
+  end
+
+  def test_errors_are_raised_in_calling_thread
+    assert_raises(Couchbase::Error::NotFound) do
+      @shared.get(uniq_id(:missing), :quiet => false)
+    end
+    assert_nil @shared.get(uniq_id(:missing), :quiet => true)
+  end
+
+  def test_failed_request_does_not_affect_others
+    threads = (1..10).map do |ii|
+      Thread.new do
+        value = ii == 5 ? Object.new : "foo#{ii}"
+        begin
+          @shared.set(uniq_id(ii), value, :format => :plain)
+        rescue Couchbase::Error::ValueFormat => ex
+          ex
+        end
+      end
+    end
+    results = threads.map(&:value)
+    assert_kind_of Couchbase::Error::ValueFormat, results.delete_at(4)
+    results.each { |cas| assert_kind_of Integer, cas }
+    assert_equal "foo1", @shared.get(uniq_id(1))
+  end
+
+  def test_disconnect_stops_dispatcher
+    @shared.set(uniq_id, "foo")
+    @shared.disconnect
+    refute @shared.instance_variable_get(:@dispatcher).alive?
+    assert_raises(Couchbase::Error::Connect) do
+      @shared.get(uniq_id)
+    end
+  end
+
+  def test_requests_fail_when_dispatcher_dies
+    @shared.instance_variable_get(:@dispatcher).kill.join
+    assert_raises(Couchbase::Error::Connect) do
+      @shared.get(uniq_id)
+    end
+  end
+
+  def test_other_operations_are_executed_synchronously
+    @shared.set(uniq_id(1) => "foo1", uniq_id(2) => "foo2")
+    assert_equal ["foo1", "foo2"], @shared.get(uniq_id(1), uniq_id(2))
+    assert @shared.delete(uniq_id(1))
+    assert_kind_of Hash, @shared.stats
+  end
+end
@@ -54,4 +54,58 @@ class TestStats < MiniTest::Test
     end
   end
 
+  def test_latency_stats
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.reset_latency_stats
+    10.times do |ii|
+      connection.set(uniq_id(ii), "x" * 100, :format => :plain)
+      connection.get(uniq_id(ii))
+    end
+    stats = connection.latency_stats(:percentiles => [50, 99.9])
+    gets = stats.values.map { |ops| ops[:get] }.compact
+    assert_equal 10, gets.inject(0) { |sum, s| sum + s[:count] }
+    get = gets.first
+    assert get[:min] <= get[:percentiles][50]
+    assert get[:percentiles][50] <= get[:percentiles][99.9]
+    assert get[:percentiles][99.9] <= get[:max]
+    assert_equal 100, get[:size][:max]
+    sets = stats.values.map { |ops| ops[:set] }.compact
+    assert_equal 10, sets.inject(0) { |sum, s| sum + s[:count] }
+
+    connection.latency_stats(:reset => true)
+    assert_equal({}, connection.latency_stats)
+  end
+
+  def test_latency_stats_can_be_turned_off
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port,
+                               :collect_latency => false)
+    refute connection.collect_latency?
+    connection.set(uniq_id, "foo")
+    connection.get(uniq_id)
+    assert_equal({}, connection.latency_stats)
+
+    connection.collect_latency = true
+    connection.get(uniq_id)
+    gets = connection.latency_stats.values.map { |ops| ops[:get] }.compact
+    assert_equal 1, gets.inject(0) { |sum, s| sum + s[:count] }
+  end
+
+  def test_latency_stats_merged_across_nodes
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+    connection.reset_latency_stats
+    20.times do |ii|
+      connection.set(uniq_id(ii), "x" * (ii + 1), :format => :plain)
+      connection.get(uniq_id(ii))
+    end
+    per_node = connection.latency_stats.values.map { |ops| ops[:get] }.compact
+    get = connection.latency_stats(:merge => true, :percentiles => [50, 99])[:get]
+    assert_equal 20, get[:count]
+    assert_equal per_node.map { |s| s[:min] }.min, get[:min]
+    assert_equal per_node.map { |s| s[:max] }.max, get[:max]
+    assert_equal 1, get[:size][:min]
+    assert_equal 20, get[:size][:max]
+    assert get[:percentiles][50] <= get[:percentiles][99]
+    assert_equal 20, connection.latency_stats(:merge => true)[:set][:count]
+  end
+
 end
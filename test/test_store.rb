@@ -171,6 +171,20 @@ class TestStore < MiniTest::Test
     assert_equal expected, connection.get("prefix:#{uniq_id(:foo)}", :assemble_hash => true)
   end
 
+  def test_single_key_operations_with_symbol_and_prefix
+    connection = Couchbase.new(:hostname => @mock.host, :port => @mock.port, :key_prefix => "prefix:")
+    key = uniq_id(:sym).to_sym
+    assert connection.set(key, "bar")
+    assert_equal "bar", connection.get(key)
+    assert connection.touch(key)
+    assert connection.delete(key)
+    assert_nil connection.get(key, :quiet => true)
+
+    connection.set(key, "1", :format => :plain)
+    assert_equal 2, connection.incr(key)
+    assert_equal 0, connection.decr(key, 2)
+  end
+
   ArbitraryData = Struct.new(:baz)
 
   def test_set_using_brackets
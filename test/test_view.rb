@@ -0,0 +1,142 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+require File.join(File.dirname(__FILE__), 'setup')
+
+class TestView < MiniTest::Test
+
+  def setup
+    @mock = start_mock
+    # only native mock returns rows for any view without design document
+    unless @mock.respond_to?(:native?) && @mock.native?
+      skip("views require native mock (COUCHBASE_MOCK=native)")
+    end
+  end
+
+  def teardown
+    stop_mock(@mock)
+  end
+
+  def connection
+    @connection ||= Couchbase.new(:hostname => @mock.host, :port => @mock.port)
+  end
+
+  def populate(num)
+    keys = Array.new(num) { |ii| uniq_id("%04d" % ii) }
+    keys.each { |key| connection.set(key, {"value" => key}) }
+    keys.sort
+  end
+
+  def view
+    Couchbase::View.new(connection, "_design/test/_view/all", :stale => false)
+  end
+
+  def test_sync_fetch_yields_rows_in_order
+    keys = populate(500)
+    ids = []
+    view.fetch { |row| ids << row.id }
+    assert_equal keys, ids
+  end
+
+  def test_sync_fetch_without_block
+    keys = populate(10)
+    docs = view.fetch
+    assert_equal keys.size, docs.total_rows
+    assert_equal keys, docs.map(&:id)
+  end
+
+  def test_sync_fetch_allows_bucket_calls_in_block
+    keys = populate(50)
+    values = []
+    view.fetch { |row| values << connection.get(row.id)["value"] }
+    assert_equal keys, values
+  end
+
+  # the native mock writes view results in pieces of 4KB, so the rows
+  # arrive in several chunks while the block is calling the bucket
+  def test_sync_fetch_allows_bucket_calls_in_block_across_chunks
+    keys = populate(1000)
+    values = []
+    view.fetch { |row| values << connection.get(row.id)["value"] }
+    assert_equal keys, values
+    # the request is released and the connection is usable
+    connection.set(uniq_id(:after), "bar")
+    assert_equal "bar", connection.get(uniq_id(:after))
+  end
+
+  def test_sync_fetch_with_include_docs
+    keys = populate(20)
+    docs = view.fetch(:include_docs => true)
+    assert_equal keys, docs.map { |doc| doc.doc["value"] }
+  end
+
+  def test_break_from_sync_fetch_cancels_request
+    keys = populate(1000)
+    ids = []
+    view.fetch do |row|
+      ids << row.id
+      break if ids.size == 10
+    end
+    assert_equal keys[0, 10], ids
+    assert_equal 0, connection.live_contexts
+    # the rest of the view isn't delivered to the stale request
+    connection.set(uniq_id(:after), "bar")
+    assert_equal "bar", connection.get(uniq_id(:after))
+    assert_equal 0, connection.live_contexts
+  end
+
+  def test_sync_fetch_with_include_docs_across_chunks
+    keys = populate(1000)
+    docs = view.fetch(:include_docs => true, :quiet => true)
+    assert_equal keys, docs.map { |doc| doc.doc && doc.doc["value"] }
+    docs = view.fetch(:include_docs => true, :quiet => true, :include_docs_window => 16)
+    assert_equal keys, docs.map { |doc| doc.doc && doc.doc["value"] }
+  end
+
+  def test_compact_rows
+    keys = populate(10)
+    rows = view.fetch(:compact => true)
+    assert_equal keys, rows.map(&:first)
+    rows.each do |row|
+      assert row.frozen?
+      assert_equal 3, row.size
+    end
+  end
+
+  def test_compact_rows_with_include_docs
+    keys = populate(10)
+    rows = view.fetch(:compact => true, :include_docs => true)
+    assert_equal keys, rows.map { |row| row[3]["value"] }
+  end
+
+  def test_sync_fetch_with_include_docs_window
+    keys = populate(25)
+    docs = view.fetch(:include_docs => true, :include_docs_window => 4)
+    assert_equal keys, docs.map { |doc| doc.doc["value"] }
+  end
+
+  def test_async_fetch_with_include_docs
+    keys = populate(30)
+    docs = []
+    connection.run do
+      view.fetch(:include_docs => true, :include_docs_window => 8) { |doc| docs << doc }
+    end
+    assert_equal keys, docs.map { |doc| doc.doc["value"] }
+    assert docs.last.last?
+    assert docs[0...-1].none?(&:last?)
+  end
+end
@@ -0,0 +1,72 @@
+# Author:: Couchbase <info@couchbase.com>
+# Copyright:: 2011, 2012 Couchbase, Inc.
+# License:: Apache License, Version 2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+require File.join(File.dirname(__FILE__), 'setup')
+
+class TestViewParser < MiniTest::Test
+
+  RESPONSE = <<-JSON
+    {"total_rows":3,"rows":[
+      {"id":"a\\"b","key":["x",1,2.5,null,true],"value":{"n":-12345678901234567890}},
+      {"id":"\\u00e9\\ud83d\\ude00","key":"k\\n","value":null,"doc":{"meta":{"id":"z"},"json":{"a":[1,{}]}}},
+      {"key":5,"value":10}
+    ],
+    "errors":[{"from":"127.0.0.1:9500","reason":"missing"}]
+    }
+  JSON
+
+  def parse(options = {}, chunk_size = RESPONSE.size)
+    res = []
+    parser = Couchbase::ViewParser.new(options) { |path, obj| res << [path, obj] }
+    RESPONSE.scan(/.{1,#{chunk_size}}/m) { |chunk| parser << chunk }
+    res
+  end
+
+  def test_it_yields_objects_with_paths
+    res = parse
+    assert_equal ["/total_rows", "/rows/", "/rows/", "/rows/", "/errors/"], res.map(&:first)
+    assert_equal 3, res[0][1]
+    assert_equal({"id" => "a\"b", "key" => ["x", 1, 2.5, nil, true],
+                  "value" => {"n" => -12345678901234567890}}, res[1][1])
+    assert_equal "\u00e9\u{1F600}", res[2][1]["id"]
+    assert_equal({"a" => [1, {}]}, res[2][1]["doc"]["json"])
+    assert_equal({"key" => 5, "value" => 10}, res[3][1])
+    assert_equal({"from" => "127.0.0.1:9500", "reason" => "missing"}, res[4][1])
+  end
+
+  def test_it_handles_any_chunk_boundaries
+    expected = parse
+    [1, 2, 3, 7, 64].each do |size|
+      assert_equal expected, parse({}, size)
+    end
+  end
+
+  def test_compact_rows
+    rows = parse(:compact => true).select { |path, _| path == "/rows/" }.map(&:last)
+    assert_equal [["a\"b", ["x", 1, 2.5, nil, true], {"n" => -12345678901234567890}],
+                  ["\u00e9\u{1F600}", "k\n", nil],
+                  [nil, 5, 10]], rows
+    assert rows.all?(&:frozen?)
+  end
+
+  def test_malformed_response
+    parser = Couchbase::ViewParser.new {}
+    assert_raises(Couchbase::Error::ValueFormat) do
+      parser << '{"rows":[{"id" 1}]}'
+    end
+  end
+end